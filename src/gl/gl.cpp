@@ -1,5 +1,8 @@
 #include "gl.h"
 
+#include <cstring>
+#include <cstdio>
+
 #ifdef PLATFORM_RPI 
 
 #ifndef DRIVER_LEGACY
@@ -47,4 +50,36 @@ void imageTargetTexture2D(EGLenum target, EGLImageKHR image) {
     #endif
 }
 
-#endif
\ No newline at end of file
+#endif
+
+bool haveExtension(const std::string& _name) {
+#if !defined(PLATFORM_RPI) && defined(GL_NUM_EXTENSIONS)
+    // From GL 3 on they are listed one by one, core profiles fail asking for all of them at once
+    int major = 0;
+    const char* version = (const char*)glGetString(GL_VERSION);
+    if (version && sscanf(version, "%d", &major) == 1 && major >= 3) {
+        GLint total = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &total);
+        for (GLint i = 0; i < total; i++) {
+            const char* extension = (const char*)glGetStringi(GL_EXTENSIONS, i);
+            if (extension && _name == extension)
+                return true;
+        }
+        return false;
+    }
+#endif
+
+    const char* extensions = (const char*)glGetString(GL_EXTENSIONS);
+    if (!extensions)
+        return false;
+
+    // Whole words only (some names are the beginning of others)
+    const char* found = extensions;
+    while ((found = strstr(found, _name.c_str())) != NULL) {
+        char after = found[_name.size()];
+        if ((found == extensions || found[-1] == ' ') && (after == ' ' || after == '\0'))
+            return true;
+        found += _name.size();
+    }
+    return false;
+}
@@ -48,3 +48,8 @@ void imageTargetTexture2D(EGLenum target, EGLImageKHR image);
 #include <GLFW/glfw3.h>
 
 #endif
+
+#include <string>
+
+// If the current context has the extension _name
+bool haveExtension(const std::string& _name);
@@ -0,0 +1,213 @@
+#include "programCache.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#include <sys/utime.h>
+#else
+#include <utime.h>
+#endif
+
+#include "../io/fs.h"
+#include "../tools/text.h"
+
+// Once the binaries take more than this, the ones used longest ago are removed
+#define PROGRAMS_CACHE_MAX (64 * 1024 * 1024)
+
+static const char   cache_magic[8] = { 'G', 'L', 'S', 'L', 'V', 'P', 'B', '1' };
+static bool         cache_enabled = true;
+
+void setProgramCache(bool _enable) {
+    cache_enabled = _enable;
+}
+
+static const std::string& getDriver() {
+    static std::string driver;
+    if (driver.empty()) {
+        const char* strings[3] = {  (const char*)glGetString(GL_VENDOR),
+                                    (const char*)glGetString(GL_RENDERER),
+                                    (const char*)glGetString(GL_VERSION) };
+        for (int i = 0; i < 3; i++)
+            driver += std::string(strings[i] ? strings[i] : "") + '\n';
+    }
+    return driver;
+}
+
+#ifdef PROGRAM_BINARIES
+
+static const std::string& getProgramsFolder() {
+    static std::string folder = getCacheFolder("programs");
+    return folder;
+}
+
+// Loading a binary touches it, so the modification time tells when it was last used.
+// The folder is only listed the first time and when the running total goes past the limit
+static void pruneCache(size_t _saved) {
+    static long long cache_size = -1;
+    if (cache_size >= 0) {
+        cache_size += _saved;
+        if (cache_size <= PROGRAMS_CACHE_MAX)
+            return;
+    }
+
+    struct Entry {
+        std::string path;
+        time_t      time;
+        size_t      size;
+    };
+
+    const std::string& folder = getProgramsFolder();
+    std::vector<std::string> files = glob(folder + "*.bin");
+    std::vector<Entry> entries;
+    size_t total = 0;
+    for (size_t i = 0; i < files.size(); i++) {
+        // On Windows glob() gives just the names
+        std::string path = (files[i].find(folder) == 0) ? files[i] : folder + files[i];
+        struct stat st;
+        if (stat(path.c_str(), &st) != 0)
+            continue;
+        entries.push_back({ path, st.st_mtime, (size_t)st.st_size });
+        total += (size_t)st.st_size;
+    }
+
+    if (total > PROGRAMS_CACHE_MAX) {
+        std::sort(entries.begin(), entries.end(), [](const Entry& _a, const Entry& _b) { return _a.time < _b.time; });
+
+        // The newest one (the one just saved) always stays
+        for (size_t i = 0; i + 1 < entries.size() && total > PROGRAMS_CACHE_MAX; i++) {
+            if (remove(entries[i].path.c_str()) == 0)
+                total -= entries[i].size;
+        }
+    }
+    cache_size = (long long)total;
+}
+
+static bool isSupported() {
+    static int supported = -1;
+    if (supported == -1) {
+        GLint formats = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        supported = formats > 0;
+    }
+    return supported == 1;
+}
+
+#endif
+
+std::string getProgramKey(const std::string& _vertexSrc, const std::string& _fragmentSrc) {
+    std::string all = getDriver() + _vertexSrc + '\0' + _fragmentSrc;
+    // Two different seeds make a 128 bits name
+    std::ostringstream key;
+    key << std::hex << std::setfill('0')
+        << std::setw(16) << hashString(all, 14695981039346656037ULL)
+        << std::setw(16) << hashString(all, 7809847782465536322ULL);
+    return key.str();
+}
+
+#ifdef PROGRAM_BINARIES
+static bool useCache() {
+    return cache_enabled && isSupported() && !getProgramsFolder().empty();
+}
+#endif
+
+GLuint loadProgramBinary(const std::string& _key) {
+#ifdef PROGRAM_BINARIES
+    if (!useCache())
+        return 0;
+
+    std::string path = getProgramsFolder() + _key + ".bin";
+    std::ifstream file(path.c_str(), std::ios::binary);
+    if (!file.is_open())
+        return 0;
+
+    char magic[8];
+    GLenum format = 0;
+    unsigned int length = 0;
+    file.read(magic, sizeof(magic));
+    file.read((char*)&format, sizeof(format));
+    file.read((char*)&length, sizeof(length));
+    if (!file || memcmp(magic, cache_magic, sizeof(magic)) != 0 || length == 0)
+        return 0;
+
+    std::vector<char> binary(length);
+    file.read(&binary[0], length);
+    if (!file)
+        return 0;
+
+    GLuint program = glCreateProgram();
+    glProgramBinary(program, format, &binary[0], length);
+
+    // Drivers can refuse binaries (ex: after an update that kept the same version string)
+    GLint isLinked = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &isLinked);
+    if (isLinked == GL_FALSE) {
+        glDeleteProgram(program);
+        remove(path.c_str());
+        return 0;
+    }
+
+    utime(path.c_str(), NULL);
+    return program;
+#else
+    return 0;
+#endif
+}
+
+void prepareProgramBinary(GLuint _program) {
+#ifdef PROGRAM_BINARIES
+    if (cache_enabled && isSupported())
+        glProgramParameteri(_program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+#endif
+}
+
+bool saveProgramBinary(GLuint _program, const std::string& _key) {
+#ifdef PROGRAM_BINARIES
+    if (!useCache())
+        return false;
+
+    GLint length = 0;
+    glGetProgramiv(_program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0)
+        return false;
+
+    std::vector<char> binary(length);
+    GLenum format = 0;
+    GLsizei written = 0;
+    glGetProgramBinary(_program, length, &written, &format, &binary[0]);
+    if (written <= 0)
+        return false;
+
+    // Written aside and moved in place, so other instances never read half a file
+    std::string path = getProgramsFolder() + _key + ".bin";
+    std::string tmp = path + ".tmp";
+    std::ofstream file(tmp.c_str(), std::ios::binary);
+    if (!file.is_open())
+        return false;
+
+    unsigned int size = (unsigned int)written;
+    file.write(cache_magic, sizeof(cache_magic));
+    file.write((const char*)&format, sizeof(format));
+    file.write((const char*)&size, sizeof(size));
+    file.write(&binary[0], written);
+    file.close();
+
+    if (!file || rename(tmp.c_str(), path.c_str()) != 0) {
+        remove(tmp.c_str());
+        return false;
+    }
+
+    pruneCache(sizeof(cache_magic) + sizeof(format) + sizeof(size) + size);
+    return true;
+#else
+    return false;
+#endif
+}
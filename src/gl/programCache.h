@@ -0,0 +1,27 @@
+#pragma once
+
+#include <string>
+
+#include "gl.h"
+
+// Program binaries need GL 4.1 (or ARB_get_program_binary)
+#if !defined(PLATFORM_RPI) && !defined(PLATFORM_OSX) && defined(GL_NUM_PROGRAM_BINARY_FORMATS)
+#define PROGRAM_BINARIES
+#endif
+
+// Linked programs are saved on $XDG_CACHE_HOME/glslViewer/programs (~/.cache/... by default)
+// named after a hash of their final sources (defines included) and the GL vendor, renderer and
+// version. Anything changing on them gives another name, so stale binaries are never picked up.
+// Past 64MB the ones used longest ago are removed
+
+// Name of the program made from those final sources (with this driver)
+std::string getProgramKey(const std::string& _vertexSrc, const std::string& _fragmentSrc);
+
+// New linked program from the cache, 0 when it's not there, the driver rejects it or the cache is off
+GLuint      loadProgramBinary(const std::string& _key);
+
+// Call before linking a program that is going to be saved
+void        prepareProgramBinary(GLuint _program);
+bool        saveProgramBinary(GLuint _program, const std::string& _key);
+
+void        setProgramCache(bool _enable);
@@ -5,17 +5,143 @@
 #include "glm/gtc/type_ptr.hpp"
 
 #include <cstring>
+#include <cctype>
 #include <chrono>
+#include <map>
 #include <algorithm>
 #include <iostream>
 
 #include "shaders/defaultShaders.h"
+#include "programCache.h"
+
+// Same value for the KHR and ARB versions of the extension, older headers may not have it
+#if !defined(PLATFORM_RPI) && !defined(GL_COMPLETION_STATUS_KHR)
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+double Shader::s_totalLoadTime = 0.0;
+unsigned long long Shader::s_totalLinks = 0;
+bool Shader::s_parallel = true;
+unsigned long long Shader::s_uploadedUniforms = 0;
+unsigned long long Shader::s_skippedUniforms = 0;
+
+// Function statics, so handles can be made from other static objects
+static std::unordered_map<std::string, int>& uniformIds() {
+    static std::unordered_map<std::string, int> ids;
+    return ids;
+}
+
+static std::vector<std::string>& uniformNames() {
+    static std::vector<std::string> names;
+    return names;
+}
+
+int getUniformId(const std::string& _name) {
+    std::unordered_map<std::string, int>::iterator it = uniformIds().find(_name);
+    if (it != uniformIds().end())
+        return it->second;
+
+    int id = (int)uniformNames().size();
+    uniformNames().push_back(_name);
+    uniformIds()[_name] = id;
+    return id;
+}
+
+const std::string& getUniformName(int _id) {
+    return uniformNames()[_id];
+}
+
+struct ProgramRef::Entry {
+    std::string key;
+    GLuint      program = 0;
+    size_t      users   = 0;
+    std::unordered_map<GLint, std::string> values;
+};
+
+// By key. Nodes of a std::map don't move, so the refs can point to them. Never destroyed,
+// global shaders (like the ones on main's sandbox) release their programs after statics are gone
+static std::map<std::string, ProgramRef::Entry>& programs() {
+    static std::map<std::string, ProgramRef::Entry>* registry = new std::map<std::string, ProgramRef::Entry>();
+    return *registry;
+}
+
+ProgramRef::ProgramRef(): m_entry(nullptr) {
+}
+
+ProgramRef::ProgramRef(const ProgramRef& _other): m_entry(_other.m_entry) {
+    if (m_entry)
+        m_entry->users++;
+}
+
+ProgramRef& ProgramRef::operator=(const ProgramRef& _other) {
+    if (m_entry != _other.m_entry) {
+        if (_other.m_entry)
+            _other.m_entry->users++;
+        release();
+        m_entry = _other.m_entry;
+    }
+    return *this;
+}
+
+ProgramRef::~ProgramRef() {
+    release();
+}
+
+ProgramRef ProgramRef::find(const std::string& _key) {
+    ProgramRef ref;
+    std::map<std::string, Entry>::iterator it = programs().find(_key);
+    if (it != programs().end()) {
+        ref.m_entry = &it->second;
+        ref.m_entry->users++;
+    }
+    return ref;
+}
+
+ProgramRef ProgramRef::add(const std::string& _key, GLuint _program) {
+    ProgramRef ref = find(_key);
+    if (!ref.isEmpty()) {
+        if (ref.getProgram() != _program)
+            glDeleteProgram(_program);
+        return ref;
+    }
+
+    Entry& entry = programs()[_key];
+    entry.key = _key;
+    entry.program = _program;
+    entry.users = 1;
+    ref.m_entry = &entry;
+    return ref;
+}
+
+GLuint ProgramRef::getProgram() const {
+    return m_entry ? m_entry->program : 0;
+}
+
+size_t ProgramRef::getUsers() const {
+    return m_entry ? m_entry->users : 0;
+}
+
+std::unordered_map<GLint, std::string>* ProgramRef::getValues() const {
+    return m_entry ? &m_entry->values : nullptr;
+}
+
+void ProgramRef::release() {
+    if (m_entry == nullptr)
+        return;
+
+    if (--m_entry->users == 0) {
+        glDeleteProgram(m_entry->program);
+        programs().erase(m_entry->key);
+    }
+    m_entry = nullptr;
+}
 
 Shader::Shader():
     m_fragmentSource(getDefaultSrc(FRAG_ERROR)),
     m_vertexSource(getDefaultSrc(VERT_ERROR)),
     m_program(0), 
-    m_fragmentShader(0),m_vertexShader(0) {
+    m_fragmentShader(0),m_vertexShader(0),
+    m_watch(nullptr), m_watchChange(false) {
 
 
     // Adding default defines
@@ -32,59 +158,145 @@ Shader::Shader():
 }
 
 Shader::~Shader() {
-    // Avoid crash when no command line arguments supplied
-    if (m_program != 0)
-        glDeleteProgram(m_program);
+    // The program goes with m_ref, once no other shader uses it
+    cancelBuild();
+}
+
+bool Shader::isParallel() {
+#ifdef GL_COMPLETION_STATUS_KHR
+    static int supported = -1;
+    if (supported == -1)
+        supported = haveExtension("GL_KHR_parallel_shader_compile") || haveExtension("GL_ARB_parallel_shader_compile");
+    return s_parallel && supported == 1;
+#else
+    return false;
+#endif
 }
 
 bool Shader::load(const std::string& _fragmentSrc, const std::string& _vertexSrc, bool _verbose, bool _error_screen) {
-    std::chrono::time_point<std::chrono::steady_clock> start_time, end_time;
-    start_time = std::chrono::steady_clock::now();
+    // With a program already running, the new one builds in the background (when the driver can) and replaces it once it links
+    return build(_fragmentSrc, _vertexSrc, _verbose, _error_screen, m_program != 0 && isParallel());
+}
+
+bool Shader::build(const std::string& _fragmentSrc, const std::string& _vertexSrc, bool _verbose, bool _error_screen, bool _parallel) {
+    std::chrono::time_point<std::chrono::steady_clock> start_time = std::chrono::steady_clock::now();
     m_defineChange = false;
 
-    m_vertexShader = compileShader(_vertexSrc, GL_VERTEX_SHADER, _verbose);
+    // A newer version replaces whatever was still building
+    cancelBuild();
+
+    Build build;
+    build.fragmentSource = _fragmentSrc;
+    build.vertexSource = _vertexSrc;
+    build.verbose = _verbose;
+    build.errorScreen = _error_screen;
+
+    // The same final sources (defines included) linked before by another shader, or on a previous run.
+    // Defines the sources never mention (ex: MODEL_NAME_*) make no difference to the program
+    std::string vertProlog, vertBody, fragProlog, fragBody;
+    preprocess(_vertexSrc, vertProlog, vertBody, true);
+    preprocess(_fragmentSrc, fragProlog, fragBody, true);
+    build.cacheKey = getProgramKey(vertProlog + vertBody, fragProlog + fragBody);
+    build.shared = ProgramRef::find(build.cacheKey);
+    if (!build.shared.isEmpty())
+        build.program = build.shared.getProgram();
+    else
+        build.program = loadProgramBinary(build.cacheKey);
+    build.cached = build.program != 0;
+
+    if (!build.cached) {
+        preprocess(_vertexSrc, vertProlog, vertBody);
+        preprocess(_fragmentSrc, fragProlog, fragBody);
+    }
 
-    if (!m_vertexShader) {
-        if (_error_screen)
-            load(getDefaultSrc(FRAG_ERROR), getDefaultSrc(VERT_ERROR), false);
-        else
-            load(m_fragmentSource, m_vertexSource, false);
+    if (!build.cached) {
+        build.vertexShader = compileShader(vertProlog, vertBody, GL_VERTEX_SHADER);
+        build.fragmentShader = compileShader(fragProlog, fragBody, GL_FRAGMENT_SHADER);
 
-        return false;
+        build.program = glCreateProgram();
+        prepareProgramBinary(build.program);
+        glAttachShader(build.program, build.vertexShader);
+        glAttachShader(build.program, build.fragmentShader);
+        glLinkProgram(build.program);
     }
 
-    m_fragmentShader = compileShader(_fragmentSrc, GL_FRAGMENT_SHADER, _verbose);
+    std::chrono::duration<double> load_time = std::chrono::steady_clock::now() - start_time;
+    build.loadTime = load_time.count();
 
-    if (!m_fragmentShader) {
-        if (_error_screen)
-            load(getDefaultSrc(FRAG_ERROR), getDefaultSrc(VERT_ERROR), false);
-        else
-            load(m_fragmentSource, m_vertexSource, false);
+    if (_parallel && !build.cached) {
+        m_build = build;
+        return true;
+    }
+
+    return finishBuild(build);
+}
 
+bool Shader::updateBuild() {
+    if (m_build.program == 0)
         return false;
+
+#ifdef GL_COMPLETION_STATUS_KHR
+    GLint done = GL_FALSE;
+    glGetProgramiv(m_build.program, GL_COMPLETION_STATUS_KHR, &done);
+    if (done == GL_FALSE)
+        return false;
+#endif
+
+    Build build = m_build;
+    m_build = Build();
+    finishBuild(build);
+    return true;
+}
+
+void Shader::cancelBuild() {
+    if (m_build.program == 0)
+        return;
+
+    if (m_build.shared.isEmpty()) {
+        glDeleteShader(m_build.vertexShader);
+        glDeleteShader(m_build.fragmentShader);
+        glDeleteProgram(m_build.program);
     }
+    m_build = Build();
+}
+
+bool Shader::finishBuild(Build& _build) {
+    std::chrono::time_point<std::chrono::steady_clock> start_time = std::chrono::steady_clock::now();
 
-    m_program = glCreateProgram();
+    bool compiled = _build.cached;
+    if (!compiled) {
+        // Both, to report the errors of each
+        bool vertex = checkShader(_build.vertexShader, GL_VERTEX_SHADER);
+        bool fragment = checkShader(_build.fragmentShader, GL_FRAGMENT_SHADER);
+        compiled = vertex && fragment;
+    }
 
-    glAttachShader(m_program, m_vertexShader);
-    glAttachShader(m_program, m_fragmentShader);
-    glLinkProgram(m_program);
+    if (!compiled) {
+        glDeleteShader(_build.vertexShader);
+        glDeleteShader(_build.fragmentShader);
+        glDeleteProgram(_build.program);
 
-    m_fragmentSource = _fragmentSrc;
-    m_vertexSource = _vertexSrc;
+        // Unless asked for the error screen, the previous program keeps running
+        if (_build.errorScreen || m_program == 0)
+            build(getDefaultSrc(FRAG_ERROR), getDefaultSrc(VERT_ERROR), false, true, false);
 
-    end_time = std::chrono::steady_clock::now();
-    std::chrono::duration<double> load_time = end_time - start_time;
+        return false;
+    }
 
+    // Asking for the link status waits for the driver to be done with it
     GLint isLinked;
-    glGetProgramiv(m_program, GL_LINK_STATUS, &isLinked);
+    glGetProgramiv(_build.program, GL_LINK_STATUS, &isLinked);
+
+    std::chrono::duration<double> load_time = std::chrono::steady_clock::now() - start_time;
+    _build.loadTime += load_time.count();
+    s_totalLoadTime += _build.loadTime;
 
     if (isLinked == GL_FALSE) {
         GLint infoLength = 0;
-        glGetProgramiv(m_program, GL_INFO_LOG_LENGTH, &infoLength);
+        glGetProgramiv(_build.program, GL_INFO_LOG_LENGTH, &infoLength);
         if (infoLength > 1) {
             std::vector<GLchar> infoLog(infoLength);
-            glGetProgramInfoLog(m_program, infoLength, NULL, &infoLog[0]);
+            glGetProgramInfoLog(_build.program, infoLength, NULL, &infoLog[0]);
             std::string error(infoLog.begin(),infoLog.end());
             // printf("Error linking shader:\n%s\n", error);
             std::cerr << "Error linking shader: " << error << std::endl;
@@ -92,34 +304,61 @@ bool Shader::load(const std::string& _fragmentSrc, const std::string& _vertexSrc
             std::size_t start = error.find("line ")+5;
             std::size_t end = error.find_last_of(")");
             std::string lineNum = error.substr(start,end-start);
-            std::cerr << (unsigned)toInt(lineNum) << ": " << getLineNumber(_fragmentSrc,(unsigned)toInt(lineNum)) << std::endl;
+            std::cerr << (unsigned)toInt(lineNum) << ": " << getLineNumber(_build.fragmentSource,(unsigned)toInt(lineNum)) << std::endl;
         }
-        glDeleteProgram(m_program);
-        load(getDefaultSrc(FRAG_ERROR), getDefaultSrc(VERT_ERROR), false);
+        glDeleteShader(_build.vertexShader);
+        glDeleteShader(_build.fragmentShader);
+        glDeleteProgram(_build.program);
+        build(getDefaultSrc(FRAG_ERROR), getDefaultSrc(VERT_ERROR), false, true, false);
         return false;
     } 
-    else {
-        glDeleteShader(m_vertexShader);
-        glDeleteShader(m_fragmentShader);
 
-        if (_verbose) {
-            std::cerr << "shader load time: " << load_time.count() << "s";
+    if (!_build.cached) {
+        glDeleteShader(_build.vertexShader);
+        glDeleteShader(_build.fragmentShader);
+        saveProgramBinary(_build.program, _build.cacheKey);
+    }
+
+    // Releasing the previous program deletes it, unless other shaders still use it
+    if (_build.shared.isEmpty())
+        m_ref = ProgramRef::add(_build.cacheKey, _build.program);
+    else
+        m_ref = _build.shared;
+    m_program = m_ref.getProgram();
+    m_vertexShader = _build.vertexShader;
+    m_fragmentShader = _build.fragmentShader;
+    m_fragmentSource = _build.fragmentSource;
+    m_vertexSource = _build.vertexSource;
+
+    m_locations.clear();
+    m_handles.clear();
+    m_arrays.clear();
+    bindings.clear();
+    bindingsVersion = 0;
+    cacheUniformLocations();
+    s_totalLinks++;
+
+    if (_build.verbose) {
+        std::cerr << "shader load time: " << _build.loadTime << "s";
+        if (!_build.shared.isEmpty())
+            std::cerr << " (shared with " << (m_ref.getUsers() - 1) << " more)";
+        else if (_build.cached)
+            std::cerr << " (cached)";
 #ifdef GL_PROGRAM_BINARY_LENGTH
-            GLint proglen = 0;
-            glGetProgramiv(m_program, GL_PROGRAM_BINARY_LENGTH, &proglen);
-            if (proglen > 0)
-                std::cerr << " size: " << proglen;
+        GLint proglen = 0;
+        glGetProgramiv(m_program, GL_PROGRAM_BINARY_LENGTH, &proglen);
+        if (proglen > 0)
+            std::cerr << " size: " << proglen;
 #endif
 #ifdef GL_PROGRAM_INSTRUCTIONS_ARB
-            GLint icount = 0;
-            glGetProgramivARB(m_program, GL_PROGRAM_INSTRUCTIONS_ARB, &icount);
-            if (icount > 0)
-                std::cerr << " #instructions: " << icount;
+        GLint icount = 0;
+        glGetProgramivARB(m_program, GL_PROGRAM_INSTRUCTIONS_ARB, &icount);
+        if (icount > 0)
+            std::cerr << " #instructions: " << icount;
 #endif
-            std::cerr << std::endl;
-        }
-        return true;
+        std::cerr << std::endl;
     }
+    return true;
 }
 
 bool Shader::reload(bool _verbose) {
@@ -130,12 +369,72 @@ const GLint Shader::getAttribLocation(const std::string& _attribute) const {
     return glGetAttribLocation(m_program, _attribute.c_str());
 }
 
+std::vector<std::string> Shader::getActiveUniforms() const {
+    std::vector<std::string> names;
+    if (m_program == 0)
+        return names;
+
+    GLint total = 0;
+    GLint max_length = 0;
+    glGetProgramiv(m_program, GL_ACTIVE_UNIFORMS, &total);
+    glGetProgramiv(m_program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &max_length);
+
+    std::vector<GLchar> buffer(std::max(max_length, 1));
+    for (GLint i = 0; i < total; i++) {
+        GLsizei length = 0;
+        GLint size = 0;
+        GLenum type = 0;
+        glGetActiveUniform(m_program, i, (GLsizei)buffer.size(), &length, &size, &type, &buffer[0]);
+
+#ifdef UNIFORM_BUFFERS
+        // Members of uniform blocks are fed by their buffer, not by glUniform calls
+        if (UniformBuffer::isSupported()) {
+            GLuint index = (GLuint)i;
+            GLint block = -1;
+            glGetActiveUniformsiv(m_program, 1, &index, GL_UNIFORM_BLOCK_INDEX, &block);
+            if (block != -1)
+                continue;
+        }
+#endif
+
+        std::string name(&buffer[0], length);
+        name = name.substr(0, name.find_first_of("[."));
+        if (std::find(names.begin(), names.end(), name) == names.end())
+            names.push_back(name);
+    }
+    return names;
+}
+
+bool Shader::haveUniformBlocks() const {
+#ifdef UNIFORM_BUFFERS
+    if (m_program != 0 && UniformBuffer::isSupported()) {
+        GLint total = 0;
+        glGetProgramiv(m_program, GL_ACTIVE_UNIFORM_BLOCKS, &total);
+        return total > 0;
+    }
+#endif
+    return false;
+}
+
+void Shader::beginWatch(std::unordered_map<GLint, std::string>* _values) {
+    m_watch = _values;
+    m_watchChange = false;
+}
+
+bool Shader::endWatch() {
+    m_watch = nullptr;
+    return m_watchChange;
+}
+
 void Shader::use() {
     textureIndex = 0;
 
     if (m_defineChange)
         reload(false);
 
+    // Swap to the new program as soon as it's done
+    updateBuild();
+
     if (!isInUse())
         glUseProgram(getProgram());
 }
@@ -150,14 +449,29 @@ bool Shader::isLoaded() const {
     return m_program != 0;
 }
 
-GLuint Shader::compileShader(const std::string& _src, GLenum _type, bool _verbose) {
-    std::string prolog = "";
+// True if _name shows up as a whole word in _src
+static bool haveWord(const std::string& _src, const std::string& _name) {
+    size_t pos = _src.find(_name);
+    while (pos != std::string::npos) {
+        size_t end = pos + _name.size();
+        bool start_ok = pos == 0 || !(isalnum((unsigned char)_src[pos - 1]) || _src[pos - 1] == '_');
+        bool end_ok = end == _src.size() || !(isalnum((unsigned char)_src[end]) || _src[end] == '_');
+        if (start_ok && end_ok)
+            return true;
+        pos = _src.find(_name, pos + 1);
+    }
+    return false;
+}
+
+void Shader::preprocess(const std::string& _src, std::string& _prolog, std::string& _body, bool _usedDefinesOnly) const {
+    std::string& prolog = _prolog;
+    std::string& srcBody = _body; // _src stripped of any #version directive at the beginning
+    prolog = "";
 
     //
     // detect #version directive at the beginning of the shader, move it to the prolog and remove it from the shader
     //
 
-    std::string srcBody; // _src stripped of any #version directive at the beginning
     bool zeroBasedLineDirective; // true for GLSL core 1.10 to 1.50
     bool srcVersionFound = _src.substr(0, 8) == "#version"; // true if user provided a #version directive at the beginning of _src
 
@@ -215,7 +529,14 @@ GLuint Shader::compileShader(const std::string& _src, GLenum _type, bool _verbos
         zeroBasedLineDirective = true; // ... glsl defaults to version 1.10, which starts numbering #line directives from 0.
     }
 
-    for(DefinesList_it it = m_defines.begin(); it != m_defines.end(); it++) {
+    std::string values;
+    if (_usedDefinesOnly)
+        for(DefinesList::const_iterator it = m_defines.begin(); it != m_defines.end(); it++)
+            values += it->second + '\n';
+
+    for(DefinesList::const_iterator it = m_defines.begin(); it != m_defines.end(); it++) {
+        if (_usedDefinesOnly && !haveWord(srcBody, it->first) && !haveWord(values, it->first))
+            continue;
         prolog += "#define " + it->first + " " + it->second + '\n';
     }
 
@@ -229,6 +550,11 @@ GLuint Shader::compileShader(const std::string& _src, GLenum _type, bool _verbos
 
     size_t startLine = (srcVersionFound ? 1 : 0) + (zeroBasedLineDirective ? 0 : 1);
     prolog += "#line " + std::to_string(startLine) + "\n";
+}
+
+GLuint Shader::compileShader(const std::string& _prolog, const std::string& _body, GLenum _type) {
+    const std::string& prolog = _prolog;
+    const std::string& srcBody = _body;
 
     // if (_verbose) {
     //     if (_type == GL_VERTEX_SHADER) {
@@ -249,7 +575,11 @@ GLuint Shader::compileShader(const std::string& _src, GLenum _type, bool _verbos
     GLuint shader = glCreateShader(_type);
     glShaderSource(shader, 2, sources, NULL);
     glCompileShader(shader);
+    return shader;
+}
 
+bool Shader::checkShader(GLuint _shader, GLenum _type) {
+    GLuint shader = _shader;
     GLint isCompiled;
     glGetShaderiv(shader, GL_COMPILE_STATUS, &isCompiled);
 
@@ -274,12 +604,7 @@ GLuint Shader::compileShader(const std::string& _src, GLenum _type, bool _verbos
         std::cerr << "shader:\n" << &infoLog[0] << std::endl;
     }
 
-    if (isCompiled == GL_FALSE) {
-        glDeleteShader(shader);
-        return 0;
-    }
-
-    return shader;
+    return isCompiled != GL_FALSE;
 }
 
 void Shader::detach(GLenum _type) {
@@ -297,37 +622,144 @@ void Shader::detach(GLenum _type) {
     }
 }
 
+void Shader::cacheUniformLocations() {
+    GLint total = 0;
+    GLint max_length = 0;
+    glGetProgramiv(m_program, GL_ACTIVE_UNIFORMS, &total);
+    glGetProgramiv(m_program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &max_length);
+
+    std::vector<GLchar> buffer(std::max(max_length, 1));
+    for (GLint i = 0; i < total; i++) {
+        GLsizei length = 0;
+        GLint size = 0;
+        GLenum type = 0;
+        glGetActiveUniform(m_program, i, (GLsizei)buffer.size(), &length, &size, &type, &buffer[0]);
+        std::string name(&buffer[0], length);
+
+        // Arrays come as "name[0]", they can be set by their name or by each element
+        if (name.size() > 3 && name.compare(name.size() - 3, 3, "[0]") == 0) {
+            std::string base = name.substr(0, name.size() - 3);
+            m_locations[base] = glGetUniformLocation(m_program, name.c_str());
+            for (GLint j = 0; j < size; j++) {
+                std::string element = base + "[" + toString(j) + "]";
+                m_locations[element] = glGetUniformLocation(m_program, element.c_str());
+                m_arrays.insert(m_locations[element]);
+            }
+        }
+        else
+            m_locations[name] = glGetUniformLocation(m_program, name.c_str());
+    }
+}
+
 GLint Shader::getUniformLocation(const std::string& _uniformName) const {
+    std::unordered_map<std::string, GLint>::const_iterator it = m_locations.find(_uniformName);
+    if (it != m_locations.end())
+        return it->second;
+
+    // Not an active one (usually -1), remember it anyway so it's only asked once
     GLint loc = glGetUniformLocation(m_program, _uniformName.c_str());
-    if (loc == -1){
-        // std::cerr << "Uniform " << _uniformName << " not found" << std::endl;
-    }
+    m_locations[_uniformName] = loc;
     return loc;
 }
 
+GLint Shader::getUniformLocation(int _id) const {
+    if (_id < 0)
+        return -1;
+
+    if ((size_t)_id >= m_handles.size())
+        m_handles.resize(_id + 1, -2);
+
+    // -2 means it was not looked up yet
+    if (m_handles[_id] == -2)
+        m_handles[_id] = getUniformLocation( getUniformName(_id) );
+
+    return m_handles[_id];
+}
+
+bool Shader::isNewValue(GLint _location, const void* _value, size_t _size) {
+    // Nothing to upload to uniforms the program doesn't use
+    if (_location < 0)
+        return false;
+
+    if (m_watch) {
+        std::string& watched = (*m_watch)[_location];
+        if (watched.size() != _size || memcmp(watched.data(), _value, _size) != 0) {
+            watched.assign((const char*)_value, _size);
+            m_watchChange = true;
+        }
+        return false;
+    }
+
+    std::unordered_map<GLint, std::string>* values = m_ref.getValues();
+    if (values == nullptr)
+        return true;
+
+    if (m_arrays.count(_location)) {
+        s_uploadedUniforms++;
+        return true;
+    }
+
+    std::string& last = (*values)[_location];
+    if (last.size() == _size && memcmp(last.data(), _value, _size) == 0) {
+        s_skippedUniforms++;
+        return false;
+    }
+
+    last.assign((const char*)_value, _size);
+    s_uploadedUniforms++;
+    return true;
+}
+
+bool Shader::forgetValue(GLint _location) {
+    if (_location < 0)
+        return false;
+
+    // Without the value, take it as a change
+    if (m_watch) {
+        m_watchChange = true;
+        return false;
+    }
+
+    if (m_ref.getValues())
+        m_ref.getValues()->erase(_location);
+    s_uploadedUniforms++;
+    return true;
+}
+
 void Shader::setUniform(const std::string& _name, int _x) {
     if (isInUse()) {
-        glUniform1i(getUniformLocation(_name), _x);
+        GLint loc = getUniformLocation(_name);
+        if (isNewValue(loc, &_x, sizeof(_x)))
+            glUniform1i(loc, _x);
     }
 }
 
 void Shader::setUniform(const std::string& _name, int _x, int _y) {
     if (isInUse()) {
-        glUniform2i(getUniformLocation(_name), _x, _y);
+        GLint loc = getUniformLocation(_name);
+        int value[2] = { _x, _y };
+        if (isNewValue(loc, value, sizeof(value)))
+            glUniform2i(loc, _x, _y);
         // std::cout << "Uniform " << _name << ": vec2i(" << _x << "," << _y << ")" << std::endl;
     }
 }
 
 void Shader::setUniform(const std::string& _name, int _x, int _y, int _z) {
     if (isInUse()) {
-        glUniform3i(getUniformLocation(_name), _x, _y, _z);
+        GLint loc = getUniformLocation(_name);
+        int value[3] = { _x, _y, _z };
+        if (isNewValue(loc, value, sizeof(value)))
+            glUniform3i(loc, _x, _y, _z);
         // std::cout << "Uniform " << _name << ": vec3i(" << _x << "," << _y << "," << _z <<")" << std::endl;
     }
 }
 
 void Shader::setUniform(const std::string& _name, int _x, int _y, int _z, int _w) {
     if (isInUse()) {
-        glUniform4i(getUniformLocation(_name), _x, _y, _z, _w);
+        GLint loc = getUniformLocation(_name);
+        int value[4] = { _x, _y, _z, _w };
+        if (isNewValue(loc, value, sizeof(value)))
+            glUniform4i(loc, _x, _y, _z, _w);
         // std::cout << "Uniform " << _name << ": vec4i(" << _x << "," << _y << "," << _z << << "," << _w << ")" << std::endl;
     }
 }
@@ -335,6 +767,14 @@ void Shader::setUniform(const std::string& _name, int _x, int _y, int _z, int _w
 void Shader::setUniform(const std::string& _name, const int *_array, unsigned int _size) {
     GLint loc = getUniformLocation(_name);
     if (isInUse()) {
+        if (_size > 4) {
+            std::cerr << "Passing matrix uniform as array, not supported yet" << std::endl;
+            return;
+        }
+
+        if (!isNewValue(loc, _array, _size * sizeof(int)))
+            return;
+
         if (_size == 1) {
             glUniform1i(loc, _array[0]);
         }
@@ -348,36 +788,44 @@ void Shader::setUniform(const std::string& _name, const int *_array, unsigned in
         else if (_size == 4) {
             glUniform4i(loc, _array[0], _array[1], _array[2], _array[3]);
         }
-        else {
-            std::cerr << "Passing matrix uniform as array, not supported yet" << std::endl;
-        }
     }
 }
 
 void Shader::setUniform(const std::string& _name, float _x) {
     if (isInUse()) {
-        glUniform1f(getUniformLocation(_name), _x);
+        GLint loc = getUniformLocation(_name);
+        if (isNewValue(loc, &_x, sizeof(_x)))
+            glUniform1f(loc, _x);
         // std::cout << "Uniform " << _name << ": float(" << _x << ")" << std::endl;
     }
 }
 
 void Shader::setUniform(const std::string& _name, float _x, float _y) {
     if (isInUse()) {
-        glUniform2f(getUniformLocation(_name), _x, _y);
+        GLint loc = getUniformLocation(_name);
+        float value[2] = { _x, _y };
+        if (isNewValue(loc, value, sizeof(value)))
+            glUniform2f(loc, _x, _y);
         // std::cout << "Uniform " << _name << ": vec2(" << _x << "," << _y << ")" << std::endl;
     }
 }
 
 void Shader::setUniform(const std::string& _name, float _x, float _y, float _z) {
     if (isInUse()) {
-        glUniform3f(getUniformLocation(_name), _x, _y, _z);
+        GLint loc = getUniformLocation(_name);
+        float value[3] = { _x, _y, _z };
+        if (isNewValue(loc, value, sizeof(value)))
+            glUniform3f(loc, _x, _y, _z);
         // std::cout << "Uniform " << _name << ": vec3(" << _x << "," << _y << "," << _z <<")" << std::endl;
     }
 }
 
 void Shader::setUniform(const std::string& _name, float _x, float _y, float _z, float _w) {
     if (isInUse()) {
-        glUniform4f(getUniformLocation(_name), _x, _y, _z, _w);
+        GLint loc = getUniformLocation(_name);
+        float value[4] = { _x, _y, _z, _w };
+        if (isNewValue(loc, value, sizeof(value)))
+            glUniform4f(loc, _x, _y, _z, _w);
         // std::cout << "Uniform " << _name << ": vec3(" << _x << "," << _y << "," << _z <<")" << std::endl;
     }
 }
@@ -385,6 +833,14 @@ void Shader::setUniform(const std::string& _name, float _x, float _y, float _z,
 void Shader::setUniform(const std::string& _name, const float *_array, unsigned int _size) {
     GLint loc = getUniformLocation(_name);
     if (isInUse()) {
+        if (_size > 4) {
+            std::cerr << "Passing matrix uniform as array, not supported yet" << std::endl;
+            return;
+        }
+
+        if (!isNewValue(loc, _array, _size * sizeof(float)))
+            return;
+
         if (_size == 1) {
             glUniform1f(loc, _array[0]);
         }
@@ -395,37 +851,50 @@ void Shader::setUniform(const std::string& _name, const float *_array, unsigned
             glUniform3f(loc, _array[0], _array[1], _array[2]);
         }
         else if (_size == 4) {
-            glUniform4f(loc, _array[0], _array[1], _array[2], _array[2]);
-        }
-        else {
-            std::cerr << "Passing matrix uniform as array, not supported yet" << std::endl;
+            glUniform4f(loc, _array[0], _array[1], _array[2], _array[3]);
         }
     }
 }
 
 void Shader::setUniform(const std::string& _name, const glm::vec2 *_array, unsigned int _size) {
     if (isInUse()) {
-        glUniform2fv(getUniformLocation(_name), _size, glm::value_ptr(_array[0]));
+        GLint loc = getUniformLocation(_name);
+        if (isNewValue(loc, &_array[0], _size * sizeof(glm::vec2)))
+            glUniform2fv(loc, _size, glm::value_ptr(_array[0]));
     }
 }
 
 void Shader::setUniform(const std::string& _name, const glm::vec3 *_array, unsigned int _size) {
     if (isInUse()) {
-        glUniform3fv(getUniformLocation(_name), _size, glm::value_ptr(_array[0]));
+        GLint loc = getUniformLocation(_name);
+        if (isNewValue(loc, &_array[0], _size * sizeof(glm::vec3)))
+            glUniform3fv(loc, _size, glm::value_ptr(_array[0]));
     }
 }
 
 void Shader::setUniform(const std::string& _name, const glm::vec4 *_array, unsigned int _size) {
     if (isInUse()) {
-        glUniform4fv(getUniformLocation(_name), _size, glm::value_ptr(_array[0]));
+        GLint loc = getUniformLocation(_name);
+        if (isNewValue(loc, &_array[0], _size * sizeof(glm::vec4)))
+            glUniform4fv(loc, _size, glm::value_ptr(_array[0]));
     }
 }
 
 void Shader::setUniformTexture(const std::string& _name, GLuint _textureId, unsigned int _texLoc) {
     if (isInUse()) {
+        if (m_watch) {
+            GLuint value[2] = { _textureId, _texLoc };
+            isNewValue(getUniformLocation(_name), value, sizeof(value));
+            return;
+        }
+
         glActiveTexture(GL_TEXTURE0 + _texLoc);
         glBindTexture(GL_TEXTURE_2D, _textureId);
-        glUniform1i(getUniformLocation(_name), _texLoc);
+
+        GLint loc = getUniformLocation(_name);
+        int unit = (int)_texLoc;
+        if (isNewValue(loc, &unit, sizeof(unit)))
+            glUniform1i(loc, unit);
     }
 }
 
@@ -455,9 +924,19 @@ void  Shader::setUniformDepthTexture(const std::string& _name, const Fbo* _fbo)
 
 void Shader::setUniformTextureCube(const std::string& _name, const TextureCube* _tex, unsigned int _texLoc) {
     if (isInUse()) {
+        if (m_watch) {
+            GLuint value[2] = { _tex->getTextureId(), _texLoc };
+            isNewValue(getUniformLocation(_name), value, sizeof(value));
+            return;
+        }
+
         glActiveTexture(GL_TEXTURE0 + _texLoc);
         glBindTexture(GL_TEXTURE_CUBE_MAP, _tex->getTextureId());
-        glUniform1i(getUniformLocation(_name), _texLoc);
+
+        GLint loc = getUniformLocation(_name);
+        int unit = (int)_texLoc;
+        if (isNewValue(loc, &unit, sizeof(unit)))
+            glUniform1i(loc, unit);
     }
 }
 
@@ -465,20 +944,98 @@ void  Shader::setUniformTextureCube(const std::string& _name, const TextureCube*
     setUniformTextureCube(_name, _tex, textureIndex++);
 }
 
+bool Shader::setUniformBlock(const std::string& _name, const UniformBuffer* _buffer) {
+#ifdef UNIFORM_BUFFERS
+    if (m_program == 0 || !_buffer->isAllocated())
+        return false;
+
+    GLuint index = glGetUniformBlockIndex(m_program, _name.c_str());
+    if (index == GL_INVALID_INDEX)
+        return false;
+
+    glUniformBlockBinding(m_program, index, _buffer->getBinding());
+    return true;
+#else
+    return false;
+#endif
+}
+
 void Shader::setUniform(const std::string& _name, const glm::mat2& _value, bool _transpose) {
     if (isInUse()) {
-        glUniformMatrix2fv(getUniformLocation(_name), 1, _transpose, &_value[0][0]);
+        GLint loc = getUniformLocation(_name);
+        if (_transpose ? forgetValue(loc) : isNewValue(loc, &_value[0][0], sizeof(_value)))
+            glUniformMatrix2fv(loc, 1, _transpose, &_value[0][0]);
     }
 }
 
 void Shader::setUniform(const std::string& _name, const glm::mat3& _value, bool _transpose) {
     if (isInUse()) {
-        glUniformMatrix3fv(getUniformLocation(_name), 1, _transpose, &_value[0][0]);
+        GLint loc = getUniformLocation(_name);
+        if (_transpose ? forgetValue(loc) : isNewValue(loc, &_value[0][0], sizeof(_value)))
+            glUniformMatrix3fv(loc, 1, _transpose, &_value[0][0]);
     }
 }
 
 void Shader::setUniform(const std::string& _name, const glm::mat4& _value, bool _transpose) {
     if (isInUse()) {
-        glUniformMatrix4fv(getUniformLocation(_name), 1, _transpose, &_value[0][0]);
+        GLint loc = getUniformLocation(_name);
+        if (_transpose ? forgetValue(loc) : isNewValue(loc, &_value[0][0], sizeof(_value)))
+            glUniformMatrix4fv(loc, 1, _transpose, &_value[0][0]);
+    }
+}
+
+void Shader::setUniform(const UniformHandle<int>& _handle, int _x) {
+    if (isInUse()) {
+        GLint loc = getUniformLocation(_handle.id);
+        if (isNewValue(loc, &_x, sizeof(_x)))
+            glUniform1i(loc, _x);
+    }
+}
+
+void Shader::setUniform(const UniformHandle<float>& _handle, float _x) {
+    if (isInUse()) {
+        GLint loc = getUniformLocation(_handle.id);
+        if (isNewValue(loc, &_x, sizeof(_x)))
+            glUniform1f(loc, _x);
+    }
+}
+
+void Shader::setUniform(const UniformHandle<glm::vec2>& _handle, const glm::vec2& _value) {
+    if (isInUse()) {
+        GLint loc = getUniformLocation(_handle.id);
+        if (isNewValue(loc, &_value[0], sizeof(_value)))
+            glUniform2f(loc, _value.x, _value.y);
+    }
+}
+
+void Shader::setUniform(const UniformHandle<glm::vec3>& _handle, const glm::vec3& _value) {
+    if (isInUse()) {
+        GLint loc = getUniformLocation(_handle.id);
+        if (isNewValue(loc, &_value[0], sizeof(_value)))
+            glUniform3f(loc, _value.x, _value.y, _value.z);
+    }
+}
+
+void Shader::setUniform(const UniformHandle<glm::vec4>& _handle, const glm::vec4& _value) {
+    if (isInUse()) {
+        GLint loc = getUniformLocation(_handle.id);
+        if (isNewValue(loc, &_value[0], sizeof(_value)))
+            glUniform4f(loc, _value.x, _value.y, _value.z, _value.w);
+    }
+}
+
+void Shader::setUniform(const UniformHandle<glm::mat3>& _handle, const glm::mat3& _value, bool _transpose) {
+    if (isInUse()) {
+        GLint loc = getUniformLocation(_handle.id);
+        if (_transpose ? forgetValue(loc) : isNewValue(loc, &_value[0][0], sizeof(_value)))
+            glUniformMatrix3fv(loc, 1, _transpose, &_value[0][0]);
+    }
+}
+
+void Shader::setUniform(const UniformHandle<glm::mat4>& _handle, const glm::mat4& _value, bool _transpose) {
+    if (isInUse()) {
+        GLint loc = getUniformLocation(_handle.id);
+        if (_transpose ? forgetValue(loc) : isNewValue(loc, &_value[0][0], sizeof(_value)))
+            glUniformMatrix4fv(loc, 1, _transpose, &_value[0][0]);
     }
 }
@@ -1,29 +1,94 @@
 #pragma once
 
 #include <string>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+#include <functional>
 
 #include "gl.h"
 #include "fbo.h"
 #include "texture.h"
 #include "textureCube.h"
+#include "uniformBuffer.h"
 
 #include "glm/glm.hpp"
 #include "../defines.h"
 
+// Uniform names get a number the first time they are asked for, shared by all shaders
+int                 getUniformId(const std::string& _name);
+const std::string&  getUniformName(int _id);
+
+// Typed handle to a uniform. Made once (ex: a static or a member), setting it
+// on any shader is a plain index into the locations that shader already knows
+template <typename T>
+class UniformHandle {
+public:
+    UniformHandle(): id(-1) {}
+    explicit UniformHandle(const std::string& _name): id(getUniformId(_name)) {}
+
+    int id;
+};
+
+// Linked program shared by all the shaders built from the same final sources (ex: the shapes
+// of an OBJ file using the same material). The last shader holding it deletes it
+class ProgramRef {
+public:
+    ProgramRef();
+    ProgramRef(const ProgramRef& _other);
+    ProgramRef& operator=(const ProgramRef& _other);
+    virtual ~ProgramRef();
+
+    // The program registered with _key, empty if there is none
+    static ProgramRef   find(const std::string& _key);
+    // Registers _program with _key. If there is one already, _program is deleted and that one is shared instead
+    static ProgramRef   add(const std::string& _key, GLuint _program);
+
+    bool    isEmpty() const { return m_entry == nullptr; }
+    GLuint  getProgram() const;
+    size_t  getUsers() const;
+
+    // Last value uploaded to each location of the program, by any of the shaders using it
+    std::unordered_map<GLint, std::string>* getValues() const;
+
+    void    release();
+
+    struct Entry;
+
+private:
+    Entry*  m_entry;
+};
+
 class Shader : public HaveDefines {
 public:
     Shader();
     virtual ~Shader();
 
     void    use();
+    // When the driver compiles in parallel (KHR_parallel_shader_compile) and there is a program
+    // already, the new one is built in the background and replaces it once it links (see use())
     bool    load(const std::string& _fragmentSrc, const std::string& _vertexSrc, bool _verbose = false, bool _error_screen = true);
     bool    reload(bool _verbose = false);
+
+    // Checks on the program being built, returns true once it's done (linked or not)
+    bool    updateBuild();
+    bool    isBuilding() const { return m_build.program != 0; }
     
     const   GLuint  getProgram() const { return m_program; };
     const   GLuint  getFragmentShader() const { return m_fragmentShader; };
     const   GLuint  getVertexShader() const { return m_vertexShader; };
     const   GLint   getAttribLocation(const std::string& _attribute) const;
 
+    // Names of the uniforms the compiled program actually uses (without array indices or struct members)
+    std::vector<std::string> getActiveUniforms() const;
+    // If it reads any uniform block
+    bool    haveUniformBlocks() const;
+
+    // Until endWatch() the values set are compared with the ones on _values instead of being sent,
+    // textures by their id. endWatch() tells if any was different (ex: to know if a pass has to render again)
+    void    beginWatch(std::unordered_map<GLint, std::string>* _values);
+    bool    endWatch();
+
     const std::string& getFragmentSource() const { return m_fragmentSource; };
     const std::string& getVertexSource() const { return m_vertexSource; };
 
@@ -54,6 +119,14 @@ public:
     void    setUniform(const std::string& _name, const glm::mat3& _value, bool transpose = false);
     void    setUniform(const std::string& _name, const glm::mat4& _value, bool transpose = false);
 
+    void    setUniform(const UniformHandle<int>& _handle, int _x);
+    void    setUniform(const UniformHandle<float>& _handle, float _x);
+    void    setUniform(const UniformHandle<glm::vec2>& _handle, const glm::vec2& _value);
+    void    setUniform(const UniformHandle<glm::vec3>& _handle, const glm::vec3& _value);
+    void    setUniform(const UniformHandle<glm::vec4>& _handle, const glm::vec4& _value);
+    void    setUniform(const UniformHandle<glm::mat3>& _handle, const glm::mat3& _value, bool transpose = false);
+    void    setUniform(const UniformHandle<glm::mat4>& _handle, const glm::mat4& _value, bool transpose = false);
+
     void    setUniformTexture(const std::string& _name, const Texture* _tex);
     void    setUniformTexture(const std::string& _name, const Fbo* _fbo);
     void    setUniformDepthTexture(const std::string& _name, const Fbo* _fbo);
@@ -65,18 +138,85 @@ public:
     void    setUniformDepthTexture(const std::string& _name, const Fbo* _fbo, unsigned int _texLoc);
     void    setUniformTextureCube(const std::string& _name, const TextureCube* _tex, unsigned int _texLoc);
 
+    // Points the uniform block _name (if the program declares it) to the binding of _buffer. Only needed once after linking
+    bool    setUniformBlock(const std::string& _name, const UniformBuffer* _buffer);
+
     void    detach(GLenum type);
 
+    // Seconds spent compiling and linking all the shaders so far
+    static double   getTotalLoadTime() { return s_totalLoadTime; }
+
+    // Programs linked so far, it changes every time a shader swaps its program
+    static unsigned long long getTotalLinks() { return s_totalLinks; }
+
+    // Background builds can be turned off (ex: for scripted runs that expect the new shaders right away)
+    static void     setParallel(bool _parallel) { s_parallel = _parallel; }
+    static bool     isParallel();
+
+    // glUniform calls made, and the ones skipped because the program already had that value
+    static unsigned long long getUploadedUniforms() { return s_uploadedUniforms; }
+    static unsigned long long getSkippedUniforms() { return s_skippedUniforms; }
+    static void     resetUniformsCount() { s_uploadedUniforms = 0; s_skippedUniforms = 0; }
+
     unsigned int    textureIndex;
 
+    // Setters of the uniforms this program uses, made by Uniforms::feedTo
+    // and replayed on every draw. Relinking the program drops them
+    std::vector< std::function<void(Shader&)> > bindings;
+    size_t          bindingsVersion = 0;
+
 private:
-    GLuint      compileShader(const std::string& _src, GLenum _type, bool _verbose);
+    // Program on its way, with everything needed to finish it
+    struct Build {
+        std::string fragmentSource;
+        std::string vertexSource;
+        std::string cacheKey;
+        ProgramRef  shared;         // same program used by other shader
+        GLuint      program         = 0;
+        GLuint      fragmentShader  = 0;
+        GLuint      vertexShader    = 0;
+        double      loadTime        = 0.0;
+        bool        cached          = false;
+        bool        verbose         = false;
+        bool        errorScreen     = true;
+    };
+
+    bool        build(const std::string& _fragmentSrc, const std::string& _vertexSrc, bool _verbose, bool _error_screen, bool _parallel);
+    bool        finishBuild(Build& _build);
+    void        cancelBuild();
+
+    // With _usedDefinesOnly the prolog leaves out defines the source never mentions (to name the program)
+    void        preprocess(const std::string& _src, std::string& _prolog, std::string& _body, bool _usedDefinesOnly = false) const;
+    GLuint      compileShader(const std::string& _prolog, const std::string& _body, GLenum _type);
+    bool        checkShader(GLuint _shader, GLenum _type);
     GLint       getUniformLocation(const std::string& _uniformName) const;
+    GLint       getUniformLocation(int _id) const;
+    void        cacheUniformLocations();
+    bool        isNewValue(GLint _location, const void* _value, size_t _size);
+    bool        forgetValue(GLint _location);
 
     std::string m_fragmentSource;
     std::string m_vertexSource;
     
+    ProgramRef  m_ref;
     GLuint      m_program;
     GLuint      m_fragmentShader;
     GLuint      m_vertexShader;
+
+    // Locations of the active uniforms, filled when the program links (and with any other name asked for)
+    mutable std::unordered_map<std::string, GLint>  m_locations;
+    mutable std::vector<GLint>                      m_handles;   // same, by uniform id
+    // Arrays can be set whole or by element, at locations that overlap. Their values are not shadowed
+    std::unordered_set<GLint>                       m_arrays;
+
+    std::unordered_map<GLint, std::string>*         m_watch;
+    bool                                            m_watchChange;
+
+    Build       m_build;
+
+    static double s_totalLoadTime;
+    static unsigned long long s_totalLinks;
+    static bool s_parallel;
+    static unsigned long long s_uploadedUniforms;
+    static unsigned long long s_skippedUniforms;
 };
@@ -1,12 +1,41 @@
 #include <iostream>
+#include <cstdio>
 
 #include "texture.h"
 
 #include "../io/fs.h"
 #include "../io/pixels.h"
 
+static GLenum getFormat(int _channels) {
+    if (_channels == 4)
+        return GL_RGBA;
+    else if (_channels == 3)
+        return GL_RGB;
+#if !defined(PLATFORM_RPI)
+    else if (_channels == 2)
+        return GL_RG;
+    else if (_channels == 1)
+        return GL_RED;
+#endif
+    std::cout << "Unrecognize GLenum format " << _channels << std::endl;
+    return GL_RGBA;
+}
+
+static GLenum getType(int _bits) {
+    if (_bits == 32)
+        return GL_FLOAT;
+    else if (_bits == 16)
+        return GL_UNSIGNED_SHORT;
+    else if (_bits == 8)
+        return GL_UNSIGNED_BYTE;
+    std::cout << "Unrecognize GLenum type for " << _bits << " bits" << std::endl;
+    return GL_UNSIGNED_BYTE;
+}
+
 // TEXTURE
-Texture::Texture():m_path(""), m_width(0), m_height(0), m_id(0), m_vFlip(false) {
+Texture::Texture():m_path(""), m_width(0), m_height(0), m_id(0), m_vFlip(false),
+    m_pbo_size(0), m_pbo_index(0), m_stream_format(0), m_stream_type(0) {
+    m_pbo[0] = m_pbo[1] = 0;
 }
 
 Texture::~Texture() {
@@ -14,6 +43,7 @@ Texture::~Texture() {
 }
 
 void Texture::clear() {
+    _clearStream();
     if (m_id != 0)
         glDeleteTextures(1, &m_id);
     m_id = 0;
@@ -21,6 +51,13 @@ void Texture::clear() {
 
 bool Texture::load(int _width, int _height, int _channels, int _bits, const void* _data) {
 
+    // Storage made by updatePixels() may be immutable
+    if (m_pbo[0] != 0) {
+        _clearStream();
+        glDeleteTextures(1, &m_id);
+        m_id = 0;
+    }
+
     // Generate an OpenGL texture ID for this texturez
     glEnable(GL_TEXTURE_2D);
     if (m_id == 0)
@@ -33,36 +70,8 @@ bool Texture::load(int _width, int _height, int _channels, int _bits, const void
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
 
-    GLenum format = GL_RGBA;
-    if (_channels == 4) {
-        format = GL_RGBA;
-    }
-    else if (_channels == 3) {
-        format = GL_RGB;
-    }
-#if !defined(PLATFORM_RPI)
-    else if (_channels == 2) {
-        format = GL_RG;
-    } 
-    else if (_channels == 1) {
-        format = GL_RED;
-    }
-#endif
-    else
-        std::cout << "Unrecognize GLenum format " << _channels << std::endl;
-
-    GLenum type = GL_UNSIGNED_BYTE;
-    if (_bits == 32) {
-        type = GL_FLOAT;
-    }
-    else if (_bits == 16) {
-        type = GL_UNSIGNED_SHORT;
-    } 
-    else if (_bits == 8) {
-        type = GL_UNSIGNED_BYTE;
-    }
-    else 
-        std::cout << "Unrecognize GLenum type for " << _bits << " bits" << std::endl;
+    GLenum format = getFormat(_channels);
+    GLenum type = getType(_bits);
 
     m_width = _width;
     m_height = _height;
@@ -103,46 +112,111 @@ bool Texture::load(int _width, int _height, int _channels, int _bits, const void
     return true;
 }
 
-bool Texture::load(const std::string& _path, bool _vFlip) {
-    
-    std::string ext = getExt(_path);
-
-    // BMP non-1bpp, non-RLE
-    // GIF (*comp always reports as 4-channel)
-    // JPEG baseline & progressive (12 bpc/arithmetic not supported, same as stock IJG lib)
-    if (ext == "bmp"    || ext == "BMP" ||
-        ext == "gif"    || ext == "GIF" ||
-        ext == "jpg"    || ext == "JPG" ||
-        ext == "jpeg"   || ext == "JPEG" ) {
-
-        unsigned char* pixels = loadPixels(_path, &m_width, &m_height, RGB_ALPHA, _vFlip);
-        load(m_width, m_height, 4, 8, pixels);
-        freePixels(pixels);
-    }
+bool Texture::updatePixels(int _width, int _height, int _channels, int _bits, const void* _data) {
+#ifdef STREAMING_TEXTURES
+    if (_data == NULL)
+        return false;
 
-    // PNG 1/2/4/8/16-bit-per-channel
-    // TGA (not sure what subset, if a subset)
-    // PSD (composited view only, no extra channels, 8/16 bit-per-channel)
-    else if (   ext == "png" || ext == "PNG" ||
-                ext == "psd" || ext == "PSD" ||
-                ext == "tga" || ext == "TGA") {
-#ifdef PLATFORM_RPI
-        // If we are in a Raspberry Pi don't take the risk of loading a 16bit image
-        unsigned char* pixels = loadPixels(_path, &m_width, &m_height, RGB_ALPHA, _vFlip);
-        load(m_width, m_height, 4, 8, pixels);
-        freePixels(pixels);
+    GLenum format = getFormat(_channels);
+    GLenum type = getType(_bits);
+    GLsizeiptr size = (GLsizeiptr)_width * _height * _channels * (_bits / 8);
+
+    if (m_pbo[0] == 0 || m_width != _width || m_height != _height || m_stream_format != format || m_stream_type != type)
+        if (!_allocateStream(_width, _height, _channels, _bits))
+            return false;
+
+    // Orphan the buffer before filling it, if the GPU is still reading
+    // the old contents the driver hands over new memory instead of waiting
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_pbo[m_pbo_index]);
+    glBufferData(GL_PIXEL_UNPACK_BUFFER, size, NULL, GL_STREAM_DRAW);
+    glBufferSubData(GL_PIXEL_UNPACK_BUFFER, 0, size, _data);
+
+    // Copied from the buffer, so it returns right away
+    glBindTexture(GL_TEXTURE_2D, m_id);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, _width, _height, format, type, (const GLvoid*)0);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    m_pbo_index = 1 - m_pbo_index;
+    return true;
 #else
-        uint16_t* pixels = loadPixels16(_path, &m_width, &m_height, RGB_ALPHA, _vFlip);
-        load(m_width, m_height, 4, 16, pixels);
-        freePixels(pixels);
+    return load(_width, _height, _channels, _bits, _data);
 #endif
+}
+
+bool Texture::_allocateStream(int _width, int _height, int _channels, int _bits) {
+#ifdef STREAMING_TEXTURES
+    // Immutable storage can't be resized, start over on a new texture
+    _clearStream();
+    if (m_id != 0)
+        glDeleteTextures(1, &m_id);
+    glGenTextures(1, &m_id);
+    glBindTexture(GL_TEXTURE_2D, m_id);
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+
+    GLenum internal = GL_RGBA8;
+    if (_bits == 32)
+        internal = GL_RGBA32F;
+    else if (_bits == 16)
+        internal = GL_RGBA16;
+
+    m_width = _width;
+    m_height = _height;
+    m_stream_format = getFormat(_channels);
+    m_stream_type = getType(_bits);
+
+    bool allocated = false;
+#ifdef TEXTURE_STORAGE
+    static int storage = -1;
+    if (storage == -1) {
+        int major = 0, minor = 0;
+        const char* version = (const char*)glGetString(GL_VERSION);
+        storage = (version && sscanf(version, "%d.%d", &major, &minor) == 2 && (major > 4 || (major == 4 && minor >= 2))) ||
+                  haveExtension("GL_ARB_texture_storage");
+    }
+    if (storage == 1) {
+        glTexStorage2D(GL_TEXTURE_2D, 1, internal, m_width, m_height);
+        allocated = true;
+    }
+#endif
+    if (!allocated)
+        glTexImage2D(GL_TEXTURE_2D, 0, internal, m_width, m_height, 0, m_stream_format, m_stream_type, NULL);
+
+    m_pbo_size = (GLsizeiptr)_width * _height * _channels * (_bits / 8);
+    m_pbo_index = 0;
+    glGenBuffers(2, m_pbo);
+    for (int i = 0; i < 2; i++) {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_pbo[i]);
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, m_pbo_size, NULL, GL_STREAM_DRAW);
     }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    return true;
+#else
+    return false;
+#endif
+}
 
-    // HDR (radiance rgbE format)
-    else if (ext == "hdr" || ext == "HDR") {
-        float* pixels = loadPixelsHDR(_path, &m_width, &m_height, _vFlip);
-        load(m_width, m_height, 3, 32, pixels);
-        freePixels(pixels);
+void Texture::_clearStream() {
+#ifdef STREAMING_TEXTURES
+    if (m_pbo[0] != 0)
+        glDeleteBuffers(2, m_pbo);
+#endif
+    m_pbo[0] = m_pbo[1] = 0;
+    m_pbo_size = 0;
+    m_pbo_index = 0;
+    m_stream_format = 0;
+    m_stream_type = 0;
+}
+
+bool Texture::load(const std::string& _path, bool _vFlip) {
+    DecodedImage image;
+    if (loadImage(_path, _vFlip, &image)) {
+        load(image.width, image.height, image.channels, image.bits, image.pixels);
+        freePixels(image.pixels);
     }
 
     m_path = _path;
@@ -151,6 +225,16 @@ bool Texture::load(const std::string& _path, bool _vFlip) {
     return true;
 }
 
+bool Texture::load(const DecodedImage& _image, const std::string& _path, bool _vFlip) {
+    if (!load(_image.width, _image.height, _image.channels, _image.bits, _image.pixels))
+        return false;
+
+    m_path = _path;
+    m_vFlip = _vFlip;
+
+    return true;
+}
+
 void Texture::bind() {
     // glActiveTexture(GL_TEXTURE0);
     glBindTexture(GL_TEXTURE_2D, m_id);
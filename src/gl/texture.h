@@ -4,6 +4,18 @@
 
 #include "gl.h"
 
+// Pixel unpack buffers are not on GLES 2.0
+#if !defined(PLATFORM_RPI) && defined(GL_PIXEL_UNPACK_BUFFER)
+#define STREAMING_TEXTURES
+#endif
+
+// Immutable storage needs GL 4.2 (or ARB_texture_storage)
+#if defined(STREAMING_TEXTURES) && !defined(PLATFORM_OSX) && defined(GL_TEXTURE_IMMUTABLE_FORMAT)
+#define TEXTURE_STORAGE
+#endif
+
+struct DecodedImage;
+
 class Texture {
 public:
     Texture();
@@ -12,6 +24,14 @@ public:
     virtual bool    load(const std::string& _filepath, bool _vFlip);
     virtual bool    load(int _width, int _height, int _component, int _bits, const void* _data);
 
+    // Image decoded by loadImage() (possibly on another thread) from _path
+    virtual bool    load(const DecodedImage& _image, const std::string& _path, bool _vFlip);
+
+    // For pixels that change every frame (videos, sequences, audio). Storage is allocated once and
+    // the pixels go through two alternating unpack buffers, so the copy of one frame doesn't wait
+    // for the GPU to be done with the previous one
+    bool            updatePixels(int _width, int _height, int _component, int _bits, const void* _data);
+
     virtual void    clear();
 
     virtual const GLuint    getTextureId() const { return m_id; };
@@ -34,4 +54,14 @@ protected:
     GLuint          m_id;
 
     bool	        m_vFlip;
+
+private:
+    bool            _allocateStream(int _width, int _height, int _component, int _bits);
+    void            _clearStream();
+
+    GLuint          m_pbo[2];
+    GLsizeiptr      m_pbo_size;
+    int             m_pbo_index;
+    GLenum          m_stream_format;
+    GLenum          m_stream_type;
 };
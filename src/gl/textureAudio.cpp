@@ -205,7 +205,7 @@ bool TextureAudio::update() {
             m_texture[i*4] = mag_uint8;
         }
     }
-    Texture::load(m_width, m_height, 4, 8, &m_texture[0]);
+    updatePixels(m_width, m_height, 4, 8, &m_texture[0]);
     return true;
 }
 
@@ -278,7 +278,7 @@ bool TextureStreamAV::update() {
         flipPixelsVertically(frame_data, av_codec_ctx->width, av_codec_ctx->height, 4);
     
     m_currentFrame++;
-    return Texture::load(av_codec_ctx->width, av_codec_ctx->height, 4, 8, frame_data);
+    return updatePixels(av_codec_ctx->width, av_codec_ctx->height, 4, 8, frame_data);
 }
 
 double TextureStreamAV::getFPS() {
@@ -351,10 +351,7 @@ void  TextureStreamAV::clear() {
     if (frame_data)
         free(frame_data);
 
-    if (m_id != 0)
-        glDeleteTextures(1, &m_id);
-
-    m_id = 0;
+    Texture::clear();
 }
 
 #endif
\ No newline at end of file
@@ -1,9 +1,126 @@
 #include "textureStreamSequence.h"
 
+#include <iostream>
+#include <sstream>
+#include <cstring>
+#include <algorithm>
+
 #include "../io/fs.h"
 #include "../io/pixels.h"
+#include "../tools/text.h"
+
+#ifdef SEQUENCE_CACHE
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+#endif
+
+static size_t memory_budget = 512 * 1024 * 1024;
+static bool cache_enabled = false;
+static unsigned long long cache_limit = 8ULL * 1024 * 1024 * 1024;
+
+void TextureStreamSequence::setMemoryBudget(size_t _bytes) {
+    memory_budget = _bytes;
+}
+
+void TextureStreamSequence::setCache(bool _enable) {
+    cache_enabled = _enable;
+}
+
+void TextureStreamSequence::setCacheLimit(unsigned long long _bytes) {
+    cache_limit = _bytes;
+}
+
+#ifdef SEQUENCE_CACHE
+
+// Cache files start with this, followed by the offset of each frame (the index)
+// and the frames, raw and each one on its own pages so they can be mapped as they are
+static const char   cache_magic[8] = { 'G', 'L', 'S', 'L', 'V', 'S', 'Q', '1' };
+struct CacheHeader {
+    char                magic[8];
+    unsigned int        width;
+    unsigned int        height;
+    unsigned int        bits;
+    unsigned int        frames;
+    unsigned long long  sources;    // hash of the files of the sequence and their state
+};
+
+// Anything changing on the files (or their order) makes another hash
+static unsigned long long hashSources(const std::vector<std::string>& _files) {
+    unsigned long long hash = hashString("");
+    for (size_t i = 0; i < _files.size(); i++) {
+        std::string state = getCanonicalPath(_files[i]);
+        struct stat st;
+        if (stat(_files[i].c_str(), &st) == 0) {
+            long long mtime_ns = 0;
+#if defined(__APPLE__)
+            mtime_ns = st.st_mtimespec.tv_nsec;
+#elif defined(__linux__)
+            mtime_ns = st.st_mtim.tv_nsec;
+#endif
+            state += "|" + std::to_string((long long)st.st_mtime) + "." + std::to_string(mtime_ns) + "|" + std::to_string((long long)st.st_size);
+        }
+        hash = hashString(state + '\n', hash);
+    }
+    return hash;
+}
+
+static size_t toPages(size_t _bytes) {
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    return (_bytes + page - 1) / page * page;
+}
+
+#endif
+
+// Decodes a frame as RGBA, free it with freePixels()
+static void* decodeFrame(const std::string& _path, bool _vFlip, int* _width, int* _height, size_t* _bits) {
+    std::string ext = getExt(_path);
+    void* pixels = nullptr;
+
+    // BMP non-1bpp, non-RLE
+    // GIF (*comp always reports as 4-channel)
+    // JPEG baseline & progressive (12 bpc/arithmetic not supported, same as stock IJG lib)
+    if (ext == "bmp"    || ext == "BMP" ||
+        ext == "jpg"    || ext == "JPG" ||
+        ext == "jpeg"   || ext == "JPEG" ) {
+        *_bits = 8;
+        pixels = loadPixels(_path, _width, _height, RGB_ALPHA, _vFlip);
+    }
+    else if (   ext == "png" || ext == "PNG" ||
+                ext == "psd" || ext == "PSD" ||
+                ext == "tga" || ext == "TGA" ) {
+#ifdef PLATFORM_RPI
+        // If we are in a Raspberry Pi don't take the risk of loading a 16bit image
+        *_bits = 8;
+        pixels = loadPixels(_path, _width, _height, RGB_ALPHA, _vFlip);
+#else
+        *_bits = 16;
+        pixels = loadPixels16(_path, _width, _height, RGB_ALPHA, _vFlip);
+#endif
+    }
 
-TextureStreamSequence::TextureStreamSequence() : m_currentFrame(0), m_bits(8) {
+#ifdef PLATFORM_RPI
+    int max_size = std::max(*_width, *_height);
+    if (pixels && max_size > 1024) {
+        float factor = max_size/1024.0;
+        int w = *_width/factor;
+        int h = *_height/factor;
+        unsigned char* data = (unsigned char*)malloc(w * h * 4);
+        rescalePixels((unsigned char*)pixels, *_width, *_height, 4, w, h, data);
+        freePixels(pixels);
+        pixels = data;
+        *_width = w;
+        *_height = h;
+    }
+#endif
+
+    return pixels;
+}
+
+TextureStreamSequence::TextureStreamSequence() : m_stop(false),
+    m_cache_total(0), m_cache_map(nullptr), m_cache_size(0), m_cache_fd(-1), m_cache_failed(false), m_currentFrame(0), m_bits(8) {
 
 }
 
@@ -12,93 +129,374 @@ TextureStreamSequence::~TextureStreamSequence() {
 }
 
 bool TextureStreamSequence::load(const std::string& _path, bool _vFlip) {
+    clear();
+
     m_path = _path;
     m_vFlip = _vFlip;
 
     std::vector<std::string> files = glob(_path);
     for (size_t i = 0; i < files.size(); i++) {
-
         std::string ext = getExt(files[i]);
+        if (ext == "bmp" || ext == "BMP" || ext == "jpg" || ext == "JPG" || ext == "jpeg" || ext == "JPEG" ||
+            ext == "png" || ext == "PNG" || ext == "psd" || ext == "PSD" || ext == "tga" || ext == "TGA" )
+            m_files.push_back(files[i]);
+    }
+
+    if (m_files.size() == 0)
+        return true;
+
+    // Packed already, nothing to decode
+    if (cache_enabled && _openCache())
+        return true;
+
+    // The first frame tells how much each one takes
+    void* first = decodeFrame(m_files[0], m_vFlip, &m_width, &m_height, &m_bits);
+    if (first == nullptr) {
+        std::cerr << "Error decoding " << m_files[0] << std::endl;
+        m_files.clear();
+        return false;
+    }
 
-        // BMP non-1bpp, non-RLE
-        // GIF (*comp always reports as 4-channel)
-        // JPEG baseline & progressive (12 bpc/arithmetic not supported, same as stock IJG lib)
-        if (ext == "bmp"    || ext == "BMP" ||
-            ext == "jpg"    || ext == "JPG" ||
-            ext == "jpeg"   || ext == "JPEG" ) {
-
-            m_bits = 8;
-            unsigned char* pixels = loadPixels(files[i], &m_width, &m_height, RGB_ALPHA, _vFlip);
-            #ifdef PLATFORM_RPI
-            int max_size = std::max(m_width, m_height);
-            if ( max_size > 1024) {
-                float factor = max_size/1024.0;
-                int w = m_width/factor;
-                int h = m_height/factor;
-                unsigned char * data = new unsigned char [w * h * 4];
-                rescalePixels((unsigned char*)pixels, m_width, m_height, 4, w, h, data);
-                delete[] pixels;
-                pixels = data;
-                m_width = w;
-                m_height = h;
+    size_t frame_size = (size_t)m_width * m_height * 4 * (m_bits / 8);
+    size_t total = std::min(m_files.size(), std::max((size_t)2, memory_budget / std::max(frame_size, (size_t)1)));
+    m_slots.resize(total);
+    m_slots[0].pixels = first;
+    m_slots[0].frame = 0;
+    m_slots[0].ready = true;
+    m_frame_slots.assign(m_files.size(), -1);
+    m_frame_slots[0] = 0;
+
+    if (cache_enabled) {
+        _createCache();
+        _cacheFrame(0, first);
+    }
+
+    size_t threads = std::min(total - 1, (size_t)std::max(1, static_cast<int>(std::thread::hardware_concurrency()) - 1));
+    m_stop = false;
+    for (size_t i = 0; i < threads; i++)
+        m_threads.push_back( std::thread(&TextureStreamSequence::_decode, this) );
+
+    return true;
+}
+
+// If _frame is on the window of frames ahead of the play head (the play head included)
+bool TextureStreamSequence::_isAhead(int _frame) const {
+    return _frame >= 0 && (_frame + m_files.size() - m_currentFrame) % m_files.size() < m_slots.size();
+}
+
+// Next frame (from the play head on) without a slot, and a slot for it: a free one or one
+// with a frame already played. There is always one, the window is as long as the ring
+bool TextureStreamSequence::_nextFrame(size_t* _frame, size_t* _slot) {
+    for (size_t i = 0; i < m_slots.size(); i++) {
+        size_t frame = (m_currentFrame + i) % m_files.size();
+        if (m_frame_slots[frame] != -1)
+            continue;
+
+        for (size_t s = 0; s < m_slots.size(); s++)
+            if (!_isAhead(m_slots[s].frame)) {
+                *_frame = frame;
+                *_slot = s;
+                return true;
             }
-            #endif
-            m_frames.push_back( (void*)pixels );
+        return false;
+    }
+    return false;
+}
+
+void TextureStreamSequence::_decode() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (!m_stop) {
+        size_t frame, index;
+        if (!_nextFrame(&frame, &index)) {
+            m_condition.wait(lock);
+            continue;
         }
-        else if (   ext == "png" || ext == "PNG" ||
-                    ext == "psd" || ext == "PSD" ||
-                    ext == "tga" || ext == "TGA" ) {
-            // m_bits = 8;
-            // unsigned char* pixels = loadPixels(files[i], &m_width, &m_height, RGB_ALPHA, _vFlip);
-
-            #ifdef PLATFORM_RPI
-            m_bits = 8;
-            // If we are in a Raspberry Pi don't take the risk of loading a 16bit image
-            unsigned char* pixels = loadPixels(files[i], &m_width, &m_height, RGB_ALPHA, _vFlip);
-            int max_size = std::max(m_width, m_height);
-            if ( max_size > 1024) {
-                float factor = max_size/1024.0;
-                int w = m_width/factor;
-                int h = m_height/factor;
-                unsigned char * data = new unsigned char [w * h * 4];
-                rescalePixels((unsigned char*)pixels, m_width, m_height, 4, w, h, data);
-                delete[] pixels;
-                pixels = data;
-                m_width = w;
-                m_height = h;
-            }
-            m_frames.push_back( (void*)pixels );
-            #else
-            m_bits = 16;
-            uint16_t* pixels = loadPixels16(files[i], &m_width, &m_height, RGB_ALPHA, _vFlip);
-            m_frames.push_back( (void*)pixels );
-            #endif
+
+        Slot& slot = m_slots[index];
+        if (slot.frame != -1)
+            m_frame_slots[slot.frame] = -1;
+        if (slot.pixels)
+            freePixels(slot.pixels);
+        slot.pixels = nullptr;
+        slot.frame = (int)frame;
+        slot.ready = false;
+        m_frame_slots[frame] = (int)index;
+
+        lock.unlock();
+        int width = 0, height = 0;
+        size_t bits = 0;
+        void* pixels = decodeFrame(m_files[frame], m_vFlip, &width, &height, &bits);
+
+        // Frames of another size or depth are left out
+        if (pixels && (width != m_width || height != m_height || bits != m_bits)) {
+            std::cerr << "Frame " << m_files[frame] << " doesn't match the size of the sequence" << std::endl;
+            freePixels(pixels);
+            pixels = nullptr;
+        }
+        _cacheFrame(frame, pixels);
+        lock.lock();
+
+        // Frames ahead are never taken from their slot, only clear() can be here before
+        if (slot.frame == (int)frame && !slot.ready) {
+            slot.pixels = pixels;
+            slot.ready = true;
         }
+        else if (pixels)
+            freePixels(pixels);
+        m_condition.notify_all();
     }
-    
-    return true;
 }
 
 bool TextureStreamSequence::update() {
-    if (m_frames.size() == 0)
+    if (m_files.size() == 0)
         return false;
 
-    if ( Texture::load(m_width, m_height, 4, m_bits, m_frames[ m_currentFrame ]) ) {
-        m_currentFrame = (m_currentFrame + 1) % m_frames.size();
-        return true;
+    // Straight from the mapped file, the pages of the next frame are read ahead
+    if (m_cache_map) {
+        size_t next = (m_currentFrame + 1) % m_files.size();
+        size_t frame_size = (size_t)m_width * m_height * 4 * (m_bits / 8);
+#ifdef SEQUENCE_CACHE
+        madvise(m_cache_map + m_cache_offsets[next], frame_size, MADV_WILLNEED);
+#endif
+        bool uploaded = updatePixels(m_width, m_height, 4, m_bits, m_cache_map + m_cache_offsets[m_currentFrame]);
+        m_currentFrame = next;
+        return uploaded;
     }
 
-    return false;
+    // Every update shows the next frame, so it waits for it if it's not ready yet
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (m_threads.size() > 0)
+        m_condition.wait(lock, [&]() {
+            int index = m_frame_slots[m_currentFrame];
+            return index != -1 && m_slots[index].ready;
+        });
+    else if (m_frame_slots[m_currentFrame] == -1)
+        return false;
+    Slot& slot = m_slots[ m_frame_slots[m_currentFrame] ];
+    void* pixels = slot.pixels;
+    lock.unlock();
+
+    // The play head is on the window, so its slot is not taken until it moves
+    bool uploaded = pixels && updatePixels(m_width, m_height, 4, m_bits, pixels);
+
+    lock.lock();
+    // If they all fit there is nothing to make room for
+    if (m_slots.size() < m_files.size()) {
+        if (slot.pixels)
+            freePixels(slot.pixels);
+        m_frame_slots[m_currentFrame] = -1;
+        slot.pixels = nullptr;
+        slot.frame = -1;
+        slot.ready = false;
+    }
+    m_currentFrame = (m_currentFrame + 1) % m_files.size();
+    m_condition.notify_all();
+
+    return uploaded;
 }
 
 void TextureStreamSequence::clear() {
-    // for (size_t i = 0; i < m_frames.size(); i++)
-    //     delete [] (m_frames[i]);
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_condition.notify_all();
+    for (size_t i = 0; i < m_threads.size(); i++)
+        m_threads[i].join();
+    m_threads.clear();
+
+    for (size_t i = 0; i < m_slots.size(); i++)
+        if (m_slots[i].pixels)
+            freePixels(m_slots[i].pixels);
+    m_slots.clear();
+    m_frame_slots.clear();
+    _closeCache();
+    m_files.clear();
+    m_currentFrame = 0;
+
+    Texture::clear();
+}
+
+bool TextureStreamSequence::_openCache() {
+#ifdef SEQUENCE_CACHE
+    std::string folder = getCacheFolder("sequences");
+    if (folder.empty())
+        return false;
+
+    std::ostringstream key;
+    key << std::hex << hashString(getCanonicalPath(m_files[0]) + '\n' + m_path + (m_vFlip ? "|flip" : ""));
+    m_cache_path = folder + key.str() + ".frames";
+
+    int fd = open(m_cache_path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    CacheHeader header = CacheHeader();
+    struct stat st;
+    bool valid =    pread(fd, &header, sizeof(header), 0) == (ssize_t)sizeof(header) &&
+                    memcmp(header.magic, cache_magic, sizeof(cache_magic)) == 0 &&
+                    header.frames == m_files.size() &&
+                    header.sources == hashSources(m_files) &&
+                    fstat(fd, &st) == 0;
 
-    m_frames.clear();
+    size_t frame_size = (size_t)header.width * header.height * 4 * (header.bits / 8);
+    size_t index_size = sizeof(header) + header.frames * sizeof(unsigned long long);
+    valid = valid && (size_t)st.st_size >= toPages(index_size) + header.frames * toPages(frame_size);
 
-    if (m_id != 0)
-        glDeleteTextures(1, &m_id);
+    void* map = MAP_FAILED;
+    if (valid)
+        map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
 
-    m_id = 0;
+    if (map == MAP_FAILED) {
+        if (valid)
+            std::cerr << "Can't map " << m_cache_path << std::endl;
+        else
+            std::cout << "// " << m_path << " sequence changed since it was packed" << std::endl;
+        return false;
+    }
+
+    // A damaged index could point frames past the end of the file
+    const unsigned long long* offsets = (const unsigned long long*)((unsigned char*)map + sizeof(header));
+    for (size_t i = 0; valid && i < header.frames; i++)
+        valid = offsets[i] <= (unsigned long long)st.st_size && frame_size <= (unsigned long long)st.st_size - offsets[i];
+    if (!valid) {
+        munmap(map, st.st_size);
+        remove(m_cache_path.c_str());
+        std::cerr << m_cache_path << " is damaged, removing it" << std::endl;
+        return false;
+    }
+
+    m_cache_map = (unsigned char*)map;
+    m_cache_size = st.st_size;
+    m_cache_offsets.assign( (const unsigned long long*)(m_cache_map + sizeof(header)),
+                            (const unsigned long long*)(m_cache_map + index_size) );
+    m_width = header.width;
+    m_height = header.height;
+    m_bits = header.bits;
+    madvise(m_cache_map, m_cache_size, MADV_SEQUENTIAL);
+    return true;
+#else
+    return false;
+#endif
+}
+
+// Frames are written as they are decoded, once all of them are there the file is moved
+// in place (so other instances never map half a file)
+void TextureStreamSequence::_createCache() {
+#ifdef SEQUENCE_CACHE
+    if (m_cache_path.empty())
+        return;
+
+    size_t frame_size = (size_t)m_width * m_height * 4 * (m_bits / 8);
+    size_t offset = toPages(sizeof(CacheHeader) + m_files.size() * sizeof(unsigned long long));
+    std::vector<unsigned long long> offsets(m_files.size());
+    for (size_t i = 0; i < m_files.size(); i++) {
+        offsets[i] = offset;
+        offset += toPages(frame_size);
+    }
+
+    // The file is made sparse, check there is room for all of it before starting
+    struct statvfs fs;
+    std::string folder = m_cache_path.substr(0, m_cache_path.find_last_of('/') + 1);
+    unsigned long long available = (statvfs(folder.c_str(), &fs) == 0) ? (unsigned long long)fs.f_bavail * fs.f_frsize : offset;
+    if (offset > cache_limit || offset > available) {
+        std::cout << "// " << m_path << " sequence needs " << (offset + 1024 * 1024 - 1) / (1024 * 1024) << "MB to be packed, more than " << (offset > cache_limit ? "the cache limit" : "the free space") << std::endl;
+        return;
+    }
+
+    std::string tmp = m_cache_path + ".tmp";
+    m_cache_fd = open(tmp.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (m_cache_fd < 0)
+        return;
+
+    m_cache_offsets.swap(offsets);
+    m_cache_written.assign(m_files.size(), false);
+    m_cache_total = 0;
+    m_cache_failed = false;
+
+    size_t index_size = m_files.size() * sizeof(unsigned long long);
+    if (ftruncate(m_cache_fd, offset) != 0 ||
+        pwrite(m_cache_fd, &m_cache_offsets[0], index_size, sizeof(CacheHeader)) != (ssize_t)index_size) {
+        std::cerr << "Can't write " << tmp << std::endl;
+        _failCache();
+    }
+#endif
+}
+
+void TextureStreamSequence::_cacheFrame(size_t _frame, const void* _pixels) {
+#ifdef SEQUENCE_CACHE
+    // Claimed before writing it, so no other thread writes it too
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_cache_fd < 0 || m_cache_failed || m_cache_written[_frame])
+            return;
+        m_cache_written[_frame] = true;
+    }
+
+    // The file stays open until all the frames are written
+    size_t frame_size = (size_t)m_width * m_height * 4 * (m_bits / 8);
+    bool written = _pixels && pwrite(m_cache_fd, _pixels, frame_size, m_cache_offsets[_frame]) == (ssize_t)frame_size;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    // Without all the frames there is no cache
+    if (!written) {
+        std::cerr << "Can't write " << m_cache_path << ".tmp" << std::endl;
+        _failCache();
+        return;
+    }
+
+    if (++m_cache_total < m_files.size())
+        return;
+
+    CacheHeader header;
+    memcpy(header.magic, cache_magic, sizeof(cache_magic));
+    header.width = m_width;
+    header.height = m_height;
+    header.bits = m_bits;
+    header.frames = m_files.size();
+    header.sources = hashSources(m_files);
+
+    std::string tmp = m_cache_path + ".tmp";
+    if (pwrite(m_cache_fd, &header, sizeof(header), 0) == (ssize_t)sizeof(header) &&
+        close(m_cache_fd) == 0 &&
+        rename(tmp.c_str(), m_cache_path.c_str()) == 0)
+        std::cout << "// " << m_path << " sequence packed on " << m_cache_path << std::endl;
+    else
+        remove(tmp.c_str());
+    m_cache_fd = -1;
+#endif
+}
+
+// Gives the space back right away. The file stays open until the sequence is cleared,
+// as other threads may still be writing on it
+void TextureStreamSequence::_failCache() {
+#ifdef SEQUENCE_CACHE
+    m_cache_failed = true;
+    if (ftruncate(m_cache_fd, 0) != 0)
+        std::cerr << "Can't truncate " << m_cache_path << ".tmp" << std::endl;
+    remove((m_cache_path + ".tmp").c_str());
+#endif
+}
+
+void TextureStreamSequence::_closeCache() {
+#ifdef SEQUENCE_CACHE
+    if (m_cache_map)
+        munmap(m_cache_map, m_cache_size);
+
+    // Unfinished
+    if (m_cache_fd >= 0) {
+        close(m_cache_fd);
+        remove((m_cache_path + ".tmp").c_str());
+    }
+#endif
+    m_cache_path = "";
+    m_cache_map = nullptr;
+    m_cache_size = 0;
+    m_cache_fd = -1;
+    m_cache_offsets.clear();
+    m_cache_written.clear();
+    m_cache_total = 0;
+    m_cache_failed = false;
 }
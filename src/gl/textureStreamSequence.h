@@ -1,15 +1,34 @@
-
 #pragma once
 
 #include "textureStream.h"
+
 #include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+// Decoded sequences can be packed on a file mapped on later runs (needs mmap)
+#if !defined(_WIN32)
+#define SEQUENCE_CACHE
+#endif
 
+// Frames are decoded by background threads ahead of the play head, and only as many
+// as fit on the memory budget are kept (the oldest ones make room for the next)
 class TextureStreamSequence : public TextureStream {
 public:
     TextureStreamSequence();
     virtual ~TextureStreamSequence();
 
-    virtual int     getTotalFrames() { return m_frames.size(); };
+    // Bytes of decoded frames each sequence can hold (512MB by default)
+    static void     setMemoryBudget(size_t _bytes);
+
+    // The first time a sequence plays its frames are saved on $XDG_CACHE_HOME/glslViewer/sequences,
+    // the next times they are read from there without decoding until a file changes (off by default)
+    static void     setCache(bool _enable);
+    // Sequences that would need a bigger file (8GB by default), or more than the free space, aren't packed
+    static void     setCacheLimit(unsigned long long _bytes);
+
+    virtual int     getTotalFrames() { return m_files.size(); };
     virtual int     getCurrentFrame() { return m_currentFrame; };
 
     virtual bool    load(const std::string& _filepath, bool _vFlip);
@@ -17,9 +36,40 @@ public:
     virtual void    clear();
 
 private:
+    struct Slot {
+        void*   pixels  = nullptr;
+        int     frame   = -1;       // the one it holds (or is being decoded into it)
+        bool    ready   = false;
+    };
+
+    void            _decode();
+    bool            _isAhead(int _frame) const;
+    bool            _nextFrame(size_t* _frame, size_t* _slot);
+
+    bool            _openCache();
+    void            _createCache();
+    void            _cacheFrame(size_t _frame, const void* _pixels);
+    void            _failCache();
+    void            _closeCache();
+
+    std::vector<std::string>    m_files;
+    std::vector<Slot>           m_slots;
+    std::vector<int>            m_frame_slots;  // slot of each frame, -1 for the ones that have none
+    std::vector<std::thread>    m_threads;
+    std::mutex                  m_mutex;
+    std::condition_variable     m_condition;
+    bool                        m_stop;
+
+    // Packed frames, the mapped ones or the ones being written
+    std::string                 m_cache_path;
+    std::vector<unsigned long long> m_cache_offsets;
+    std::vector<bool>           m_cache_written;
+    size_t                      m_cache_total;
+    unsigned char*              m_cache_map;
+    size_t                      m_cache_size;
+    int                         m_cache_fd;
+    bool                        m_cache_failed;
 
-    std::vector<void*>  m_frames;
     size_t  m_currentFrame;
     size_t  m_bits;
-
 };
@@ -0,0 +1,81 @@
+#include "uniformBuffer.h"
+
+#include <cstring>
+#include <cstdio>
+
+UniformBuffer::UniformBuffer(): m_size(0), m_id(0), m_binding(0) {
+}
+
+UniformBuffer::~UniformBuffer() {
+    clear();
+}
+
+bool UniformBuffer::isSupported() {
+#ifdef UNIFORM_BUFFERS
+    static int supported = -1;
+    if (supported == -1) {
+        int major = 0, minor = 0;
+        const char* version = (const char*)glGetString(GL_VERSION);
+        if (version && sscanf(version, "%d.%d", &major, &minor) == 2 && (major > 3 || (major == 3 && minor >= 1)))
+            supported = 1;
+        else {
+            // Legacy contexts still list their extensions on a single string
+            const char* extensions = (const char*)glGetString(GL_EXTENSIONS);
+            supported = (extensions && strstr(extensions, "GL_ARB_uniform_buffer_object")) ? 1 : 0;
+        }
+    }
+    return supported == 1;
+#else
+    return false;
+#endif
+}
+
+bool UniformBuffer::allocate(GLuint _binding, size_t _size) {
+#ifdef UNIFORM_BUFFERS
+    if (!isSupported())
+        return false;
+
+    if (m_id == 0)
+        glGenBuffers(1, &m_id);
+
+    glBindBuffer(GL_UNIFORM_BUFFER, m_id);
+    glBufferData(GL_UNIFORM_BUFFER, _size, NULL, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    glBindBufferBase(GL_UNIFORM_BUFFER, _binding, m_id);
+
+    m_binding = _binding;
+    m_size = _size;
+    m_data.clear();
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool UniformBuffer::update(const void* _data) {
+#ifdef UNIFORM_BUFFERS
+    if (m_id == 0)
+        return false;
+
+    if (m_data.size() == m_size && memcmp(m_data.data(), _data, m_size) == 0)
+        return false;
+
+    m_data.assign((const char*)_data, m_size);
+    glBindBuffer(GL_UNIFORM_BUFFER, m_id);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, m_size, _data);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    return true;
+#else
+    return false;
+#endif
+}
+
+void UniformBuffer::clear() {
+#ifdef UNIFORM_BUFFERS
+    if (m_id != 0)
+        glDeleteBuffers(1, &m_id);
+#endif
+    m_id = 0;
+    m_size = 0;
+    m_data.clear();
+}
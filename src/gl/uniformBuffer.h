@@ -0,0 +1,39 @@
+#pragma once
+
+#include <string>
+
+#include "gl.h"
+
+// Uniform blocks need GL 3.1 (or ARB_uniform_buffer_object), GLES 2.0 doesn't have them
+#if !defined(PLATFORM_RPI) && defined(GL_UNIFORM_BUFFER)
+#define UNIFORM_BUFFERS
+#endif
+
+// Buffer holding a std140 uniform block. It stays bound to a fixed binding point,
+// so the shaders declaring the block read it without any glUniform call
+class UniformBuffer {
+public:
+    UniformBuffer();
+    virtual ~UniformBuffer();
+
+    // True when the current GL context can use them
+    static bool     isSupported();
+
+    bool            allocate(GLuint _binding, size_t _size);
+
+    // Uploads _data (of the allocated size) only if it's different from what was sent last time
+    bool            update(const void* _data);
+
+    const GLuint    getId() const { return m_id; }
+    const GLuint    getBinding() const { return m_binding; }
+    const size_t    getSize() const { return m_size; }
+    const bool      isAllocated() const { return m_id != 0; }
+
+    void            clear();
+
+private:
+    std::string     m_data;
+    size_t          m_size;
+    GLuint          m_id;
+    GLuint          m_binding;
+};
@@ -4,15 +4,20 @@
 #include <fstream>      // File
 #include <iterator>     // std::back_inserter
 #include <algorithm>    // std::unique
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
 #include <sys/stat.h>
 
 #ifdef _WIN32
 #include <stdlib.h>
 #include <stdio.h>
 #include <errno.h>
+#include <direct.h>
 #define WIN32_LEAN_AND_MEAN 1
 #include <windows.h>
 #else
+#include <errno.h>
 #include <glob.h>
 #endif
 
@@ -63,6 +68,51 @@ std::string getAbsPath(const std::string& _path) {
     else return "";
 }
 
+std::string getCanonicalPath(const std::string& _path) {
+#if defined (PLATFORM_WINDOWS)
+    char full_path[_MAX_PATH];
+    if (_fullpath(full_path, _path.c_str(), _MAX_PATH) != NULL)
+        return full_path;
+    return _path;
+#else
+    char* real_path = realpath(_path.c_str(), NULL);
+    if (real_path == NULL)
+        return _path;
+    std::string canonical_path(real_path);
+    free(real_path);
+    return canonical_path;
+#endif
+}
+
+static bool makeFolder(const std::string& _path) {
+#ifdef _WIN32
+    return _mkdir(_path.c_str()) == 0 || errno == EEXIST;
+#else
+    return mkdir(_path.c_str(), 0755) == 0 || errno == EEXIST;
+#endif
+}
+
+std::string getCacheFolder(const std::string& _name) {
+    std::string base;
+    const char* xdg = getenv("XDG_CACHE_HOME");
+    if (xdg && xdg[0] != '\0')
+        base = xdg;
+    else if (const char* home = getenv("HOME"))
+        base = std::string(home) + "/.cache";
+#ifdef _WIN32
+    else if (const char* local = getenv("LOCALAPPDATA"))
+        base = local;
+#endif
+    if (base.empty())
+        return "";
+
+    if (makeFolder(base) && makeFolder(base + "/glslViewer") && makeFolder(base + "/glslViewer/" + _name))
+        return base + "/glslViewer/" + _name + "/";
+
+    std::cerr << "Can't create the cache folder on " << base << std::endl;
+    return "";
+}
+
 std::string urlResolve(const std::string& _path, const std::string& _pwd, const List &_include_folders) {
     std::string url = _pwd +'/'+ _path;
 
@@ -94,58 +144,115 @@ bool extractDependency(const std::string &_line, std::string *_dependency) {
     return false;
 }
 
-bool alreadyInclude(const std::string &_path, List *_dependencies) {
-    for (unsigned int i = 0; i < _dependencies->size(); i++) {
-        if ( _path == (*_dependencies)[i]) {
-            return true;
-        }
-    }
-    return false;
-}
+// A file split by its #include lines, so reloads only read the files that changed
+struct IncludeUnit {
+    std::string                 folder;     // absolute folder, includes are resolved from it
+    long long                   mtime = 0;
+    long long                   mtime_ns = 0;
+    long long                   size = -1;
+    std::vector<std::string>    chunks;     // text around the includes (one more than includes)
+    std::vector<std::string>    includes;   // as written on the #include line
+};
 
-bool loadFromPath(const std::string &_path, std::string *_into, const std::vector<std::string> &_include_folders, List *_dependencies) {
-    std::ifstream file;
-    file.open(_path.c_str());
+// By absolute path. Shared, so a unit replaced while assembling stays alive for whoever is reading it
+static std::unordered_map<std::string, std::shared_ptr<const IncludeUnit> > include_units;
 
-    // Skip if it's already open
+static std::shared_ptr<const IncludeUnit> getIncludeUnit(const std::string &_path) {
+    struct stat st;
+    if (stat(_path.c_str(), &st) != 0)
+        return nullptr;
+
+    long long mtime_ns = 0;
+#if defined(__APPLE__)
+    mtime_ns = st.st_mtimespec.tv_nsec;
+#elif defined(__linux__)
+    mtime_ns = st.st_mtim.tv_nsec;
+#endif
+
+    std::unordered_map<std::string, std::shared_ptr<const IncludeUnit> >::iterator it = include_units.find(_path);
+    if (it != include_units.end() && 
+        it->second->mtime == (long long)st.st_mtime && it->second->mtime_ns == mtime_ns && it->second->size == (long long)st.st_size)
+        return it->second;
+
+    std::ifstream file(_path.c_str());
     if (!file.is_open()) 
-        return false;
+        return nullptr;
+
+    std::string content((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    file.close();
 
-    // Get absolute home folder
-    std::string original_path = getAbsPath(_path);
+    std::shared_ptr<IncludeUnit> unit(new IncludeUnit());
+    unit->folder = getAbsPath(_path);
+    unit->mtime = st.st_mtime;
+    unit->mtime_ns = mtime_ns;
+    unit->size = st.st_size;
+    unit->chunks.push_back("");
 
-    std::string line;
+    // Every line ends with a new line, one more after a last one (same as reading them with getline until eof)
     std::string dependency;
-    std::string newBuffer;
-    while (!file.eof()) {
-        dependency = "";
-        getline(file, line);
+    size_t start = 0;
+    while (start <= content.size()) {
+        size_t end = content.find('\n', start);
+        if (end == std::string::npos)
+            end = content.size();
 
+        std::string line = content.substr(start, end - start);
         if (extractDependency(line, &dependency)) {
-            dependency = urlResolve(dependency, original_path, _include_folders);
-            newBuffer = "";
-            if (loadFromPath(dependency, &newBuffer, _include_folders, _dependencies)) {
-                if (!alreadyInclude(dependency, _dependencies)) {
-                    // Insert the content of the dependency
-                    (*_into) += "\n" + newBuffer + "\n";
-
-                    // Add dependency to dependency list
-                    _dependencies->push_back(dependency);
-                }
-            }
-            else {
-                std::cerr << "Error: " << dependency << " not found at " << original_path << std::endl;
+            unit->includes.push_back(dependency);
+            unit->chunks.push_back("");
+        }
+        else
+            unit->chunks.back() += line + "\n";
+
+        start = end + 1;
+    }
+
+    include_units[_path] = unit;
+    return unit;
+}
+
+static bool assembleFromPath(const std::string &_path, std::string *_into, const List &_include_folders, List *_dependencies, std::unordered_set<std::string>& _included) {
+    std::shared_ptr<const IncludeUnit> unit = getIncludeUnit(_path);
+    if (!unit)
+        return false;
+
+    const std::string& folder = unit->folder;
+    const std::vector<std::string>& chunks = unit->chunks;
+    const std::vector<std::string>& includes = unit->includes;
+
+    for (size_t i = 0; i < chunks.size(); i++) {
+        (*_into) += chunks[i];
+        if (i >= includes.size())
+            break;
+
+        // Included before, along with everything it includes
+        std::string dependency = urlResolve(includes[i], folder, _include_folders);
+        if (_included.count(dependency))
+            continue;
+
+        std::string newBuffer;
+        if (assembleFromPath(dependency, &newBuffer, _include_folders, _dependencies, _included)) {
+            if (_included.insert(dependency).second) {
+                // Insert the content of the dependency
+                (*_into) += "\n" + newBuffer + "\n";
+
+                // Add dependency to dependency list
+                _dependencies->push_back(dependency);
             }
         }
         else {
-            (*_into) += line + "\n";
+            std::cerr << "Error: " << dependency << " not found at " << folder << std::endl;
         }
     }
 
-    file.close();
     return true;
 }
 
+bool loadFromPath(const std::string &_path, std::string *_into, const std::vector<std::string> &_include_folders, List *_dependencies) {
+    std::unordered_set<std::string> included(_dependencies->begin(), _dependencies->end());
+    return assembleFromPath(_path, _into, _include_folders, _dependencies, included);
+}
+
 std::string toString(FileType _type) {
     if (_type == FRAG_SHADER) {
         return "FRAG_SHADER";
@@ -25,11 +25,16 @@ bool urlExists(const std::string& _filename);
 bool haveExt(const std::string& _filename, const std::string& _ext);
 std::string getExt(const std::string& _filename);
 
+// Files are parsed once and kept (by path) until they change, a reload only reads again the ones modified
 bool loadFromPath(const std::string& _filename, std::string *_into, const List& _include_folders, List *_dependencies);
 
 std::string toString(FileType _type);
 std::string getBaseDir (const std::string& filepath);
 std::string getAbsPath (const std::string& _filename);
+std::string getCanonicalPath (const std::string& _filename);  // absolute, without links, "." or ".."
+
+// $XDG_CACHE_HOME/glslViewer/<_name>/ (~/.cache/... by default), made if it's not there. Empty if it can't be
+std::string getCacheFolder(const std::string& _name);
 std::string urlResolve(const std::string& _filename, const std::string& _pwd, const List& _include_folders);
 std::vector<std::string> glob(const std::string& _pattern);
 
@@ -28,8 +28,15 @@
 
 #define BUFFER_OFFSET(i) ((char *)NULL + (i))
 
+// Keeps images encoded, they are decoded on the threads of Uniforms (see extractMaterial)
+static bool keepImageData(tinygltf::Image* _image, const int _index, std::string* _err, std::string* _warn, int _width, int _height, const unsigned char* _bytes, int _size, void* _userData) {
+    _image->image.assign(_bytes, _bytes + _size);
+    return true;
+}
+
 bool loadModel(tinygltf::Model& _model, const std::string& _filename) {
     tinygltf::TinyGLTF loader;
+    loader.SetImageLoader(keepImageData, nullptr);
     std::string err;
     std::string warn;
     std::string ext = getExt(_filename);
@@ -145,11 +152,7 @@ Material extractMaterial(const tinygltf::Model& _model, const tinygltf::Material
         if (_verbose)
             std::cout << "Loading " << name << "for BASECOLORMAP as " << name << std::endl;
 
-        Texture* texture = new Texture();
-        texture->load(image.width, image.height, image.component, image.bits, &image.image.at(0));
-        if (!_uniforms.addTexture(name, texture)) {
-            delete texture;
-        }
+        _uniforms.addTexture(name, image.image, false, _verbose);
         mat.addDefine("MATERIAL_BASECOLORMAP", name);
     }
 
@@ -164,11 +167,7 @@ Material extractMaterial(const tinygltf::Model& _model, const tinygltf::Material
         if (_verbose)
             std::cout << "Loading " << name << "for EMISSIVEMAP as " << name << std::endl;
 
-        Texture* texture = new Texture();
-        texture->load(image.width, image.height, image.component, image.bits, &image.image.at(0));
-        if (!_uniforms.addTexture(name, texture)) {
-            delete texture;
-        }
+        _uniforms.addTexture(name, image.image, false, _verbose);
         mat.addDefine("MATERIAL_EMISSIVEMAP", name);
     }
 
@@ -186,11 +185,7 @@ Material extractMaterial(const tinygltf::Model& _model, const tinygltf::Material
         if (_verbose)
             std::cout << "Loading " << name << "for METALLICROUGHNESSMAP as " << name << std::endl;
 
-        Texture* texture = new Texture();
-        texture->load(image.width, image.height, image.component, image.bits, &image.image.at(0));
-        if (!_uniforms.addTexture(name, texture)) {
-            delete texture;
-        }
+        _uniforms.addTexture(name, image.image, false, _verbose);
 
         if (_material.occlusionTexture.index >= 0) {
             const tinygltf::Image &occlussionImage = _model.images[_model.textures[_material.occlusionTexture.index].source];
@@ -218,11 +213,7 @@ Material extractMaterial(const tinygltf::Model& _model, const tinygltf::Material
         if (_verbose)
             std::cout << "Loading " << name << "for OCCLUSIONMAP as " << name << std::endl;
 
-        Texture* texture = new Texture();
-        texture->load(image.width, image.height, image.component, image.bits, &image.image.at(0));
-        if (!_uniforms.addTexture(name, texture)) {
-            delete texture;
-        }
+        _uniforms.addTexture(name, image.image, false, _verbose);
         mat.addDefine("MATERIAL_OCCLUSIONMAP", name);
 
         if (_material.occlusionTexture.strength != 1.0)
@@ -240,11 +231,7 @@ Material extractMaterial(const tinygltf::Model& _model, const tinygltf::Material
         if (_verbose)
             std::cout << "Loading " << name << "for NORMALMAP as " << name << std::endl;
 
-        Texture* texture = new Texture();
-        texture->load(image.width, image.height, image.component, image.bits, &image.image.at(0));
-        if (!_uniforms.addTexture(name, texture)) {
-            delete texture;
-        }
+        _uniforms.addTexture(name, image.image, false, _verbose);
         mat.addDefine("MATERIAL_NORMALMAP", name);
 
         if (_material.normalTexture.scale != 1.0)
@@ -422,48 +409,69 @@ bool loadGLTF(Uniforms& _uniforms, WatchFileList& _files, Materials& _materials,
 unsigned char* loadPixels(unsigned char const *_data, int len, int *_width, int *_height, Channels _channels, bool _vFlip) {
     int comp;
     unsigned char* pixels = stbi_load_from_memory(_data, len, _width, _height, &comp, (_channels == RGB)? STBI_rgb : STBI_rgb_alpha);
+    if (pixels && _vFlip)
+        flipPixelsVertically(pixels, *_width, *_height, (_channels == RGB)? 3 : 4);
     return pixels;
 } 
 
 unsigned char* loadPixels(const std::string& _path, int *_width, int *_height, Channels _channels, bool _vFlip) {
-    stbi_set_flip_vertically_on_load(_vFlip);
     int comp;
     unsigned char* pixels = stbi_load(_path.c_str(), _width, _height, &comp, (_channels == RGB)? STBI_rgb : STBI_rgb_alpha);
+    if (pixels && _vFlip)
+        flipPixelsVertically(pixels, *_width, *_height, (_channels == RGB)? 3 : 4);
     return pixels;
 }
 
 uint16_t* loadPixels16(const std::string& _path, int *_width, int *_height, Channels _channels, bool _vFlip) {
-    stbi_set_flip_vertically_on_load(_vFlip);
     int comp;
     uint16_t *pixels = stbi_load_16(_path.c_str(), _width, _height, &comp, _channels);
+    if (pixels && _vFlip)
+        flipPixelsVertically(pixels, *_width, *_height, (int)_channels);
     return pixels;
 }
 
 float* loadPixelsHDR(const std::string& _path, int *_width, int *_height, bool _vFlip) {
-    stbi_set_flip_vertically_on_load(_vFlip);
     int comp;
     float* pixels = stbi_loadf(_path.c_str(), _width, _height, &comp, 0);
+    if (pixels && _vFlip)
+        flipPixelsVertically(pixels, *_width, *_height, comp);
     return pixels;
 }
 
-bool savePixels(const std::string& _path, unsigned char* _pixels, int _width, int _height) {
+bool loadImage(unsigned char const *_data, int _len, bool _vFlip, DecodedImage* _image) {
+    int comp;
+    _image->channels = 4;
+    _image->bits = 8;
+    if (stbi_is_16_bit_from_memory(_data, _len)) {
+        _image->pixels = stbi_load_16_from_memory(_data, _len, &_image->width, &_image->height, &comp, STBI_rgb_alpha);
+        _image->bits = 16;
+        if (_image->pixels && _vFlip)
+            flipPixelsVertically((uint16_t*)_image->pixels, _image->width, _image->height, 4);
+    }
+    else
+        _image->pixels = loadPixels(_data, _len, &_image->width, &_image->height, RGB_ALPHA, _vFlip);
+
+    return _image->pixels != nullptr;
+}
+
+bool savePixelsSTB(const std::string& _path, const unsigned char* _pixels, int _width, int _height, const PixelsOptions& _options) {
     int saved = 0;
     int channels = 4;
-    std::string ext = getExt(_path);
+    std::string format = getPixelsFormat(_path, _options);
 
-    // Flip the image on Y
-    flipPixelsVertically<unsigned char>(_pixels, _width, _height, channels);
+    // Rows come bottom-up, let stb flip them while writing instead of flipping the buffer
+    stbi_flip_vertically_on_write(1);
 
-    if ( ext == "png") 
+    if ( format == "png") 
         saved = stbi_write_png(_path.c_str(), _width, _height, channels, _pixels, _width * channels);
-    else if ( ext == "jpg")
-        saved = stbi_write_jpg(_path.c_str(), _width, _height, channels, _pixels, 92);
-    else if ( ext == "bmp")
+    else if ( format == "jpg")
+        saved = stbi_write_jpg(_path.c_str(), _width, _height, channels, _pixels, (_options.level > 0) ? _options.level : 92);
+    else if ( format == "bmp")
         saved = stbi_write_bmp(_path.c_str(), _width, _height, channels, _pixels);
-    else if ( ext == "tga")
+    else if ( format == "tga")
         saved = stbi_write_tga(_path.c_str(), _width, _height, channels, _pixels);
-    else if ( ext == "hdr") {
-        size_t total = _width * _height * channels;
+    else if ( format == "hdr") {
+        size_t total = (size_t)_width * _height * channels;
         const float m = 1.f / 255.f;
         float *float_pixels = new float[total];
         for (size_t i = 0; i < total; i++)
@@ -484,8 +492,8 @@ bool savePixels16(const std::string& _path, unsigned short* _pixels, int _width,
     int channels = 4;
     std::string ext = getExt(_path);
 
-    // Flip the image on Y
-    flipPixelsVertically<unsigned short>(_pixels, _width, _height, channels);
+    // Rows come bottom-up, let stb flip them while writing instead of flipping the buffer
+    stbi_flip_vertically_on_write(1);
 
     if ( ext == "png") 
         saved = stbi_write_png(_path.c_str(), _width, _height, channels, _pixels, _width * channels);
@@ -512,11 +520,11 @@ bool savePixels16(const std::string& _path, unsigned short* _pixels, int _width,
     return true;
 }
 
-bool savePixelsHDR(const std::string& _path, float* _pixels, int _width, int _height) {
+bool savePixelsSTBHDR(const std::string& _path, const float* _pixels, int _width, int _height) {
     int channels = 4;
 
-    // Flip the image on Y
-    flipPixelsVertically<float>(_pixels, _width, _height, channels);
+    // Rows come bottom-up, let stb flip them while writing instead of flipping the buffer
+    stbi_flip_vertically_on_write(1);
     
     if (0 == stbi_write_hdr(_path.c_str(), _width, _height, channels, _pixels)) {
         std::cout << "Can't create file " << _path << std::endl;
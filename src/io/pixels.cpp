@@ -0,0 +1,730 @@
+#include "pixels.h"
+
+#include <iostream>
+#include <cstdio>
+#include <cctype>
+#include <algorithm>
+#include <vector>
+#include <map>
+#include <mutex>
+
+#include "fs.h"
+#include "../tools/text.h"
+
+// Implemented on gltf.cpp together with the rest of stb_image_write (which doesn't expose it on its header)
+extern "C" unsigned char* stbi_zlib_compress(unsigned char *data, int data_len, int *out_len, int quality);
+
+// PNG
+// ---------------------------------------------------------------------------
+//  Written here (instead of through stbi_write_png) so the compression level and
+//  row filter can be chosen per image without touching stb's global settings,
+//  which are shared by all the saving threads.
+
+static unsigned int png_crc32(unsigned int _crc, const unsigned char* _data, size_t _size) {
+    struct Table {
+        unsigned int v[256];
+        Table() {
+            for (unsigned int n = 0; n < 256; n++) {
+                unsigned int c = n;
+                for (int k = 0; k < 8; k++)
+                    c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+                v[n] = c;
+            }
+        }
+    };
+    static const Table table;
+
+    _crc = ~_crc;
+    for (size_t i = 0; i < _size; i++)
+        _crc = table.v[(_crc ^ _data[i]) & 0xff] ^ (_crc >> 8);
+    return ~_crc;
+}
+
+static void png_put32(unsigned char* _dst, unsigned int _v) {
+    _dst[0] = (_v >> 24) & 0xff;
+    _dst[1] = (_v >> 16) & 0xff;
+    _dst[2] = (_v >> 8) & 0xff;
+    _dst[3] = _v & 0xff;
+}
+
+static bool png_chunk(FILE* _file, const char* _tag, const unsigned char* _data, size_t _size) {
+    unsigned char head[8];
+    png_put32(head, (unsigned int)_size);
+    std::memcpy(head + 4, _tag, 4);
+
+    unsigned int crc = png_crc32(0, head + 4, 4);
+    crc = png_crc32(crc, _data, _size);
+
+    unsigned char tail[4];
+    png_put32(tail, crc);
+
+    return  fwrite(head, 1, 8, _file) == 8 &&
+            (_size == 0 || fwrite(_data, 1, _size, _file) == _size) &&
+            fwrite(tail, 1, 4, _file) == 4;
+}
+
+static unsigned char png_paeth(int _a, int _b, int _c) {
+    int p = _a + _b - _c;
+    int pa = abs(p - _a);
+    int pb = abs(p - _b);
+    int pc = abs(p - _c);
+    if (pa <= pb && pa <= pc) return _a;
+    if (pb <= pc) return _b;
+    return _c;
+}
+
+// Filter one row of RGBA pixels. _prev is the row above it on the image (NULL for the first one)
+static void png_filter(int _type, const unsigned char* _row, const unsigned char* _prev, size_t _stride, unsigned char* _dst) {
+    const int bpp = 4;
+    for (size_t i = 0; i < _stride; i++) {
+        int a = (i >= bpp) ? _row[i - bpp] : 0;
+        int b = _prev ? _prev[i] : 0;
+        int c = (_prev && i >= bpp) ? _prev[i - bpp] : 0;
+        switch (_type) {
+            case 1: _dst[i] = _row[i] - a; break;
+            case 2: _dst[i] = _row[i] - b; break;
+            case 3: _dst[i] = _row[i] - ((a + b) >> 1); break;
+            case 4: _dst[i] = _row[i] - png_paeth(a, b, c); break;
+            default: _dst[i] = _row[i]; break;
+        }
+    }
+}
+
+// Writes the filter type byte followed by the filtered row. A negative _filter picks the one with
+// the lowest sum of absolute differences (same heuristic as stb and libpng), _candidate is scratch space
+static void png_filter_row(int _filter, const unsigned char* _row, const unsigned char* _prev, size_t _stride, unsigned char* _candidate, unsigned char* _dst) {
+    if (_filter >= 0) {
+        _dst[0] = (unsigned char)_filter;
+        png_filter(_filter, _row, _prev, _stride, _dst + 1);
+        return;
+    }
+
+    long best_sum = -1;
+    for (int type = 0; type < 5; type++) {
+        png_filter(type, _row, _prev, _stride, _candidate);
+        long sum = 0;
+        for (size_t i = 0; i < _stride; i++)
+            sum += abs((signed char)_candidate[i]);
+        if (best_sum < 0 || sum < best_sum) {
+            best_sum = sum;
+            _dst[0] = (unsigned char)type;
+            std::memcpy(_dst + 1, _candidate, _stride);
+        }
+    }
+}
+
+static bool png_begin(FILE* _file, int _width, int _height) {
+    static const unsigned char signature[8] = { 137, 80, 78, 71, 13, 10, 26, 10 };
+    unsigned char ihdr[13];
+    png_put32(ihdr, _width);
+    png_put32(ihdr + 4, _height);
+    ihdr[8] = 8;    // bits per channel
+    ihdr[9] = 6;    // RGBA
+    ihdr[10] = ihdr[11] = ihdr[12] = 0;
+
+    return  fwrite(signature, 1, 8, _file) == 8 &&
+            png_chunk(_file, "IHDR", ihdr, 13);
+}
+
+// Uncompressed PNG made of stored deflate blocks, written out as rows are filtered
+// so only a few of them are in memory at once
+class PngWriter : public PixelsWriter {
+protected:
+    bool _begin() {
+        // Without compression there is nothing to gain from filtering
+        m_filter = m_options.filter;
+        if (m_filter < 0 || m_filter > 4)
+            m_filter = 0;
+
+        size_t stride = (size_t)m_width * 4;
+        m_prev.resize(stride);
+        m_line.resize(stride + 1);
+        m_idat.clear();
+        m_idat.reserve(1 << 18);
+        m_idat.push_back(0x78);
+        m_idat.push_back(0x01);
+        m_s1 = 1;
+        m_s2 = 0;
+
+        return png_begin(m_file, m_width, m_height);
+    }
+
+    bool _addRow(const unsigned char* _row) {
+        png_filter_row(m_filter, _row, (m_rows > 0) ? m_prev.data() : NULL, m_prev.size(), NULL, m_line.data());
+        if (m_filter > 1)
+            std::memcpy(m_prev.data(), _row, m_prev.size());
+
+        // adler32, taking the modulo only every 5552 bytes (the most that can't overflow)
+        for (size_t i = 0; i < m_line.size(); ) {
+            size_t end = std::min(m_line.size(), i + 5552);
+            for (; i < end; i++) {
+                m_s1 += m_line[i];
+                m_s2 += m_s1;
+            }
+            m_s1 %= 65521;
+            m_s2 %= 65521;
+        }
+
+        for (size_t offset = 0; offset < m_line.size(); offset += 65535) {
+            size_t len = std::min(m_line.size() - offset, (size_t)65535);
+            m_idat.push_back(0x00);
+            m_idat.push_back(len & 0xff);
+            m_idat.push_back((len >> 8) & 0xff);
+            m_idat.push_back(~len & 0xff);
+            m_idat.push_back((~len >> 8) & 0xff);
+            m_idat.insert(m_idat.end(), m_line.begin() + offset, m_line.begin() + offset + len);
+        }
+
+        if (m_idat.size() >= (1 << 18)) {
+            bool ok = png_chunk(m_file, "IDAT", m_idat.data(), m_idat.size());
+            m_idat.clear();
+            return ok;
+        }
+        return true;
+    }
+
+    bool _end() {
+        // Last (empty) block and the adler32 checksum
+        const unsigned char last[5] = { 0x01, 0x00, 0x00, 0xff, 0xff };
+        m_idat.insert(m_idat.end(), last, last + 5);
+        unsigned char adler[4];
+        png_put32(adler, (m_s2 << 16) | m_s1);
+        m_idat.insert(m_idat.end(), adler, adler + 4);
+
+        bool ok =   png_chunk(m_file, "IDAT", m_idat.data(), m_idat.size()) &&
+                    png_chunk(m_file, "IEND", NULL, 0);
+        m_idat = std::vector<unsigned char>();
+        return ok;
+    }
+
+    std::vector<unsigned char>  m_prev;
+    std::vector<unsigned char>  m_line;
+    std::vector<unsigned char>  m_idat;
+    unsigned int                m_s1 = 1;
+    unsigned int                m_s2 = 0;
+    int                         m_filter = 0;
+};
+
+// QOI (https://qoiformat.org)
+// ---------------------------------------------------------------------------
+
+class QoiWriter : public PixelsWriter {
+protected:
+    bool _begin() {
+        std::memset(m_index, 0, sizeof(m_index));
+        m_prev[0] = m_prev[1] = m_prev[2] = 0;
+        m_prev[3] = 255;
+        m_run = 0;
+
+        // Each row is encoded into a small buffer (5 bytes per pixel at worst) and written at once
+        size_t stride = (size_t)m_width * 4;
+        m_out.resize(stride + stride / 4 + 1);
+
+        unsigned char header[14] = { 'q', 'o', 'i', 'f' };
+        png_put32(header + 4, m_width);
+        png_put32(header + 8, m_height);
+        header[12] = 4; // RGBA
+        header[13] = 0; // sRGB with linear alpha
+        return fwrite(header, 1, 14, m_file) == 14;
+    }
+
+    bool _addRow(const unsigned char* _row) {
+        const unsigned char* px = _row;
+        size_t n = 0;
+
+        for (int x = 0; x < m_width; x++, px += 4) {
+            if (std::memcmp(px, m_prev, 4) == 0) {
+                m_run++;
+                if (m_run == 62) {
+                    m_out[n++] = 0xc0 | (m_run - 1);
+                    m_run = 0;
+                }
+                continue;
+            }
+
+            if (m_run > 0) {
+                m_out[n++] = 0xc0 | (m_run - 1);
+                m_run = 0;
+            }
+
+            int hash = (px[0] * 3 + px[1] * 5 + px[2] * 7 + px[3] * 11) % 64;
+            if (std::memcmp(m_index[hash], px, 4) == 0) {
+                m_out[n++] = hash;
+            }
+            else {
+                std::memcpy(m_index[hash], px, 4);
+
+                if (px[3] == m_prev[3]) {
+                    signed char vr = px[0] - m_prev[0];
+                    signed char vg = px[1] - m_prev[1];
+                    signed char vb = px[2] - m_prev[2];
+                    signed char vg_r = vr - vg;
+                    signed char vg_b = vb - vg;
+
+                    if (vr > -3 && vr < 2 && vg > -3 && vg < 2 && vb > -3 && vb < 2) {
+                        m_out[n++] = 0x40 | (vr + 2) << 4 | (vg + 2) << 2 | (vb + 2);
+                    }
+                    else if (vg_r > -9 && vg_r < 8 && vg > -33 && vg < 32 && vg_b > -9 && vg_b < 8) {
+                        m_out[n++] = 0x80 | (vg + 32);
+                        m_out[n++] = (vg_r + 8) << 4 | (vg_b + 8);
+                    }
+                    else {
+                        m_out[n++] = 0xfe;
+                        m_out[n++] = px[0];
+                        m_out[n++] = px[1];
+                        m_out[n++] = px[2];
+                    }
+                }
+                else {
+                    m_out[n++] = 0xff;
+                    std::memcpy(&m_out[n], px, 4);
+                    n += 4;
+                }
+            }
+            std::memcpy(m_prev, px, 4);
+        }
+
+        return fwrite(m_out.data(), 1, n, m_file) == n;
+    }
+
+    bool _end() {
+        if (m_run > 0) {
+            unsigned char op = 0xc0 | (m_run - 1);
+            if (fwrite(&op, 1, 1, m_file) != 1)
+                return false;
+        }
+        const unsigned char end[8] = { 0, 0, 0, 0, 0, 0, 0, 1 };
+        return fwrite(end, 1, 8, m_file) == 8;
+    }
+
+    std::vector<unsigned char>  m_out;
+    unsigned char               m_index[64][4];
+    unsigned char               m_prev[4];
+    int                         m_run = 0;
+};
+
+// TGA
+// ---------------------------------------------------------------------------
+
+// Uncompressed true-color with the origin at the bottom left, so rows go in the same order they come from GL
+class TgaWriter : public PixelsWriter {
+public:
+    bool isBottomUp() const { return true; }
+
+protected:
+    bool _begin() {
+        if (m_width > 0xffff || m_height > 0xffff) {
+            std::cout << "TGA images can't be bigger than 65535x65535" << std::endl;
+            return false;
+        }
+
+        m_row.resize((size_t)m_width * 4);
+
+        unsigned char header[18] = { 0 };
+        header[2] = 2;
+        header[12] = m_width & 0xff;
+        header[13] = (m_width >> 8) & 0xff;
+        header[14] = m_height & 0xff;
+        header[15] = (m_height >> 8) & 0xff;
+        header[16] = 32;
+        header[17] = 8;
+        return fwrite(header, 1, 18, m_file) == 18;
+    }
+
+    bool _addRow(const unsigned char* _row) {
+        for (size_t i = 0; i < m_row.size(); i += 4) {
+            m_row[i] = _row[i + 2];
+            m_row[i + 1] = _row[i + 1];
+            m_row[i + 2] = _row[i];
+            m_row[i + 3] = _row[i + 3];
+        }
+        return fwrite(m_row.data(), 1, m_row.size(), m_file) == m_row.size();
+    }
+
+    std::vector<unsigned char>  m_row;
+};
+
+// PPM / PFM
+// ---------------------------------------------------------------------------
+
+class PpmWriter : public PixelsWriter {
+protected:
+    bool _begin() {
+        m_row.resize((size_t)m_width * 3);
+        return fprintf(m_file, "P6\n%d %d\n255\n", m_width, m_height) > 0;
+    }
+
+    bool _addRow(const unsigned char* _row) {
+        for (int x = 0; x < m_width; x++) {
+            m_row[x * 3] = _row[x * 4];
+            m_row[x * 3 + 1] = _row[x * 4 + 1];
+            m_row[x * 3 + 2] = _row[x * 4 + 2];
+        }
+        return fwrite(m_row.data(), 1, m_row.size(), m_file) == m_row.size();
+    }
+
+    std::vector<unsigned char>  m_row;
+};
+
+static bool pfm_begin(FILE* _file, int _width, int _height) {
+    // A negative scale means little endian
+    const unsigned int one = 1;
+    bool little_endian = *(const unsigned char*)&one == 1;
+    return fprintf(_file, "PF\n%d %d\n%s\n", _width, _height, little_endian ? "-1.0" : "1.0") > 0;
+}
+
+template<typename T>
+static bool pfm_row(FILE* _file, const T* _src, int _width, float _scale, std::vector<float>& _row) {
+    _row.resize((size_t)_width * 3);
+    for (int x = 0; x < _width; x++) {
+        _row[x * 3] = _src[x * 4] * _scale;
+        _row[x * 3 + 1] = _src[x * 4 + 1] * _scale;
+        _row[x * 3 + 2] = _src[x * 4 + 2] * _scale;
+    }
+    return fwrite(_row.data(), sizeof(float), _row.size(), _file) == _row.size();
+}
+
+// PFM rows go bottom to top, just like the pixels come from GL
+class PfmWriter : public PixelsWriter {
+public:
+    bool isBottomUp() const { return true; }
+
+protected:
+    bool _begin() { return pfm_begin(m_file, m_width, m_height); }
+    bool _addRow(const unsigned char* _row) { return pfm_row<unsigned char>(m_file, _row, m_width, 1.0f / 255.0f, m_row); }
+
+    std::vector<float>  m_row;
+};
+
+static bool savePFMHDR(const std::string& _path, const float* _pixels, int _width, int _height) {
+    FILE* file = fopen(_path.c_str(), "wb");
+    if (!file) {
+        std::cout << "Can't create file " << _path << std::endl;
+        return false;
+    }
+
+    std::vector<float> row;
+    bool ok = pfm_begin(file, _width, _height);
+    for (int y = 0; y < _height && ok; y++)
+        ok = pfm_row<float>(file, _pixels + (size_t)y * _width * 4, _width, 1.0f, row);
+    fclose(file);
+
+    if (!ok)
+        std::cout << "Can't write file " << _path << std::endl;
+    return ok;
+}
+
+// WHOLE IMAGE ENCODERS
+// ---------------------------------------------------------------------------
+
+static bool writePixels(PixelsWriter& _writer, const std::string& _path, const unsigned char* _pixels, int _width, int _height, const PixelsOptions& _options) {
+    if (!_writer.open(_path, _width, _height, _options))
+        return false;
+    _writer.addRows(_pixels, _height);
+    return _writer.close();
+}
+
+static bool savePNG(const std::string& _path, const unsigned char* _pixels, int _width, int _height, const PixelsOptions& _options) {
+    int level = (_options.level < 0) ? 6 : std::min(_options.level, 9);
+    if (level == 0) {
+        PngWriter writer;
+        return writePixels(writer, _path, _pixels, _width, _height, _options);
+    }
+
+    FILE* file = fopen(_path.c_str(), "wb");
+    if (!file) {
+        std::cout << "Can't create file " << _path << std::endl;
+        return false;
+    }
+
+    const size_t stride = (size_t)_width * 4;
+    int filter = (_options.filter > 4) ? 0 : _options.filter;
+
+    // The buffer is bottom-up, so the row above on the image is the next one in memory
+    std::vector<unsigned char> candidate(stride);
+    std::vector<unsigned char> filtered((stride + 1) * _height);
+    for (int y = 0; y < _height; y++) {
+        const unsigned char* row = _pixels + (size_t)(_height - 1 - y) * stride;
+        png_filter_row(filter, row, (y > 0) ? row + stride : NULL, stride, candidate.data(), &filtered[y * (stride + 1)]);
+    }
+
+    // stb's deflate doesn't have zlib levels, it's quality is how many matches
+    // it looks at per position (5 at least, 8 by default). Level 6, zlib's default,
+    // gets stb's and the ones above it look further (up to 20)
+    int quality = (level <= 6) ? 5 + ((level - 1) * 3) / 5 : 8 + (level - 6) * 4;
+    int zlen = 0;
+    unsigned char* zlib = stbi_zlib_compress(filtered.data(), (int)filtered.size(), &zlen, quality);
+
+    bool ok =   zlib &&
+                png_begin(file, _width, _height) &&
+                png_chunk(file, "IDAT", zlib, zlen) &&
+                png_chunk(file, "IEND", NULL, 0);
+    if (zlib)
+        free(zlib);
+    fclose(file);
+
+    if (!ok)
+        std::cout << "Can't write file " << _path << std::endl;
+    return ok;
+}
+
+static bool saveQOI(const std::string& _path, const unsigned char* _pixels, int _width, int _height, const PixelsOptions& _options) {
+    QoiWriter writer;
+    return writePixels(writer, _path, _pixels, _width, _height, _options);
+}
+
+static bool saveTGA(const std::string& _path, const unsigned char* _pixels, int _width, int _height, const PixelsOptions& _options) {
+    // Anything but level 0 goes to stb, which compress it with RLE
+    if (_options.level != 0)
+        return savePixelsSTB(_path, _pixels, _width, _height, _options);
+
+    TgaWriter writer;
+    return writePixels(writer, _path, _pixels, _width, _height, _options);
+}
+
+static bool savePPM(const std::string& _path, const unsigned char* _pixels, int _width, int _height, const PixelsOptions& _options) {
+    PpmWriter writer;
+    return writePixels(writer, _path, _pixels, _width, _height, _options);
+}
+
+static bool savePFM8(const std::string& _path, const unsigned char* _pixels, int _width, int _height, const PixelsOptions& _options) {
+    PfmWriter writer;
+    return writePixels(writer, _path, _pixels, _width, _height, _options);
+}
+
+// BUFFERS
+// ---------------------------------------------------------------------------
+
+// Enough for the read back ring and the frames queued on the savers
+#define PIXELS_BUFFERS_MAX 8
+
+static std::mutex buffers_mutex;
+static std::vector< std::unique_ptr<unsigned char[]> > buffers;
+static size_t buffers_bytes = 0;
+
+std::unique_ptr<unsigned char[]> takePixelsBuffer(size_t _bytes) {
+    {
+        std::lock_guard<std::mutex> lock(buffers_mutex);
+
+        // Only the last size is kept (ex: the window got resized)
+        if (_bytes != buffers_bytes) {
+            buffers.clear();
+            buffers_bytes = _bytes;
+        }
+        else if (!buffers.empty()) {
+            std::unique_ptr<unsigned char[]> pixels = std::move(buffers.back());
+            buffers.pop_back();
+            return pixels;
+        }
+    }
+    return std::unique_ptr<unsigned char[]>(new unsigned char[_bytes]);
+}
+
+void recyclePixelsBuffer(std::unique_ptr<unsigned char[]>&& _pixels, size_t _bytes) {
+    if (!_pixels)
+        return;
+
+    std::lock_guard<std::mutex> lock(buffers_mutex);
+    if (_bytes == buffers_bytes && buffers.size() < PIXELS_BUFFERS_MAX)
+        buffers.push_back(std::move(_pixels));
+    else
+        _pixels.reset();
+}
+
+void clearPixelsBuffers() {
+    std::lock_guard<std::mutex> lock(buffers_mutex);
+    buffers.clear();
+}
+
+// REGISTRY
+// ---------------------------------------------------------------------------
+
+static std::mutex encoders_mutex;
+static std::map<std::string, PixelsEncoder>& encoders() {
+    static std::map<std::string, PixelsEncoder> list = {
+        { "png", savePNG },
+        { "qoi", saveQOI },
+        { "tga", saveTGA },
+        { "ppm", savePPM },
+        { "pfm", savePFM8 },
+        { "jpg", savePixelsSTB },
+        { "jpeg", savePixelsSTB },
+        { "bmp", savePixelsSTB },
+        { "hdr", savePixelsSTB }
+    };
+    return list;
+}
+
+void addPixelsEncoder(const std::string& _format, PixelsEncoder _encoder) {
+    std::lock_guard<std::mutex> lock(encoders_mutex);
+    encoders()[_format] = _encoder;
+}
+
+PixelsEncoder getPixelsEncoder(const std::string& _format) {
+    std::lock_guard<std::mutex> lock(encoders_mutex);
+    std::map<std::string, PixelsEncoder>::iterator it = encoders().find(_format);
+    if (it != encoders().end())
+        return it->second;
+    return nullptr;
+}
+
+std::string getPixelsFormat(const std::string& _path, const PixelsOptions& _options) {
+    std::string format = (_options.format != "") ? _options.format : getExt(_path);
+    std::transform(format.begin(), format.end(), format.begin(), ::tolower);
+    if (format == "jpeg")
+        format = "jpg";
+    return format;
+}
+
+bool parsePixelsOptions(const std::string& _spec, PixelsOptions* _options) {
+    std::vector<std::string> values = split(_spec, ':');
+    if (values.size() == 0 || values.size() > 3 || getPixelsEncoder(values[0]) == nullptr)
+        return false;
+
+    _options->format = values[0];
+    _options->level = (values.size() > 1) ? toInt(values[1]) : -1;
+    _options->filter = (values.size() > 2) ? toInt(values[2]) : -1;
+    return true;
+}
+
+bool savePixels(const std::string& _path, const unsigned char* _pixels, int _width, int _height, const PixelsOptions& _options) {
+    PixelsEncoder encoder = getPixelsEncoder(getPixelsFormat(_path, _options));
+    if (encoder == nullptr) {
+        std::cout << "Don't know how to encode " << _path << std::endl;
+        return false;
+    }
+    return encoder(_path, _pixels, _width, _height, _options);
+}
+
+bool savePixelsHDR(const std::string& _path, const float* _pixels, int _width, int _height, const PixelsOptions& _options) {
+    if (getPixelsFormat(_path, _options) == "pfm")
+        return savePFMHDR(_path, _pixels, _width, _height);
+    return savePixelsSTBHDR(_path, _pixels, _width, _height);
+}
+
+bool loadImage(const std::string& _path, bool _vFlip, DecodedImage* _image) {
+    std::string ext = getExt(_path);
+
+    // BMP non-1bpp, non-RLE
+    // GIF (*comp always reports as 4-channel)
+    // JPEG baseline & progressive (12 bpc/arithmetic not supported, same as stock IJG lib)
+    if (ext == "bmp"    || ext == "BMP" ||
+        ext == "gif"    || ext == "GIF" ||
+        ext == "jpg"    || ext == "JPG" ||
+        ext == "jpeg"   || ext == "JPEG" ) {
+        _image->pixels = loadPixels(_path, &_image->width, &_image->height, RGB_ALPHA, _vFlip);
+        _image->channels = 4;
+        _image->bits = 8;
+    }
+
+    // PNG 1/2/4/8/16-bit-per-channel
+    // TGA (not sure what subset, if a subset)
+    // PSD (composited view only, no extra channels, 8/16 bit-per-channel)
+    else if (   ext == "png" || ext == "PNG" ||
+                ext == "psd" || ext == "PSD" ||
+                ext == "tga" || ext == "TGA") {
+#ifdef PLATFORM_RPI
+        // If we are in a Raspberry Pi don't take the risk of loading a 16bit image
+        _image->pixels = loadPixels(_path, &_image->width, &_image->height, RGB_ALPHA, _vFlip);
+        _image->bits = 8;
+#else
+        _image->pixels = loadPixels16(_path, &_image->width, &_image->height, RGB_ALPHA, _vFlip);
+        _image->bits = 16;
+#endif
+        _image->channels = 4;
+    }
+
+    // HDR (radiance rgbE format)
+    else if (ext == "hdr" || ext == "HDR") {
+        _image->pixels = loadPixelsHDR(_path, &_image->width, &_image->height, _vFlip);
+        _image->channels = 3;
+        _image->bits = 32;
+    }
+
+    return _image->pixels != nullptr;
+}
+
+// STRIP WRITERS
+// ---------------------------------------------------------------------------
+
+PixelsWriter::PixelsWriter():
+    m_path(""), m_file(nullptr), m_width(0), m_height(0), m_rows(0), m_ok(false) {
+}
+
+PixelsWriter::~PixelsWriter() {
+    // The subclass is already gone, so an unfinished image is left as it is
+    if (m_file)
+        fclose(m_file);
+}
+
+bool PixelsWriter::open(const std::string& _path, int _width, int _height, const PixelsOptions& _options) {
+    close();
+
+    m_file = fopen(_path.c_str(), "wb");
+    if (!m_file) {
+        std::cout << "Can't create file " << _path << std::endl;
+        return false;
+    }
+
+    m_path = _path;
+    m_options = _options;
+    m_width = _width;
+    m_height = _height;
+    m_rows = 0;
+    m_ok = _begin();
+
+    if (!m_ok) {
+        std::cout << "Can't write file " << _path << std::endl;
+        fclose(m_file);
+        m_file = nullptr;
+    }
+    return m_ok;
+}
+
+bool PixelsWriter::addRows(const unsigned char* _pixels, int _rows) {
+    if (!m_file || !m_ok)
+        return false;
+
+    if (m_rows + _rows > m_height) {
+        std::cout << "Too many rows for the " << m_width << "x" << m_height << " image " << m_path << std::endl;
+        m_ok = false;
+        return false;
+    }
+
+    // The strip is bottom-up, top-down formats take its last row first
+    const size_t stride = (size_t)m_width * 4;
+    for (int i = 0; i < _rows && m_ok; i++) {
+        int row = isBottomUp() ? i : _rows - 1 - i;
+        m_ok = _addRow(_pixels + (size_t)row * stride);
+        m_rows++;
+    }
+    return m_ok;
+}
+
+bool PixelsWriter::close() {
+    if (!m_file)
+        return false;
+
+    m_ok = m_ok && m_rows == m_height && _end();
+    fclose(m_file);
+    m_file = nullptr;
+
+    if (!m_ok)
+        std::cout << "Can't write file " << m_path << std::endl;
+    return m_ok;
+}
+
+std::unique_ptr<PixelsWriter> createPixelsWriter(const std::string& _path, const PixelsOptions& _options) {
+    std::string format = getPixelsFormat(_path, _options);
+    if (format == "png" && _options.level == 0)
+        return std::unique_ptr<PixelsWriter>(new PngWriter());
+    else if (format == "qoi")
+        return std::unique_ptr<PixelsWriter>(new QoiWriter());
+    else if (format == "tga" && _options.level == 0)
+        return std::unique_ptr<PixelsWriter>(new TgaWriter());
+    else if (format == "ppm")
+        return std::unique_ptr<PixelsWriter>(new PpmWriter());
+    else if (format == "pfm")
+        return std::unique_ptr<PixelsWriter>(new PfmWriter());
+    return nullptr;
+}
@@ -1,8 +1,10 @@
 #pragma once
 
 #include <stdlib.h>
+#include <cstdio>
 #include <cstring>
 #include <string>
+#include <memory>
 
 enum Channels {
     LUMINANCE = 1,
@@ -11,17 +13,91 @@ enum Channels {
     RGB_ALPHA = 4
 };
 
-// Implementation of savePixels and loadPixels is on gltf.cpp because tiny_gltf.h also use stb_image*.h
-bool            savePixels(const std::string& _path, unsigned char* _pixels, int _width, int _height);
+// How savePixels() encodes an image. Negative values keep the defaults of each encoder
+struct PixelsOptions {
+    std::string format  = "";   // name of the encoder, by default the extension of the file
+    int         level   = -1;   // png: compression 0 (none) to 9, jpg: quality 1 to 100, tga: 0 for no RLE
+    int         filter  = -1;   // png: row filter 0 (none), 1 (sub), 2 (up), 3 (average) or 4 (paeth)
+};
+
+// Encoders take RGBA pixels with the rows bottom-up (the way glReadPixels returns them)
+// and write them as they are, without flipping or copying the buffer first
+typedef bool (*PixelsEncoder)(const std::string& _path, const unsigned char* _pixels, int _width, int _height, const PixelsOptions& _options);
+
+void            addPixelsEncoder(const std::string& _format, PixelsEncoder _encoder);
+PixelsEncoder   getPixelsEncoder(const std::string& _format);
+std::string     getPixelsFormat(const std::string& _path, const PixelsOptions& _options);
+
+// Parse "<format>[:<level>[:<filter>]]" (ex: "png:1" or "qoi")
+bool            parsePixelsOptions(const std::string& _spec, PixelsOptions* _options);
+
+// Writes an image a strip of rows at a time, for the ones too big to be held in memory at once.
+// Strips are RGBA pixels with their rows bottom-up (the way glReadPixels returns them) and have to be
+// handed from the top of the image down, or from the bottom up when isBottomUp() is true
+class PixelsWriter {
+public:
+    PixelsWriter();
+    virtual ~PixelsWriter();
+
+    bool            open(const std::string& _path, int _width, int _height, const PixelsOptions& _options = PixelsOptions());
+    bool            addRows(const unsigned char* _pixels, int _rows);
+    bool            close();
+
+    virtual bool    isBottomUp() const { return false; }
+
+protected:
+    // Called with the file already open. Rows come one by one in the order they go on the file
+    virtual bool    _begin() = 0;
+    virtual bool    _addRow(const unsigned char* _row) = 0;
+    virtual bool    _end() { return true; }
+
+    std::string     m_path;
+    PixelsOptions   m_options;
+    FILE*           m_file;
+    int             m_width;
+    int             m_height;
+    int             m_rows;
+    bool            m_ok;
+};
+
+// Returns nullptr for the formats that can't be written in strips (compressed png, jpg, bmp and hdr)
+std::unique_ptr<PixelsWriter> createPixelsWriter(const std::string& _path, const PixelsOptions& _options);
+
+bool            savePixels(const std::string& _path, const unsigned char* _pixels, int _width, int _height, const PixelsOptions& _options = PixelsOptions());
+
+// Buffers for the frames on their way to be saved. Give them back once saved so the next
+// frames of the same size reuse them instead of allocating their own
+std::unique_ptr<unsigned char[]> takePixelsBuffer(size_t _bytes);
+void            recyclePixelsBuffer(std::unique_ptr<unsigned char[]>&& _pixels, size_t _bytes);
+void            clearPixelsBuffers();
+bool            savePixelsHDR(const std::string& _path, const float* _pixels, int _width, int _height, const PixelsOptions& _options = PixelsOptions());
+
+// Implementation of the stb_image_write encoders (jpg, bmp, tga, hdr), savePixels16 and loadPixels is on gltf.cpp because tiny_gltf.h also use stb_image*.h
+bool            savePixelsSTB(const std::string& _path, const unsigned char* _pixels, int _width, int _height, const PixelsOptions& _options);
+bool            savePixelsSTBHDR(const std::string& _path, const float* _pixels, int _width, int _height);
 bool            savePixels16(const std::string& _path, unsigned short* _pixels, int _width, int _height);
-bool            savePixelsHDR(const std::string& _path, float* _pixels, int _width, int _height);
 
+// Loaders flip the rows themselves (stb's flag is global), so they can run on several threads at once
 unsigned char*  loadPixels(const std::string& _path, int *_width, int *_height, Channels _channels = RGB, bool _vFlip = true);
 uint16_t *      loadPixels16(const std::string& _path, int *_width, int *_height, Channels _channels = RGB, bool _vFlip = true);
 float*          loadPixelsHDR(const std::string& _path, int *_width, int *_height, bool _vFlip = true);
 unsigned char*  loadPixels(unsigned char const *_data, int len, int *_width, int *_height, Channels _channels, bool _vFlip);
 void            freePixels(void *pixels);
 
+// Image decoded by loadImage(), ready to go to Texture::load()
+struct DecodedImage {
+    void*   pixels      = nullptr;  // free them with freePixels()
+    int     width       = 0;
+    int     height      = 0;
+    int     channels    = 0;
+    int     bits        = 0;        // per channel, 32 are floats
+};
+
+// Decodes the files Texture::load() takes (picking the bits by extension) or
+// the encoded bytes of one (RGBA, 16 bits if the image has them)
+bool            loadImage(const std::string& _path, bool _vFlip, DecodedImage* _image);
+bool            loadImage(unsigned char const *_data, int _len, bool _vFlip, DecodedImage* _image);
+
 template<typename T>
 void rescalePixels(const T* _src, int _srcWidth, int _srcHeight, int _srcChannels, int _dstWidth, int _dstHeight, T* _dst) {
     int x, y, i, c;
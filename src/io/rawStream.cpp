@@ -0,0 +1,178 @@
+#include "rawStream.h"
+
+#include <iostream>
+#include <cmath>
+
+#ifndef PLATFORM_WINDOWS
+#include <unistd.h>
+#include <signal.h>
+#endif
+
+#include "fs.h"
+#include "pixels.h"
+
+// Max number of frames waiting to be written before addFrame() starts blocking the render loop
+#define MAX_QUEUED_FRAMES 4
+
+RawStream::RawStream():
+    m_path(""), m_file(nullptr), m_fps(60.0f), m_width(0), m_height(0), m_y4m(false),
+    m_queue_max(MAX_QUEUED_FRAMES), m_failed(false), m_closing(false), m_open(false) {
+}
+
+RawStream::~RawStream() {
+    close();
+}
+
+bool RawStream::open(const std::string& _path, float _fps) {
+    close();
+
+    if (_path == "-") {
+    #ifndef PLATFORM_WINDOWS
+        // Frames get the real stdout, everything else that gets printed is sent to stderr
+        fflush(stdout);
+        int fd = dup(STDOUT_FILENO);
+        if (fd != -1 && dup2(STDERR_FILENO, STDOUT_FILENO) != -1)
+            m_file = fdopen(fd, "wb");
+    #endif
+        m_y4m = true;
+    }
+    else {
+        m_file = fopen(_path.c_str(), "wb");
+        m_y4m = getExt(_path) == "y4m" || getExt(_path) == "Y4M";
+    }
+
+    if (!m_file) {
+        std::cout << "Could not open " << _path << " to stream frames" << std::endl;
+        return false;
+    }
+
+    #ifndef PLATFORM_WINDOWS
+    // When the reader goes away writes should fail instead of killing the process
+    signal(SIGPIPE, SIG_IGN);
+    #endif
+
+    m_path = _path;
+    m_fps = _fps;
+    m_width = 0;
+    m_height = 0;
+    m_failed = false;
+    m_closing = false;
+    m_open = true;
+    m_thread = std::thread(&RawStream::_run, this);
+
+    return true;
+}
+
+void RawStream::addFrame(std::unique_ptr<unsigned char[]>&& _pixels, int _width, int _height) {
+    if (!m_open || !_pixels)
+        return;
+
+    Frame frame;
+    frame.pixels = std::move(_pixels);
+    frame.width = _width;
+    frame.height = _height;
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_condition.wait(lock, [this]{ return m_queue.size() < m_queue_max; });
+    m_queue.push_back(std::move(frame));
+    lock.unlock();
+    m_condition.notify_all();
+}
+
+void RawStream::close() {
+    if (m_open) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_closing = true;
+        m_open = false;
+        lock.unlock();
+        m_condition.notify_all();
+    }
+
+    if (m_thread.joinable())
+        m_thread.join();
+
+    if (m_file) {
+        fclose(m_file);
+        m_file = nullptr;
+    }
+}
+
+void RawStream::_run() {
+    while (true) {
+        Frame frame;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_condition.wait(lock, [this]{ return !m_queue.empty() || m_closing; });
+            if (m_queue.empty())
+                break;
+            frame = std::move(m_queue.front());
+            m_queue.pop_front();
+        }
+        m_condition.notify_all();
+
+        // Once the reader is gone keep draining the queue so the render loop never blocks
+        if (m_failed)
+            continue;
+
+        // The stream can't change size on the way
+        if (m_width == 0 && m_height == 0) {
+            m_width = frame.width;
+            m_height = frame.height;
+
+            if (m_y4m) {
+                int fps_num = (int)std::round(m_fps.load() * 1000.0f);
+                fprintf(m_file, "YUV4MPEG2 W%d H%d F%d:1000 Ip A1:1 C444\n", m_width, m_height, fps_num);
+            }
+        }
+        else if (frame.width != m_width || frame.height != m_height) {
+            std::cout << "// Skipping a " << frame.width << "x" << frame.height << " frame on the " << m_width << "x" << m_height << " stream " << m_path << std::endl;
+            continue;
+        }
+
+        bool ok = m_y4m ? _writeY4M(frame) : _writeRGBA(frame);
+        if (!ok) {
+            std::cout << "// Could not write frames to " << m_path << ", stop streaming" << std::endl;
+            m_failed = true;
+        }
+        recyclePixelsBuffer(std::move(frame.pixels), (size_t)frame.width * frame.height * 4);
+    }
+
+    if (m_file)
+        fflush(m_file);
+}
+
+bool RawStream::_writeY4M(const Frame& _frame) {
+    // Convert to BT.601 (studio range) 4:4:4 planes, flipping vertically on the way
+    size_t plane = (size_t)_frame.width * _frame.height;
+    m_planes.resize(plane * 3);
+    unsigned char* y_plane = m_planes.data();
+    unsigned char* u_plane = y_plane + plane;
+    unsigned char* v_plane = u_plane + plane;
+
+    for (int row = 0; row < _frame.height; row++) {
+        const unsigned char* src = _frame.pixels.get() + (size_t)(_frame.height - 1 - row) * _frame.width * 4;
+        size_t dst = (size_t)row * _frame.width;
+        for (int x = 0; x < _frame.width; x++, src += 4, dst++) {
+            int r = src[0];
+            int g = src[1];
+            int b = src[2];
+            y_plane[dst] = (unsigned char)((( 66 * r + 129 * g +  25 * b + 128) >> 8) + 16);
+            u_plane[dst] = (unsigned char)(((-38 * r -  74 * g + 112 * b + 128) >> 8) + 128);
+            v_plane[dst] = (unsigned char)(((112 * r -  94 * g -  18 * b + 128) >> 8) + 128);
+        }
+    }
+
+    if (fputs("FRAME\n", m_file) < 0)
+        return false;
+    return fwrite(m_planes.data(), 1, m_planes.size(), m_file) == m_planes.size();
+}
+
+bool RawStream::_writeRGBA(const Frame& _frame) {
+    // Rows are written from the top one down, no need to flip them first
+    size_t stride = (size_t)_frame.width * 4;
+    for (int row = _frame.height - 1; row >= 0; row--) {
+        if (fwrite(_frame.pixels.get() + row * stride, 1, stride, m_file) != stride)
+            return false;
+    }
+    return true;
+}
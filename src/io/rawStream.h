@@ -0,0 +1,63 @@
+#pragma once
+
+#include <string>
+#include <memory>
+#include <deque>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+
+// Writes uncompressed frames to a file, a named pipe or stdout ("-") on its own thread.
+// Paths ending in .y4m (and stdout) get a YUV4MPEG2 (4:4:4) stream, anything else raw RGBA
+class RawStream {
+public:
+    RawStream();
+    virtual ~RawStream();
+
+    bool                open(const std::string& _path, float _fps);
+    bool                isOpen() const { return m_open; }
+    const std::string&  getPath() const { return m_path; }
+
+    // Frame rate announced on the Y4M header, it can change until the first frame is written
+    void                setFps(float _fps) { m_fps = _fps; }
+
+    // Takes RGBA8 pixels as they come from glReadPixels (bottom-up).
+    // Blocks when the reader on the other side falls too far behind
+    void                addFrame(std::unique_ptr<unsigned char[]>&& _pixels, int _width, int _height);
+
+    // Writes the queued frames and closes the stream
+    void                close();
+
+private:
+    struct Frame {
+        std::unique_ptr<unsigned char[]>    pixels;
+        int                                 width = 0;
+        int                                 height = 0;
+    };
+
+    void                _run();
+    bool                _writeY4M(const Frame& _frame);
+    bool                _writeRGBA(const Frame& _frame);
+
+    std::string         m_path;
+    FILE*               m_file;
+    std::atomic<float>  m_fps;
+    int                 m_width;
+    int                 m_height;
+    bool                m_y4m;
+
+    std::vector<unsigned char> m_planes;
+
+    std::deque<Frame>   m_queue;
+    size_t              m_queue_max;
+    std::mutex          m_mutex;
+    std::condition_variable m_condition;
+    std::thread         m_thread;
+
+    std::atomic<bool>   m_failed;
+    bool                m_closing;
+    bool                m_open;
+};
@@ -0,0 +1,305 @@
+#include "videoEncoder.h"
+
+#include <iostream>
+#include <cstring>
+
+#include "fs.h"
+#include "pixels.h"
+
+bool VideoEncoder::isVideo(const std::string& _path) {
+    std::string ext = getExt(_path);
+    return ext == "mkv" || ext == "mov" || ext == "mp4";
+}
+
+#ifdef SUPPORT_FOR_LIBAV
+
+extern "C" {
+#include <libavutil/opt.h>
+#include <libavutil/imgutils.h>
+}
+
+// Max number of frames waiting to be encoded before addFrame() starts blocking the render loop
+#define MAX_QUEUED_FRAMES 8
+
+// av_err2str returns a temporary array. This doesn't work in gcc.
+// This function can be used as a replacement for av_err2str.
+static const char* av_make_error(int errnum) {
+    static char str[AV_ERROR_MAX_STRING_SIZE];
+    memset(str, 0, sizeof(str));
+    return av_make_error_string(str, AV_ERROR_MAX_STRING_SIZE, errnum);
+}
+
+VideoEncoder::VideoEncoder():
+    m_path(""),
+    m_format_ctx(nullptr), m_codec_ctx(nullptr), m_stream(nullptr), m_frame(nullptr), m_packet(nullptr), m_sws_ctx(nullptr),
+    m_frame_count(0), m_queue_max(MAX_QUEUED_FRAMES), m_failed(false), m_closing(false), m_open(false) {
+}
+
+VideoEncoder::~VideoEncoder() {
+    close();
+    wait();
+}
+
+bool VideoEncoder::open(const std::string& _path, int _width, int _height, float _fps) {
+    // A previous video could still be finishing
+    close();
+    wait();
+
+    std::string ext = getExt(_path);
+    AVCodecID codec_id = AV_CODEC_ID_NONE;
+    if (ext == "mkv")
+        codec_id = AV_CODEC_ID_FFV1;
+    else if (ext == "mov")
+        codec_id = AV_CODEC_ID_QTRLE;
+    else if (ext == "mp4")
+        codec_id = AV_CODEC_ID_H264;
+    else {
+        std::cout << "Don't know how to encode " << _path << ". Use .mkv (FFV1), .mov (QTRLE) or .mp4 (H.264)" << std::endl;
+        return false;
+    }
+
+    const AVCodec* codec = avcodec_find_encoder(codec_id);
+    if (!codec) {
+        std::cout << "Could not find an encoder for " << avcodec_get_name(codec_id) << std::endl;
+        return false;
+    }
+
+    int ret = avformat_alloc_output_context2(&m_format_ctx, NULL, NULL, _path.c_str());
+    if (ret < 0) {
+        std::cout << "Could not create an output context for " << _path << ": " << av_make_error(ret) << std::endl;
+        _release();
+        return false;
+    }
+
+    m_stream = avformat_new_stream(m_format_ctx, NULL);
+    m_codec_ctx = avcodec_alloc_context3(codec);
+    if (!m_stream || !m_codec_ctx) {
+        std::cout << "Could not allocate the encoder for " << _path << std::endl;
+        _release();
+        return false;
+    }
+
+    AVRational framerate = av_d2q(_fps, 100000);
+    m_codec_ctx->width = _width;
+    m_codec_ctx->height = _height;
+    m_codec_ctx->time_base = av_inv_q(framerate);
+    m_codec_ctx->framerate = framerate;
+
+    if (codec_id == AV_CODEC_ID_H264) {
+        // 4:2:0 is what most players expect, but it needs even dimensions
+        m_codec_ctx->pix_fmt = AV_PIX_FMT_YUV420P;
+        m_codec_ctx->width &= ~1;
+        m_codec_ctx->height &= ~1;
+        av_opt_set(m_codec_ctx->priv_data, "crf", "18", 0);
+        av_opt_set(m_codec_ctx->priv_data, "preset", "fast", 0);
+    }
+    else {
+        // The lossless codecs keep the alpha channel
+        m_codec_ctx->pix_fmt = avcodec_find_best_pix_fmt_of_list(codec->pix_fmts, AV_PIX_FMT_RGBA, 1, NULL);
+    }
+
+    if (m_format_ctx->oformat->flags & AVFMT_GLOBALHEADER)
+        m_codec_ctx->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+
+    ret = avcodec_open2(m_codec_ctx, codec, NULL);
+    if (ret < 0) {
+        std::cout << "Could not open " << codec->name << " encoder: " << av_make_error(ret) << std::endl;
+        _release();
+        return false;
+    }
+
+    avcodec_parameters_from_context(m_stream->codecpar, m_codec_ctx);
+    m_stream->time_base = m_codec_ctx->time_base;
+
+    if (!(m_format_ctx->oformat->flags & AVFMT_NOFILE)) {
+        ret = avio_open(&m_format_ctx->pb, _path.c_str(), AVIO_FLAG_WRITE);
+        if (ret < 0) {
+            std::cout << "Could not open " << _path << ": " << av_make_error(ret) << std::endl;
+            _release();
+            return false;
+        }
+    }
+
+    ret = avformat_write_header(m_format_ctx, NULL);
+    if (ret < 0) {
+        std::cout << "Could not write the header of " << _path << ": " << av_make_error(ret) << std::endl;
+        _release();
+        return false;
+    }
+
+    // The destination frame is allocated once and reused, the RGBA pixels get converted straight into it
+    m_frame = av_frame_alloc();
+    m_packet = av_packet_alloc();
+    if (!m_frame || !m_packet) {
+        std::cout << "Could not allocate frames for " << _path << std::endl;
+        _release();
+        return false;
+    }
+    m_frame->format = m_codec_ctx->pix_fmt;
+    m_frame->width = m_codec_ctx->width;
+    m_frame->height = m_codec_ctx->height;
+    ret = av_frame_get_buffer(m_frame, 0);
+    if (ret < 0) {
+        std::cout << "Could not allocate frames for " << _path << ": " << av_make_error(ret) << std::endl;
+        _release();
+        return false;
+    }
+
+    m_path = _path;
+    m_frame_count = 0;
+    m_failed = false;
+    m_closing = false;
+    m_open = true;
+    m_thread = std::thread(&VideoEncoder::_run, this);
+
+    return true;
+}
+
+void VideoEncoder::addFrame(std::unique_ptr<unsigned char[]>&& _pixels, int _width, int _height) {
+    if (!m_open || !_pixels)
+        return;
+
+    Frame frame;
+    frame.pixels = std::move(_pixels);
+    frame.width = _width;
+    frame.height = _height;
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_condition.wait(lock, [this]{ return m_queue.size() < m_queue_max; });
+    m_queue.push_back(std::move(frame));
+    lock.unlock();
+    m_condition.notify_all();
+}
+
+void VideoEncoder::close() {
+    if (!m_open)
+        return;
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_closing = true;
+    m_open = false;
+    lock.unlock();
+    m_condition.notify_all();
+}
+
+void VideoEncoder::wait() {
+    if (m_thread.joinable())
+        m_thread.join();
+}
+
+void VideoEncoder::_run() {
+    while (true) {
+        Frame frame;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_condition.wait(lock, [this]{ return !m_queue.empty() || m_closing; });
+            if (m_queue.empty())
+                break;
+            frame = std::move(m_queue.front());
+            m_queue.pop_front();
+        }
+        m_condition.notify_all();
+
+        // Once something went wrong keep draining the queue so the render loop never blocks
+        if (m_failed)
+            continue;
+
+        // The encoder may still hold a reference to the previous frame
+        int ret = av_frame_make_writable(m_frame);
+        if (ret < 0) {
+            std::cout << "Could not write frame " << m_frame_count << " of " << m_path << ": " << av_make_error(ret) << std::endl;
+            m_failed = true;
+            continue;
+        }
+
+        // Start from the last row with a negative stride, flipping the image on the same pass as the pixel format conversion
+        int stride = frame.width * 4;
+        const uint8_t* src[1] = { frame.pixels.get() + (size_t)(frame.height - 1) * stride };
+        int src_stride[1] = { -stride };
+
+        m_sws_ctx = sws_getCachedContext(m_sws_ctx,
+                                         frame.width, frame.height, AV_PIX_FMT_RGBA,
+                                         m_frame->width, m_frame->height, (AVPixelFormat)m_frame->format,
+                                         SWS_BILINEAR, NULL, NULL, NULL);
+        if (!m_sws_ctx) {
+            std::cout << "Could not convert frames for " << m_path << std::endl;
+            m_failed = true;
+            continue;
+        }
+
+        sws_scale(m_sws_ctx, src, src_stride, 0, frame.height, m_frame->data, m_frame->linesize);
+        recyclePixelsBuffer(std::move(frame.pixels), (size_t)frame.width * frame.height * 4);
+
+        m_frame->pts = m_frame_count++;
+        if (!_encode(m_frame))
+            m_failed = true;
+    }
+
+    // Flush the frames the encoder is still holding and close the file
+    if (!m_failed)
+        _encode(NULL);
+    av_write_trailer(m_format_ctx);
+
+    if (m_failed)
+        std::cout << "// Video " << m_path << " could not be completely saved" << std::endl;
+    else
+        std::cout << "// Video saved to " << m_path << " (" << m_frame_count << " frames)" << std::endl;
+
+    _release();
+}
+
+bool VideoEncoder::_encode(AVFrame* _frame) {
+    int ret = avcodec_send_frame(m_codec_ctx, _frame);
+    if (ret < 0) {
+        std::cout << "Error sending frame to the encoder: " << av_make_error(ret) << std::endl;
+        return false;
+    }
+
+    while (ret >= 0) {
+        ret = avcodec_receive_packet(m_codec_ctx, m_packet);
+        if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF)
+            return true;
+        else if (ret < 0) {
+            std::cout << "Error encoding frame: " << av_make_error(ret) << std::endl;
+            return false;
+        }
+
+        av_packet_rescale_ts(m_packet, m_codec_ctx->time_base, m_stream->time_base);
+        m_packet->stream_index = m_stream->index;
+
+        ret = av_interleaved_write_frame(m_format_ctx, m_packet);
+        if (ret < 0) {
+            std::cout << "Error writing frame to " << m_path << ": " << av_make_error(ret) << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+void VideoEncoder::_release() {
+    if (m_sws_ctx) {
+        sws_freeContext(m_sws_ctx);
+        m_sws_ctx = nullptr;
+    }
+
+    if (m_frame)
+        av_frame_free(&m_frame);
+
+    if (m_packet)
+        av_packet_free(&m_packet);
+
+    if (m_codec_ctx)
+        avcodec_free_context(&m_codec_ctx);
+
+    if (m_format_ctx) {
+        if (m_format_ctx->pb && !(m_format_ctx->oformat->flags & AVFMT_NOFILE))
+            avio_closep(&m_format_ctx->pb);
+        avformat_free_context(m_format_ctx);
+        m_format_ctx = nullptr;
+    }
+
+    m_stream = nullptr;
+    m_queue.clear();
+}
+
+#endif
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <string>
+
+// #define SUPPORT_FOR_LIBAV
+#ifdef SUPPORT_FOR_LIBAV
+
+#include <memory>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+
+extern "C" {
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+#include <libswscale/swscale.h>
+}
+
+// Encodes the recorded frames straight into a video file (.mkv as FFV1, .mov as QTRLE, .mp4 as H.264)
+// on its own thread, so the render loop only pays for handing over the pixels
+class VideoEncoder {
+public:
+    VideoEncoder();
+    virtual ~VideoEncoder();
+
+    static bool         isVideo(const std::string& _path);
+
+    bool                open(const std::string& _path, int _width, int _height, float _fps);
+    bool                isOpen() const { return m_open; }
+    const std::string&  getPath() const { return m_path; }
+
+    // Takes RGBA8 pixels as they come from glReadPixels (bottom-up).
+    // Blocks when the encoder falls too far behind
+    void                addFrame(std::unique_ptr<unsigned char[]>&& _pixels, int _width, int _height);
+
+    // Stops taking frames. The queued ones are encoded and the file closed on the encoder thread
+    void                close();
+
+    // Waits for the encoder thread to finish the file
+    void                wait();
+
+private:
+    struct Frame {
+        std::unique_ptr<unsigned char[]>    pixels;
+        int                                 width = 0;
+        int                                 height = 0;
+    };
+
+    void                _run();
+    bool                _encode(AVFrame* _frame);
+    void                _release();
+
+    std::string         m_path;
+
+    AVFormatContext     *m_format_ctx;
+    AVCodecContext      *m_codec_ctx;
+    AVStream            *m_stream;
+    AVFrame             *m_frame;
+    AVPacket            *m_packet;
+    SwsContext          *m_sws_ctx;
+    int64_t             m_frame_count;
+
+    std::deque<Frame>   m_queue;
+    size_t              m_queue_max;
+    std::mutex          m_mutex;
+    std::condition_variable m_condition;
+    std::thread         m_thread;
+
+    std::atomic<bool>   m_failed;
+    bool                m_closing;
+    bool                m_open;
+};
+
+#else
+
+class VideoEncoder {
+public:
+    static bool         isVideo(const std::string& _path);
+};
+
+#endif
@@ -8,10 +8,13 @@
 #include <thread>
 #include <mutex>
 #include <atomic>
+#include <chrono>
 #include <iostream>
 #include <fstream>
 
 #include "gl/gl.h"
+#include "gl/programCache.h"
+#include "gl/textureStreamSequence.h"
 #include "window.h"
 #include "sandbox.h"
 #include "io/fs.h"
@@ -54,6 +57,11 @@ std::string header = name + " " + version + " by Patricio Gonzalez Vivo ( patric
 bool fullFps = false;
 bool timeOut = false;
 bool screensaver = false;
+std::string renderRange = "";
+std::string benchmark = "";
+std::streambuf* reportBuffer = std::cout.rdbuf();
+int exitStatus = 0;
+std::chrono::steady_clock::time_point startTime;
 
 // Here is where all the magic happens
 Sandbox sandbox;
@@ -65,6 +73,9 @@ void cinWatcherThread();
 
 //================================================================= Functions
 void onExit();
+void renderFirstFrame(const std::vector<std::string>& _cmds);
+void renderOffline(const std::vector<std::string>& _cmds);
+void renderBenchmark(const std::vector<std::string>& _cmds);
 void printUsage(char * executableName) {
     std::cerr << "// " << header << std::endl;
     std::cerr << "// "<< std::endl;
@@ -105,7 +116,13 @@ void printUsage(char * executableName) {
     std::cerr << "// [-l|--life-coding] - live code mode, where the billboard is allways visible" << std::endl;
     std::cerr << "// [-ss|--screensaver] - screensaver mode, any pressed key will exit" << std::endl;
     std::cerr << "// [--headless] - headless rendering. Very useful for making images or benchmarking." << std::endl;
+    std::cerr << "// [--render-range <A_sec>,<B_sec>[,fps][,<format>[:<level>]|<file>.mkv|mov|mp4]] - render a sequence as fast as possible and exit" << std::endl;
+    std::cerr << "// [--benchmark <frames>[,<warmup_frames>][,<file>]] - render frames as fast as possible, write their timings as JSON to a file (or stdout, logs go to stderr) and exit" << std::endl;
+    std::cerr << "// [--record-raw <file.y4m|file.rgba|->] - stream every frame uncompressed (Y4M or raw RGBA) to a file, pipe or stdout" << std::endl;
     std::cerr << "// [--nocursor] - hide cursor" << std::endl;
+    std::cerr << "// [--noshadercache] - don't read or save compiled shaders on the cache folder ($XDG_CACHE_HOME/glslViewer)" << std::endl;
+    std::cerr << "// [--sequence-memory <megabytes>] - memory for the decoded frames of each image sequence, decoded ahead while playing (512 by default)" << std::endl;
+    std::cerr << "// [--sequence-cache [<megabytes>]] - pack the decoded frames of image sequences on the cache folder the first time they play, and map them from there until their files change. Sequences needing more than <megabytes> (8192 by default) or the free space aren't packed" << std::endl;
     std::cerr << "// [--fxaa] - set FXAA as postprocess filter" << std::endl;
     std::cerr << "// [--holoplay <0/1/2>] - HoloPlay volumetric postprocess" << std::endl;
     std::cerr << "// [-I<include_folder>] - add an include folder to default for #include files" << std::endl;
@@ -224,6 +241,19 @@ void declareCommands() {
     },
     "fps                            return or set the amount of frames per second.", false));
 
+    commands.push_back(Command("profile", [&](const std::string& _line){
+        std::vector<std::string> values = split(_line,',');
+        if (values.size() == 1 || (values.size() == 2 && values[1] == "csv")) {
+            std::cout << sandbox.getProfiler().report(values.size() == 2);
+            if (values.size() == 1)
+                std::cout << "// uniforms: " << Shader::getUploadedUniforms() << " uploaded, " << Shader::getSkippedUniforms() << " skipped as unchanged (since last asked)" << std::endl;
+            Shader::resetUniformsCount();
+            return true;
+        }
+        return false;
+    },
+    "profile[,csv]                  print the CPU and GPU time (in ms) of each render pass and how many uniform uploads were skipped.", false));
+
     commands.push_back(Command("delta", [&](const std::string& _line){ 
         if (_line == "delta") {
             // Force the output in floats
@@ -493,15 +523,37 @@ void declareCommands() {
 
     commands.push_back(Command("screenshot", [&](const std::string& _line){ 
         std::vector<std::string> values = split(_line,',');
-        if (values.size() == 2) {
+        if (values.size() >= 2 && values.size() <= 5) {
+            PixelsOptions options;
+            int width = 0;
+            int height = 0;
+
+            // Two numbers are the size of the image, anything else how to encode it
+            size_t i = 2;
+            if (values.size() >= 4 && isInt(values[2]) && isInt(values[3])) {
+                width = toInt(values[2]);
+                height = toInt(values[3]);
+                i = 4;
+            }
+
+            if (i < values.size()) {
+                if (i + 1 < values.size() || !parsePixelsOptions(values[i], &options)) {
+                    std::cout << "// Unknown image format " << values[i] << std::endl;
+                    return true;
+                }
+            }
+
             consoleMutex.lock();
             sandbox.screenshotFile = values[1];
+            sandbox.screenshotOptions = options;
+            sandbox.screenshotWidth = width;
+            sandbox.screenshotHeight = height;
             consoleMutex.unlock();
             return true;
         }
         return false;
     },
-    "screenshot[,<filename>]        saves a screenshot to a filename.", false));
+    "screenshot[,<filename>][,<width>,<height>][,<format>[:<level>[:<filter>]]] saves a screenshot to a filename (format: png, qoi, tga, ppm, pfm, jpg, bmp or hdr). Given a size it renders it in tiles (png:0, qoi, tga:0, ppm or pfm).", false));
 
     commands.push_back(Command("sequence", [&](const std::string& _line){ 
         std::vector<std::string> values = split(_line,',');
@@ -509,18 +561,29 @@ void declareCommands() {
             float from = toFloat(values[1]);
             float to = toFloat(values[2]);
             float fps = 24.0;
-
-            if (values.size() == 4)
-                fps = toFloat(values[3]);
+            std::string file = "";
+            PixelsOptions options;
+
+            // Optionally the fps, a video file (.mkv, .mov or .mp4) to encode into instead of
+            // saving images, or the format of the images (<format>[:<level>[:<filter>]])
+            for (size_t i = 3; i < values.size(); i++) {
+                if (VideoEncoder::isVideo(values[i]))
+                    file = values[i];
+                else if (!parsePixelsOptions(values[i], &options))
+                    fps = toFloat(values[i]);
+            }
 
             if (from >= to) {
                 from = 0.0;
             }
 
             consoleMutex.lock();
-            sandbox.record(from, to, fps);
+            bool recording = sandbox.record(from, to, fps, file, options);
             consoleMutex.unlock();
 
+            if (!recording)
+                return true;
+
             std::cout << "// " << std::endl;
 
             int pct = 0;
@@ -550,7 +613,7 @@ void declareCommands() {
         }
         return false;
     },
-    "sequence,<A_sec>,<B_sec>[,fps] saves a sequence of images from A to B second.", false));
+    "sequence,<A_sec>,<B_sec>[,fps][,<format>[:<level>[:<filter>]]|<file>.mkv|mov|mp4] saves a sequence of images (or a video) from A to B second.", false));
 
     commands.push_back(Command("q", [&](const std::string& _line){ 
         if (_line == "q") {
@@ -585,6 +648,7 @@ void declareCommands() {
 // Main program
 //============================================================================
 int main(int argc, char **argv){
+    startTime = std::chrono::steady_clock::now();
 
     // Set the size
     glm::ivec4 windowPosAndSize = glm::ivec4(0);
@@ -638,6 +702,27 @@ int main(int argc, char **argv){
             else
                 std::cout << "Argument '" << argument << "' should be followed by a <pixels>. Skipping argument." << std::endl;
         }
+        else if (   std::string(argv[i]) == "--sequence-memory" ) {
+            if(++i < argc)
+                TextureStreamSequence::setMemoryBudget( (size_t)std::max(0, toInt(std::string(argv[i]))) * 1024 * 1024 );
+            else
+                std::cout << "Argument '" << argument << "' should be followed by <megabytes>. Skipping argument." << std::endl;
+        }
+        else if (   std::string(argv[i]) == "--sequence-cache" ) {
+            TextureStreamSequence::setCache(true);
+            if (i + 1 < argc && isInt(std::string(argv[i + 1])))
+                TextureStreamSequence::setCacheLimit( (unsigned long long)std::max(0, toInt(std::string(argv[++i]))) * 1024 * 1024 );
+        }
+        else if (   std::string(argv[i]) == "--record-raw" ||
+                    std::string(argv[i]) == "--render-range" ) {
+            // Skip the value, it's used once the GL context is up
+            i++;
+        }
+        else if (   std::string(argv[i]) == "--benchmark" ) {
+            // Without a file the report takes stdout, so the logs move to stderr
+            if (++i < argc && split(std::string(argv[i]), ',').size() < 3)
+                std::cout.rdbuf(std::cerr.rdbuf());
+        }
         else if (   std::string(argv[i]) == "--help" ) {
             displayHelp = true;
         }
@@ -714,7 +799,8 @@ int main(int argc, char **argv){
         if (    argument == "-x" || argument == "-y" ||
                 argument == "-w" || argument == "--width" ||
                 argument == "-h" || argument == "--height" ||
-                argument == "--fps" ) {
+                argument == "--fps" ||
+                argument == "--sequence-memory" ) {
             i++;
         }
         else if (   argument == "-l" ||
@@ -729,9 +815,37 @@ int main(int argc, char **argv){
         else if ( argument == "--nocursor" ) {
             sandbox.cursor = false;
         }
+        else if ( argument == "--noshadercache" ) {
+            setProgramCache(false);
+        }
+        else if ( argument == "--sequence-cache" ) {
+            // Skip the limit if there is one
+            if (i + 1 < argc && isInt(std::string(argv[i + 1])))
+                i++;
+        }
         else if ( argument == "--fxaa" ) {
             sandbox.fxaa = true;
         }
+        else if ( argument == "--record-raw" ) {
+            if(++i < argc)
+                sandbox.recordRaw(std::string(argv[i]));
+            else
+                std::cout << "Argument '" << argument << "' should be followed by a <file|->. Skipping argument." << std::endl;
+        }
+        else if ( argument == "--render-range" ) {
+            if(++i < argc)
+                renderRange = std::string(argv[i]);
+            else
+                std::cout << "Argument '" << argument << "' should be followed by <A_sec>,<B_sec>[,fps]. Skipping argument." << std::endl;
+        }
+        else if ( argument == "--benchmark" ) {
+            if(++i < argc) {
+                benchmark = std::string(argv[i]);
+                fullFps = true;
+            }
+            else
+                std::cout << "Argument '" << argument << "' should be followed by <frames>[,<warmup_frames>][,<file>]. Skipping argument." << std::endl;
+        }
         else if ( argument== "-p" || argument == "--port" ) {
             if(++i < argc)
                 osc_listener.start(toInt(std::string(argv[i])), runCmd);
@@ -962,6 +1076,15 @@ int main(int argc, char **argv){
         exit(EXIT_FAILURE);
     }
 
+    // Offline renders and benchmarks run the argument commands themselves, right before they start
+    std::vector<std::string> offline_cmds;
+    if (renderRange != "" || benchmark != "")
+        offline_cmds.swap(cmds_arguments);
+
+    // Scripted runs expect the frames right after a reload to use the new shaders
+    if (renderRange != "" || benchmark != "" || execute_exit || windowStyle == HEADLESS)
+        Shader::setParallel(false);
+
     // Start watchers
     fileChanged = -1;
     std::thread fileWatcher( &fileWatcherThread );
@@ -975,6 +1098,12 @@ int main(int argc, char **argv){
     if (sandbox.verbose)
         std::cout << "Starting Render Loop" << std::endl; 
     
+    // Offline render or benchmark (turn bRun off once they are done)
+    if (renderRange != "")
+        renderOffline(offline_cmds);
+    else if (benchmark != "")
+        renderBenchmark(offline_cmds);
+
     // Render Loop
     while ( isGL() && bRun.load() ) {
         // Update
@@ -1028,7 +1157,7 @@ int main(int argc, char **argv){
     pthread_t cinHandler = cinWatcher.native_handle();
     pthread_cancel( cinHandler );
 #endif//
-    exit(0);
+    exit(exitStatus);
 }
 
 // Events
@@ -1082,6 +1211,163 @@ void onExit() {
 }
 
 
+void renderFirstFrame(const std::vector<std::string>& _cmds) {
+    // The first frame sets up the viewport, after it the commands (-e, -E and -D) can be applied
+    updateGL(false);
+    sandbox.render();
+    sandbox.renderDone();
+
+    for (unsigned int i = 0; i < _cmds.size(); i++)
+        runCmd(_cmds[i], consoleMutex);
+}
+
+void renderOffline(const std::vector<std::string>& _cmds) {
+    std::vector<std::string> values = split(renderRange, ',');
+    if (values.size() < 2) {
+        std::cout << "// --render-range needs <A_sec>,<B_sec>[,fps]" << std::endl;
+        bRun.store(false);
+        return;
+    }
+
+    float from = toFloat(values[0]);
+    float to = toFloat(values[1]);
+    float fps = 24.0;
+    std::string file = "";
+    PixelsOptions options;
+
+    for (size_t i = 2; i < values.size(); i++) {
+        if (VideoEncoder::isVideo(values[i]))
+            file = values[i];
+        else if (!parsePixelsOptions(values[i], &options))
+            fps = toFloat(values[i]);
+    }
+
+    if (from >= to)
+        from = 0.0;
+
+    renderFirstFrame(_cmds);
+
+    if (sandbox.record(from, to, fps, file, options)) {
+        // Frames are driven by the virtual clock of the recording, no resting between them,
+        // no buffer swaps and no waiting for changes. Reading back and saving happen on the background
+        auto start = std::chrono::steady_clock::now();
+        int frames = 0;
+
+        // Keep going until the frame that ends the recording is done: it's the one that waits
+        // for the pending read backs and closes the encoder
+        while ( isGL() && bRun.load() && sandbox.isRecording() ) {
+            updateGL(false);
+
+            glClear( GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT );
+
+            sandbox.render();
+            sandbox.renderDone();
+            frames++;
+        }
+
+        double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::cout << "// Rendered " << frames << " frames in " << secs << " secs (" << (secs > 0.0 ? frames / secs : 0.0) << " fps)" << std::endl;
+    }
+
+    bRun.store(false);
+}
+
+void printStatsJSON(std::ostream& _out, const std::string& _name, const Profiler::Stats& _stats, const std::string& _indent) {
+    _out << _indent << "\"" << _name << "\": { ";
+    _out << "\"mean\": " << _stats.mean << ", ";
+    _out << "\"p50\": " << _stats.p50 << ", ";
+    _out << "\"p95\": " << _stats.p95 << ", ";
+    _out << "\"p99\": " << _stats.p99 << ", ";
+    _out << "\"max\": " << _stats.max << ", ";
+    _out << "\"samples\": " << _stats.count << " }";
+}
+
+void renderBenchmark(const std::vector<std::string>& _cmds) {
+    std::vector<std::string> values = split(benchmark, ',');
+    int frames = toInt(values[0]);
+    int warmup = (values.size() > 1) ? toInt(values[1]) : 0;
+    if (frames <= 0) {
+        std::cerr << "// --benchmark needs <frames>[,<warmup_frames>][,<file>]" << std::endl;
+        exitStatus = 1;
+        bRun.store(false);
+        return;
+    }
+
+    std::ofstream file;
+    std::ostream out(reportBuffer);
+    if (values.size() > 2) {
+        file.open(values[2].c_str());
+        if (!file.is_open()) {
+            std::cerr << "// Can't write the benchmark report to " << values[2] << std::endl;
+            exitStatus = 1;
+            bRun.store(false);
+            return;
+        }
+        out.rdbuf(file.rdbuf());
+    }
+
+    renderFirstFrame(_cmds);
+    double startup = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+
+    // Every run sees the same sequence of u_time values, 60 frames per virtual second
+    sandbox.setTimeStep(1.0f / 60.0f);
+
+    // Keep the times of every frame and don't skip the GPU ones that are late
+    Profiler& profiler = sandbox.getProfiler();
+    profiler.setSamples(frames);
+    profiler.setWait(true);
+
+    // No resting, no swapping and no waiting for changes, so only the rendering is measured
+    std::vector<float> frame_times;
+    frame_times.reserve(frames);
+    for (int i = 0; i < warmup + frames && isGL() && bRun.load(); i++) {
+        if (i == warmup) {
+            profiler.reset();
+            Shader::resetUniformsCount();
+        }
+
+        auto start = std::chrono::steady_clock::now();
+
+        updateGL(false);
+        glClear( GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT );
+        sandbox.render();
+        sandbox.renderUI();
+        sandbox.renderDone();
+
+        if (i >= warmup)
+            frame_times.push_back(std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count());
+    }
+
+    // The GPU times of the last frame are still in flight
+    glFinish();
+    profiler.flush();
+
+    std::vector<std::string> passes = profiler.getPasses();
+    out << "{" << std::endl;
+    out << "    \"frames\": " << frame_times.size() << "," << std::endl;
+    out << "    \"warmup\": " << warmup << "," << std::endl;
+    out << "    \"width\": " << getWindowWidth() << "," << std::endl;
+    out << "    \"height\": " << getWindowHeight() << "," << std::endl;
+    out << "    \"startup_ms\": " << startup << "," << std::endl;
+    out << "    \"shader_compile_ms\": " << Shader::getTotalLoadTime() * 1000.0 << "," << std::endl;
+    out << "    \"uniforms_uploaded\": " << Shader::getUploadedUniforms() << "," << std::endl;
+    out << "    \"uniforms_skipped\": " << Shader::getSkippedUniforms() << "," << std::endl;
+    printStatsJSON(out, "frame_ms", Profiler::getStats(frame_times), "    ");
+    out << "," << std::endl;
+    out << "    \"passes\": {" << std::endl;
+    for (size_t i = 0; i < passes.size(); i++) {
+        out << "        \"" << passes[i] << "\": {" << std::endl;
+        printStatsJSON(out, "cpu_ms", profiler.getStats(passes[i], false), "            ");
+        out << "," << std::endl;
+        printStatsJSON(out, "gpu_ms", profiler.getStats(passes[i], true), "            ");
+        out << std::endl << "        }" << (i + 1 < passes.size() ? "," : "") << std::endl;
+    }
+    out << "    }" << std::endl;
+    out << "}" << std::endl;
+
+    bRun.store(false);
+}
+
 //  Watching Thread
 //============================================================================
 void fileWatcherThread() {
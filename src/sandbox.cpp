@@ -34,14 +34,29 @@ int holoplay_columns = 4;
 int holoplay_rows = 8;
 int holoplay_totalViews = 32;
 
+// Amount of frames that can be in flight between the GPU and the saving threads
+const int record_pbos_total = 3;
+
 // ------------------------------------------------------------------------- CONTRUCTOR
+// Native uniforms set on every draw, by handle to skip looking them up by name
+static const UniformHandle<int>       u_frame("u_frame");
+static const UniformHandle<float>     u_time("u_time");
+static const UniformHandle<float>     u_delta("u_delta");
+static const UniformHandle<glm::vec4> u_date("u_date");
+static const UniformHandle<glm::vec2> u_mouse("u_mouse");
+static const UniformHandle<glm::vec2> u_resolution("u_resolution");
+static const UniformHandle<glm::vec2> u_tileOffset("u_tileOffset");
+static const UniformHandle<glm::mat3> u_view2d("u_view2d");
+
 Sandbox::Sandbox(): 
+    screenshotWidth(0), screenshotHeight(0),
     frag_index(-1), vert_index(-1), geom_index(-1), holoplay(-1),
     verbose(false), cursor(true), fxaa(false),
     // Main Vert/Frag/Geom
     m_frag_source(""), m_vert_source(""),
     // Buffers
     m_buffers_total(0),
+    m_render_graph_showPasses(false), m_render_graph_change(true), m_render_graph_links(0),
     // Poisson Fill
     m_convolution_pyramid_total(0),
     // PostProcessing
@@ -50,10 +65,12 @@ Sandbox::Sandbox():
     m_billboard_vbo(nullptr), m_cross_vbo(nullptr),
     // Record
     m_record_fdelta(0.04166666667), m_record_start(0.0f), m_record_head(0.0f), m_record_end(0.0f), m_record_counter(0), m_record(false),
+    // Poster
+    m_poster_size(0.0), m_poster_offset(0.0), m_poster_time(0.0f), m_poster(false),
     // Histogram
     m_histogram_texture(nullptr), m_histogram(false),
     // Scene
-    m_view2d(1.0), m_time_offset(0.0), m_lat(180.0), m_lon(0.0), m_frame(0), m_change(true), m_initialized(false), m_error_screen(true),
+    m_view2d(1.0), m_time_offset(0.0), m_time_step(0.0), m_lat(180.0), m_lon(0.0), m_frame(0), m_change(true), m_initialized(false), m_error_screen(true),
     // Debug
     m_showTextures(false), m_showPasses(false),
     m_task_count(0),
@@ -64,39 +81,48 @@ Sandbox::Sandbox():
     m_save_threads(std::max(1, static_cast<int>(std::thread::hardware_concurrency()) - 1))
 {
 
+    #if !defined(PLATFORM_RPI)
+    m_record_pbos.resize(record_pbos_total);
+    #endif
+
     // TIME UNIFORMS
     //
     uniforms.functions["u_frame"] = UniformFunction( "int", [this](Shader& _shader) {
-        _shader.setUniform("u_frame", (int)m_frame);
+        _shader.setUniform(u_frame, (int)m_frame);
     }, [this]() { return toString(m_frame); } );
 
     uniforms.functions["u_time"] = UniformFunction( "float", [this](Shader& _shader) {
-        if (m_record) _shader.setUniform("u_time", m_record_head);
-        else _shader.setUniform("u_time", float(getTime()) - m_time_offset);
+        _shader.setUniform(u_time, _getTime());
     }, [this]() { return toString(getTime() - m_time_offset); } );
 
     uniforms.functions["u_delta"] = UniformFunction("float", [this](Shader& _shader) {
-        if (m_record) _shader.setUniform("u_delta", float(m_record_fdelta));
-        else _shader.setUniform("u_delta", float(getDelta()));
+        _shader.setUniform(u_delta, _getDelta());
     },
     []() { return toString(getDelta()); });
 
     uniforms.functions["u_date"] = UniformFunction("vec4", [](Shader& _shader) {
-        _shader.setUniform("u_date", getDate());
+        _shader.setUniform(u_date, getDate());
     },
     []() { return toString(getDate(), ','); });
 
     // MOUSE
     uniforms.functions["u_mouse"] = UniformFunction("vec2", [](Shader& _shader) {
-        _shader.setUniform("u_mouse", float(getMouseX()), float(getMouseY()));
+        _shader.setUniform(u_mouse, glm::vec2(getMouseX(), getMouseY()));
     },
     []() { return toString(getMouseX()) + "," + toString(getMouseY()); } );
 
     // VIEWPORT
-    uniforms.functions["u_resolution"]= UniformFunction("vec2", [](Shader& _shader) {
-        _shader.setUniform("u_resolution", float(getWindowWidth()), float(getWindowHeight()));
+    uniforms.functions["u_resolution"]= UniformFunction("vec2", [this](Shader& _shader) {
+        _shader.setUniform(u_resolution, _getResolution());
     },
-    []() { return toString(getWindowWidth()) + "," + toString(getWindowHeight()); });
+    [this]() { return m_poster ? toString(m_poster_size, ',') : toString(getWindowWidth()) + "," + toString(getWindowHeight()); });
+
+    // Origin (in pixels) of the tile being rendered when the screenshot is bigger than the window.
+    // Add it to gl_FragCoord to get the position on the whole image
+    uniforms.functions["u_tileOffset"]= UniformFunction("vec2", [this](Shader& _shader) {
+        _shader.setUniform(u_tileOffset, m_poster_offset);
+    },
+    [this]() { return toString(m_poster_offset, ','); });
 
     // SCENE
     uniforms.functions["u_scene"] = UniformFunction("sampler2D", [this](Shader& _shader) {
@@ -120,7 +146,7 @@ Sandbox::Sandbox():
     #endif
 
     uniforms.functions["u_view2d"] = UniformFunction("mat3", [this](Shader& _shader) {
-        _shader.setUniform("u_view2d", m_view2d);
+        _shader.setUniform(u_view2d, m_view2d);
     });
 
     uniforms.functions["u_modelViewProjectionMatrix"] = UniformFunction("mat4");
@@ -419,6 +445,26 @@ void Sandbox::setup( WatchFileList &_files, CommandList &_commands ) {
     },
     "light_intensity[,<value>]      get or set the light intensity."));
 
+    _commands.push_back(Command("light_add", [&](const std::string& _line){ 
+        std::vector<std::string> values = split(_line,',');
+        if (values.size() >= 4 && uniforms.lights.size() < LIGHTS_MAX) {
+            float falloff = (values.size() == 9)? toFloat(values[8]) : -1.0f;
+            Light light( glm::vec3(toFloat(values[1]),toFloat(values[2]),toFloat(values[3])), falloff );
+            if (values.size() >= 7)
+                light.color = glm::vec3(toFloat(values[4]),toFloat(values[5]),toFloat(values[6]));
+            if (values.size() >= 8)
+                light.intensity = toFloat(values[7]);
+            uniforms.lights.push_back( light );
+
+            // From the second one on, shaders loop over them (see LightClusters)
+            if (geom_index != -1 && uniforms.lights.size() > 1)
+                addDefine("LIGHT_CLUSTERS");
+            return true;
+        }
+        return false;
+    },
+    "light_add,<x>,<y>,<z>[,<r>,<g>,<b>[,<intensity>[,<falloff>]]]   add a point light."));
+
     // CAMERA
     _commands.push_back(Command("camera_distance", [&](const std::string& _line){ 
         std::vector<std::string> values = split(_line,',');
@@ -672,6 +718,7 @@ void Sandbox::addDefine(const std::string &_define, const std::string &_value) {
         m_scene.addDefine(_define, _value);
 
     m_postprocessing_shader.addDefine(_define, _value);
+    m_render_graph_change = true;
 }
 
 void Sandbox::delDefine(const std::string &_define) {
@@ -684,6 +731,7 @@ void Sandbox::delDefine(const std::string &_define) {
         m_scene.delDefine(_define);
 
     m_postprocessing_shader.delDefine(_define);
+    m_render_graph_change = true;
 }
 
 // ------------------------------------------------------------------------- GET
@@ -712,6 +760,7 @@ bool Sandbox::haveChange() {
 
     return  m_change ||
             m_record ||
+            m_record_raw.isOpen() ||
             screenshotFile != "" ||
             m_scene.haveChange() ||
             uniforms.haveChange();
@@ -725,6 +774,24 @@ int Sandbox::getRecordedPercentage() {
     return ((m_record_head - m_record_start) / (m_record_end - m_record_start)) * 100;
 }
 
+float Sandbox::_getTime() const {
+    if (m_record) return m_record_head;
+    else if (m_poster) return m_poster_time;
+    else if (m_time_step > 0.0f) return m_frame * m_time_step;
+    else return float(getTime()) - m_time_offset;
+}
+
+float Sandbox::_getDelta() const {
+    if (m_record) return float(m_record_fdelta);
+    else if (m_time_step > 0.0f) return m_time_step;
+    else return float(getDelta());
+}
+
+glm::vec2 Sandbox::_getResolution() const {
+    if (m_poster) return m_poster_size;
+    else return glm::vec2(getWindowWidth(), getWindowHeight());
+}
+
 // ------------------------------------------------------------------------- RELOAD SHADER
 
 void Sandbox::_updateSceneBuffer(int _width, int _height) {
@@ -745,6 +812,10 @@ void Sandbox::_updateSceneBuffer(int _width, int _height) {
 bool Sandbox::reloadShaders( WatchFileList &_files ) {
     flagChange();
 
+    // Passes, sections and uniforms used by the sources, on one go
+    m_frag_info = analyzeSource(m_frag_source);
+    m_vert_info = analyzeSource(m_vert_source);
+
     // UPDATE scene shaders of models (materials)
     if (geom_index == -1) {
 
@@ -759,7 +830,7 @@ bool Sandbox::reloadShaders( WatchFileList &_files ) {
         if (verbose)
             std::cout << "// Reload 3D scene shaders" << std::endl;
 
-        m_scene.loadShaders(m_frag_source, m_vert_source, verbose);
+        m_scene.loadShaders(m_frag_source, m_vert_source, m_frag_info, m_vert_info, verbose);
     }
 
     // UPDATE shaders dependencies
@@ -787,7 +858,7 @@ bool Sandbox::reloadShaders( WatchFileList &_files ) {
     }
 
     // UPDATE uniforms
-    uniforms.checkPresenceIn(m_vert_source, m_frag_source); // Check active native uniforms
+    uniforms.checkPresenceIn(m_vert_info, m_frag_info);     // Check active native uniforms
     uniforms.flagChange();                                  // Flag all user defined uniforms as changed
 
     if (uniforms.cubemap) {
@@ -795,16 +866,27 @@ bool Sandbox::reloadShaders( WatchFileList &_files ) {
         addDefine("SCENE_CUBEMAP", "u_cubeMap");
     }
 
+    // All the lights go on arrays (u_lightsPosition, ...), with more than one the default shader loops over them
+    if (geom_index != -1) {
+        addDefine("LIGHTS_MAX", toString(LIGHTS_MAX));
+        if (uniforms.lights.size() > 1)
+            addDefine("LIGHT_CLUSTERS");
+    }
+
+    // Camera, lights, time and IBL shared through uniform blocks by the shaders that can (see default_scene.h)
+    if (uniforms.setBlocks(true))
+        addDefine("UNIFORM_BLOCKS");
+
     // UPDATE Buffers
-    m_buffers_total = count_buffers(m_frag_source);
+    m_buffers_total = m_frag_info.buffers.size();
     _updateBuffers();
 
     // Convolution Pyramids
-    m_convolution_pyramid_total = count_convolution_pyramid(getSource(FRAGMENT));
+    m_convolution_pyramid_total = m_frag_info.convolution_pyramids.size();
     _updateConvolutionPyramids();
     
     // UPDATE Postprocessing
-    bool havePostprocessing = check_for_postprocessing(getSource(FRAGMENT));
+    bool havePostprocessing = m_frag_info.havePostprocessing();
     if (havePostprocessing) {
         // Specific defines for this buffer
         m_postprocessing_shader.addDefine("POSTPROCESSING");
@@ -827,11 +909,15 @@ bool Sandbox::reloadShaders( WatchFileList &_files ) {
     if (m_postprocessing || m_histogram)
         _updateSceneBuffer(getWindowWidth(), getWindowHeight());
 
+    m_render_graph_change = true;
+
     return true;
 }
 
 // ------------------------------------------------------------------------- UPDATE
 void Sandbox::_updateBuffers() {
+    m_render_graph_change = true;
+
     if ( m_buffers_total != int(uniforms.buffers.size()) ) {
 
         if (verbose)
@@ -841,9 +927,8 @@ void Sandbox::_updateBuffers() {
         m_buffers_shaders.clear();
 
         for (int i = 0; i < m_buffers_total; i++) {
-            // New FBO
-            uniforms.buffers.push_back( Fbo() );
-            uniforms.buffers[i].allocate(getWindowWidth(), getWindowHeight(), COLOR_TEXTURE);
+            // FBOs are handed out by the render graph
+            uniforms.buffers.push_back( nullptr );
             
             // New Shader
             m_buffers_shaders.push_back( Shader() );
@@ -862,6 +947,8 @@ void Sandbox::_updateBuffers() {
 }
 
 void Sandbox::_updateConvolutionPyramids() {
+    m_render_graph_change = true;
+
     if ( m_convolution_pyramid_total != int(uniforms.convolution_pyramids.size()) ) {
 
         if (verbose)
@@ -901,7 +988,7 @@ void Sandbox::_updateConvolutionPyramids() {
         }
     }
     
-    if (check_for_convolution_pyramid_algorithm(getSource(FRAGMENT))) {
+    if (m_frag_info.haveConvolutionPyramidAlgorithm()) {
         m_convolution_pyramid_shader.addDefine("CONVOLUTION_PYRAMID_ALGORITHM");
         m_convolution_pyramid_shader.load(m_frag_source, getDefaultSrc(VERT_BILLBOARD), false);
     }
@@ -915,84 +1002,275 @@ void Sandbox::_updateConvolutionPyramids() {
 }
 
 // ------------------------------------------------------------------------- DRAW
-void Sandbox::_renderBuffers() {
-    glDisable(GL_BLEND);
+unsigned int Sandbox::_getPassVersion(size_t _node) {
+    // Buffers come first on the render graph, followed by the pyramids
+    if (_node < uniforms.buffers.size())
+        return (_node < m_buffers_inputs.size()) ? m_buffers_inputs[_node].version : 0;
+    _node -= uniforms.buffers.size();
+    return (_node < m_convolution_pyramid_inputs.size()) ? m_convolution_pyramid_inputs[_node].version : 0;
+}
+
+bool Sandbox::_isPassDirty(PassInputs& _pass, size_t _node, Shader& _shader, Shader* _extra) {
+    bool dirty = m_change || m_poster || !m_initialized;
+
+    // The active uniforms of the compiled program are what the pass really reads,
+    // once the preprocessor and the compiler have dropped everything else
+    if (_pass.program != _shader.getProgram() || (_extra && _pass.extra_program != _extra->getProgram())) {
+        _pass.program = _shader.getProgram();
+        _pass.extra_program = _extra ? _extra->getProgram() : 0;
+        _pass.names = _shader.getActiveUniforms();
+        if (_extra) {
+            std::vector<std::string> names = _extra->getActiveUniforms();
+            for (unsigned int i = 0; i < names.size(); i++)
+                if (std::find(_pass.names.begin(), _pass.names.end(), names[i]) == _pass.names.end())
+                    _pass.names.push_back(names[i]);
+        }
+
+        // Uniform blocks hold the time, and the histogram is made out of the previous frame
+        _pass.always = _shader.haveUniformBlocks() || (_extra && _extra->haveUniformBlocks()) ||
+                        std::find(_pass.names.begin(), _pass.names.end(), "u_sceneHistogram") != _pass.names.end();
+        _pass.passes = m_render_graph.getInputs(_node);
+        _pass.versions.clear();
+        _pass.values.clear();
+        _pass.extra_values.clear();
+        dirty = true;
+    }
+    dirty = dirty || _pass.always;
+
+    // Other passes are compared by how many times they were rendered
+    _pass.versions.resize(_pass.passes.size(), (unsigned int)-1);
+    for (size_t i = 0; i < _pass.passes.size(); i++) {
+        unsigned int version = _getPassVersion(_pass.passes[i]);
+        if (_pass.versions[i] != version) {
+            _pass.versions[i] = version;
+            dirty = true;
+        }
+    }
+
+    for (size_t i = 0; i < _pass.names.size() && !dirty; i++)
+        if (uniforms.isChanging(_pass.names[i]))
+            dirty = true;
+
+    // Everything else by the values the uniforms would send. Kept up to date even when
+    // the pass is already dirty, they are the ones it's about to render with
+    _shader.use();
+    _shader.beginWatch(&_pass.values);
+    uniforms.feedTo(_shader);
+    dirty = _shader.endWatch() || dirty;
+
+    if (_extra) {
+        _extra->use();
+        _extra->beginWatch(&_pass.extra_values);
+        uniforms.feedTo(*_extra);
+        dirty = _extra->endWatch() || dirty;
+    }
+
+    return dirty;
+}
+
+void Sandbox::_updateRenderGraph() {
+    // Pending define changes get compiled first, so the inputs are the ones that will be used
+    std::vector<Shader*> shaders;
+    for (unsigned int i = 0; i < m_buffers_shaders.size(); i++)
+        shaders.push_back( &m_buffers_shaders[i] );
+    for (unsigned int i = 0; i < m_convolution_pyramid_subshaders.size(); i++)
+        shaders.push_back( &m_convolution_pyramid_subshaders[i] );
+    shaders.push_back( &m_convolution_pyramid_shader );
+    shaders.push_back( &m_canvas_shader );
+    shaders.push_back( &m_postprocessing_shader );
+    for (unsigned int i = 0; i < shaders.size(); i++)
+        if (shaders[i]->getProgram() != 0)
+            shaders[i]->use();
+
+    m_render_graph.clear();
+    for (unsigned int i = 0; i < m_buffers_shaders.size(); i++)
+        m_render_graph.addPass("u_buffer" + toString(i), m_buffers_shaders[i].getActiveUniforms(), true);
+
+    std::vector<std::string> pyramid_inputs = m_convolution_pyramid_shader.getActiveUniforms();
+    for (unsigned int i = 0; i < m_convolution_pyramid_subshaders.size(); i++) {
+        std::vector<std::string> inputs = m_convolution_pyramid_subshaders[i].getActiveUniforms();
+        inputs.insert(inputs.end(), pyramid_inputs.begin(), pyramid_inputs.end());
+        m_render_graph.addPass("u_convolutionPyramid" + toString(i), inputs, false);
+    }
+
+    // What is read once all passes are done
+    std::vector<std::string> outputs;
+    if (geom_index == -1)
+        outputs = m_canvas_shader.getActiveUniforms();
+    else
+        outputs = m_scene.getActiveUniforms();
+
+    if (m_postprocessing) {
+        std::vector<std::string> postprocessing = m_postprocessing_shader.getActiveUniforms();
+        outputs.insert(outputs.end(), postprocessing.begin(), postprocessing.end());
+    }
+
+    // Debug views show all of them
+    if (m_showPasses)
+        for (size_t i = 0; i < m_render_graph.getTotalPasses(); i++)
+            outputs.push_back( m_render_graph.getName(i) );
+
+    m_render_graph.compile(outputs);
+
+    // Buffers that are never needed at the same time share the same FBO
+    if (m_buffers_fbos.size() != m_render_graph.getTotalTargets()) {
+        m_buffers_fbos.clear();
+        m_buffers_fbos.resize(m_render_graph.getTotalTargets());
+        for (unsigned int i = 0; i < m_buffers_fbos.size(); i++)
+            m_buffers_fbos[i].allocate(getWindowWidth(), getWindowHeight(), COLOR_TEXTURE);
+    }
+    m_buffers_fbos_owners.assign(m_buffers_fbos.size(), -1);
 
     for (unsigned int i = 0; i < uniforms.buffers.size(); i++) {
-        uniforms.buffers[i].bind();
-        m_buffers_shaders[i].use();
+        int target = m_render_graph.getTarget(i);
+        uniforms.buffers[i] = (target == -1) ? nullptr : &m_buffers_fbos[target];
+    }
 
-        // Update uniforms and textures
-        uniforms.feedTo( m_buffers_shaders[i] );
+    // Programs may have been rebuilt under the same id
+    m_buffers_inputs.clear();
+    m_convolution_pyramid_inputs.clear();
 
-        // Pass textures for the other buffers
-        for (unsigned int j = 0; j < uniforms.buffers.size(); j++) {
-            if (i != j) {
-                m_buffers_shaders[i].setUniformTexture("u_buffer" + toString(j), &uniforms.buffers[j] );
-            }
-        }
+    if (verbose) {
+        std::cout << "// Render graph:";
+        for (size_t i = 0; i < m_render_graph.getOrder().size(); i++)
+            std::cout << " " << m_render_graph.getName( m_render_graph.getOrder()[i] );
+        std::cout << " (" << m_buffers_fbos.size() << " FBOs for " << uniforms.buffers.size() << " buffers)" << std::endl;
+    }
+
+    m_render_graph_showPasses = m_showPasses;
+    m_render_graph_change = false;
+    m_render_graph_links = Shader::getTotalLinks();
+}
+
+void Sandbox::_renderPasses() {
+    // Shaders built in the background can start reading other passes once they swap
+    if (m_render_graph_links != Shader::getTotalLinks())
+        m_render_graph_change = true;
+
+    if (m_render_graph_change || m_render_graph_showPasses != m_showPasses)
+        _updateRenderGraph();
+
+    m_buffers_inputs.resize(uniforms.buffers.size());
+    m_convolution_pyramid_inputs.resize(m_convolution_pyramid_subshaders.size());
+
+    // Passes come first in the graph, followed by the pyramids
+    const std::vector<size_t>& order = m_render_graph.getOrder();
+    for (size_t i = 0; i < order.size(); i++) {
+        if (order[i] < uniforms.buffers.size())
+            _renderBuffer(order[i]);
+        else
+            _renderConvolutionPyramid(order[i] - uniforms.buffers.size());
+    }
+    m_profiler.end();
+}
+
+void Sandbox::_renderBuffer(unsigned int _index) {
+    // Keep what the buffer has from last time, unless another buffer used the FBO since
+    int target = m_render_graph.getTarget(_index);
+    bool dirty = _isPassDirty(m_buffers_inputs[_index], _index, m_buffers_shaders[_index]);
+    if (!dirty && m_buffers_fbos_owners[target] == (int)_index)
+        return;
+
+    m_profiler.begin("buffer" + toString(_index));
+    glDisable(GL_BLEND);
+
+    uniforms.buffers[_index]->bind();
+    m_buffers_shaders[_index].use();
 
-        m_billboard_vbo->render( &m_buffers_shaders[i] );
+    // Update uniforms and textures
+    uniforms.feedTo( m_buffers_shaders[_index] );
 
-        uniforms.buffers[i].unbind();
+    // Pass textures for the other buffers
+    for (unsigned int j = 0; j < uniforms.buffers.size(); j++) {
+        if (_index != j && uniforms.buffers[j]) {
+            m_buffers_shaders[_index].setUniformTexture("u_buffer" + toString(j), uniforms.buffers[j] );
+        }
     }
 
+    m_billboard_vbo->render( &m_buffers_shaders[_index] );
+
+    uniforms.buffers[_index]->unbind();
+    m_buffers_fbos_owners[target] = _index;
+    if (dirty)
+        m_buffers_inputs[_index].version++;
+
     glEnable(GL_BLEND);
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 }
 
-void Sandbox::_renderConvolutionPyramids() {
-    // 
-    // glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_DST_ALPHA);
-    // glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+void Sandbox::_renderConvolutionPyramid(unsigned int _index) {
+    if (!_isPassDirty(m_convolution_pyramid_inputs[_index], uniforms.buffers.size() + _index, m_convolution_pyramid_subshaders[_index], &m_convolution_pyramid_shader))
+        return;
 
-    for (unsigned int i = 0; i < m_convolution_pyramid_subshaders.size(); i++) {
-        glDisable(GL_BLEND);
-
-        m_convolution_pyramid_fbos[i].bind();
-        m_convolution_pyramid_subshaders[i].use();
+    m_profiler.begin("pyramid" + toString(_index));
+    glDisable(GL_BLEND);
 
-        // Clear the background
-        glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    m_convolution_pyramid_fbos[_index].bind();
+    m_convolution_pyramid_subshaders[_index].use();
 
-        // Update uniforms and textures
-        uniforms.feedTo( m_convolution_pyramid_subshaders[i] );
-        m_billboard_vbo->render( &m_convolution_pyramid_subshaders[i] );
+    // Clear the background
+    glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-        m_convolution_pyramid_fbos[i].unbind();
+    // Update uniforms and textures
+    uniforms.feedTo( m_convolution_pyramid_subshaders[_index] );
+    m_billboard_vbo->render( &m_convolution_pyramid_subshaders[_index] );
 
-        glEnable(GL_BLEND);
-        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-        uniforms.convolution_pyramids[i].process(&m_convolution_pyramid_fbos[i]);
-    }
+    m_convolution_pyramid_fbos[_index].unbind();
 
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    uniforms.convolution_pyramids[_index].process(&m_convolution_pyramid_fbos[_index]);
+    m_convolution_pyramid_inputs[_index].version++;
 }
 
 void Sandbox::render() {
 
+    // UPLOAD DECODED IMAGES
+    // -----------------------------------------------
+    // (frames that are going to be saved wait for all of them)
+    uniforms.updateTextures(_isRecording());
+
     // UPDATE STREAMING TEXTURES
     // -----------------------------------------------
-    if (m_initialized)
+    // (tiles of a poster are all the same frame)
+    if (m_initialized && !m_poster) {
+        m_profiler.begin("textures");
         uniforms.updateStreammingTextures();
+        m_profiler.end();
+    }
 
     // RENDER SHADOW MAP
     // -----------------------------------------------
     if (geom_index != -1)
-        if (uniforms.functions["u_lightShadowMap"].present)
+        if (uniforms.functions["u_lightShadowMap"].present) {
+            m_profiler.begin("shadows");
             m_scene.renderShadowMap(uniforms);
+            m_profiler.end();
+        }
     
-    // BUFFERS
+    // UNIFORM BLOCKS
     // -----------------------------------------------
-    if (uniforms.buffers.size() > 0)
-        _renderBuffers();
+    if (uniforms.haveBlocks()) {
+        uniforms.frame.time = _getTime();
+        uniforms.frame.delta = _getDelta();
+        uniforms.frame.frame = (int)m_frame;
+        uniforms.frame.date = getDate();
+        uniforms.frame.resolution = _getResolution();
+        uniforms.frame.mouse = glm::vec2(getMouseX(), getMouseY());
+        uniforms.updateBlocks();
+    }
 
-    if (m_convolution_pyramid_total > 0)
-        _renderConvolutionPyramids();
+    // BUFFERS AND CONVOLUTION PYRAMIDS
+    // -----------------------------------------------
+    if (uniforms.buffers.size() > 0 || m_convolution_pyramid_total > 0)
+        _renderPasses();
     
     // MAIN SCENE
     // ----------------------------------------------- < main scene start
-    if (screenshotFile != "" || m_record)
+    m_profiler.begin(geom_index == -1 ? "canvas" : "scene");
+
+    if (_isRecording())
         if (!m_record_fbo.isAllocated())
             m_record_fbo.allocate(getWindowWidth(), getWindowHeight(), COLOR_TEXTURE_DEPTH_BUFFER);
 
@@ -1000,7 +1278,7 @@ void Sandbox::render() {
         _updateSceneBuffer(getWindowWidth(), getWindowHeight());
         m_scene_fbo.bind();
     }
-    else if (screenshotFile != "" || m_record )
+    else if (_isRecording())
         m_record_fbo.bind();
 
     // Clear the background
@@ -1039,6 +1317,7 @@ void Sandbox::render() {
                 uniforms.getCamera().setVirtualOffset(5.0, viewIndex, holoplay_totalViews);
                 uniforms.set("u_holoPlayTile", float(holoplay_columns), float(holoplay_rows), float(holoplay_totalViews));
                 uniforms.set("u_holoPlayViewport", float(x), float(y), float(qs_viewWidth), float(qs_viewHeight));
+                uniforms.updateBlocks();
 
                 // Update Uniforms and textures variables
                 uniforms.feedTo( m_canvas_shader );
@@ -1097,6 +1376,7 @@ void Sandbox::render() {
                 uniforms.getCamera().setVirtualOffset(m_scene.getArea(), viewIndex, holoplay_totalViews);
                 uniforms.set("u_holoPlayTile", float(holoplay_columns), float(holoplay_rows), float(holoplay_totalViews));
                 uniforms.set("u_holoPlayViewport", float(x), float(y), float(qs_viewWidth), float(qs_viewHeight));
+                uniforms.updateBlocks();
 
                 m_scene.render(uniforms);
 
@@ -1120,12 +1400,16 @@ void Sandbox::render() {
     }
     
     // ----------------------------------------------- < main scene end
+    m_profiler.end();
 
     // POST PROCESSING
+    if (m_postprocessing || m_histogram || _isRecording())
+        m_profiler.begin("postprocessing");
+
     if (m_postprocessing) {
         m_scene_fbo.unbind();
 
-        if (screenshotFile != "" || m_record)
+        if (_isRecording())
             m_record_fbo.bind();
     
         m_postprocessing_shader.use();
@@ -1141,14 +1425,15 @@ void Sandbox::render() {
 
         // Pass textures of buffers
         for (unsigned int i = 0; i < uniforms.buffers.size(); i++)
-            m_postprocessing_shader.setUniformTexture("u_buffer" + toString(i), &uniforms.buffers[i]);
+            if (uniforms.buffers[i])
+                m_postprocessing_shader.setUniformTexture("u_buffer" + toString(i), uniforms.buffers[i]);
 
         m_billboard_vbo->render( &m_postprocessing_shader );
     }
     else if (m_histogram) {
         m_scene_fbo.unbind();
 
-        if (screenshotFile != "" || m_record)
+        if (_isRecording())
             m_record_fbo.bind();
 
         if (!m_billboard_shader.isLoaded())
@@ -1163,7 +1448,7 @@ void Sandbox::render() {
         m_billboard_vbo->render( &m_billboard_shader );
     }
     
-    if (screenshotFile != "" || m_record) {
+    if (_isRecording()) {
         m_record_fbo.unbind();
 
         if (!m_billboard_shader.isLoaded())
@@ -1177,10 +1462,13 @@ void Sandbox::render() {
         m_billboard_shader.setUniformTexture("u_tex0", &m_record_fbo, 0);
         m_billboard_vbo->render( &m_billboard_shader );
     }
+    m_profiler.end();
 }
 
 
 void Sandbox::renderUI() {
+    m_profiler.begin("ui");
+
     // IN PUT TEXTURES
     if (m_showTextures) {        
         glDisable(GL_DEPTH_TEST);
@@ -1240,11 +1528,13 @@ void Sandbox::renderUI() {
             m_billboard_shader.use();
 
             for (unsigned int i = 0; i < uniforms.buffers.size(); i++) {
+                if (!uniforms.buffers[i])
+                    continue;
                 m_billboard_shader.setUniform("u_depth", 0.0f);
                 m_billboard_shader.setUniform("u_scale", xStep, yStep);
                 m_billboard_shader.setUniform("u_translate", xOffset, yOffset);
                 m_billboard_shader.setUniform("u_modelViewProjectionMatrix", getOrthoMatrix());
-                m_billboard_shader.setUniformTexture("u_tex0", &uniforms.buffers[i]);
+                m_billboard_shader.setUniformTexture("u_tex0", uniforms.buffers[i]);
                 m_billboard_vbo->render(&m_billboard_shader);
                 yOffset -= yStep * 2.0;
             }
@@ -1358,12 +1648,19 @@ void Sandbox::renderUI() {
         m_cross_vbo->render(&m_wireframe2D_shader);
         glLineWidth(1.0f);
     }
+
+    m_profiler.end();
 }
 
 void Sandbox::renderDone() {
+    m_profiler.begin("readback");
+
     // RECORD
     if (m_record) {
-        onScreenshot(toString(m_record_counter, 0, 5, '0') + ".png");
+        if (m_record_file != "")
+            onScreenshot(m_record_file);
+        else if (!m_record_raw.isOpen())
+            onScreenshot(toString(m_record_counter, 0, 5, '0') + "." + getPixelsFormat(".png", m_record_options), m_record_options);
 
         m_record_head += m_record_fdelta;
         m_record_counter++;
@@ -1374,13 +1671,42 @@ void Sandbox::renderDone() {
     }
     // SCREENSHOT 
     else if (screenshotFile != "") {
-        onScreenshot(screenshotFile);
+        if (screenshotWidth > 0 && screenshotHeight > 0) {
+            if (_renderPoster(screenshotFile, screenshotWidth, screenshotHeight, screenshotOptions))
+                std::cout << "// Screenshot saved to " << screenshotFile << std::endl;
+        }
+        else {
+            onScreenshot(screenshotFile, screenshotOptions);
+            std::cout << "// Screenshot saved to " << screenshotFile << std::endl;
+        }
+        std::cout << "// > ";
         screenshotFile = "";
+        screenshotOptions = PixelsOptions();
+        screenshotWidth = 0;
+        screenshotHeight = 0;
     }
 
+    // RAW STREAM gets every frame after the first one (which only sets the viewport up)
+    if (m_record_raw.isOpen() && m_initialized)
+        onScreenshot(m_record_raw.getPath());
+
+    #if !defined(PLATFORM_RPI)
+    // Hand the frames that the GPU is done with to the saving threads.
+    // Once nothing else is going to be recorded wait for all of them
+    _updateRecordPbos(!m_record && !m_record_raw.isOpen());
+    #endif
+
+    #ifdef SUPPORT_FOR_LIBAV
+    // All frames are on the encoder queue, let it finish the file on its own thread
+    if (!m_record && m_record_encoder.isOpen())
+        m_record_encoder.close();
+    #endif
+
     if (m_histogram)
         onHistogram();
 
+    m_profiler.end();
+    m_profiler.frame();
 
     unflagChange();
 
@@ -1407,15 +1733,51 @@ void Sandbox::clear() {
 
     if (m_cross_vbo)
         delete m_cross_vbo;
+
+    #if !defined(PLATFORM_RPI)
+    _updateRecordPbos(true);
+    for (size_t i = 0; i < m_record_pbos.size(); i++) {
+        if (m_record_pbos[i].id != 0)
+            glDeleteBuffers(1, &m_record_pbos[i].id);
+        m_record_pbos[i] = RecordPbo();
+    }
+    #endif
+
+    #ifdef SUPPORT_FOR_LIBAV
+    m_record_encoder.close();
+    #endif
+    m_record_raw.close();
+    clearPixelsBuffers();
+
+    m_profiler.clear();
 }
 
-void Sandbox::record(float _start, float _end, float fps) {
+bool Sandbox::record(float _start, float _end, float fps, const std::string& _file, const PixelsOptions& _options) {
+    m_record_file = "";
+    m_record_options = _options;
+    if (VideoEncoder::isVideo(_file)) {
+    #ifdef SUPPORT_FOR_LIBAV
+        if (!m_record_encoder.open(_file, getWindowWidth(), getWindowHeight(), fps))
+            return false;
+        m_record_file = _file;
+    #else
+        std::cout << "// Exporting " << _file << " needs glslViewer to be compiled with LIBAV" << std::endl;
+        return false;
+    #endif
+    }
+
     m_record_fdelta = 1.0/fps;
+    m_record_raw.setFps(fps);
     m_record_start = _start;
     m_record_head = _start;
     m_record_end = _end;
     m_record_counter = 0;
     m_record = true;
+    return true;
+}
+
+bool Sandbox::recordRaw(const std::string& _path) {
+    return m_record_raw.open(_path, 1.0f/getRestSec());
 }
 
 void Sandbox::printDependencies(ShaderType _type) const {
@@ -1530,8 +1892,8 @@ void Sandbox::onMouseDrag(float _x, float _y, int _button) {
 void Sandbox::onViewportResize(int _newWidth, int _newHeight) {
     uniforms.getCamera().setViewport(_newWidth, _newHeight);
     
-    for (unsigned int i = 0; i < uniforms.buffers.size(); i++) 
-        uniforms.buffers[i].allocate(_newWidth, _newHeight, COLOR_TEXTURE);
+    for (unsigned int i = 0; i < m_buffers_fbos.size(); i++) 
+        m_buffers_fbos[i].allocate(_newWidth, _newHeight, COLOR_TEXTURE);
 
     if (m_convolution_pyramid_fbos.size() > 0) {
         for (unsigned int i = 0; i < uniforms.convolution_pyramids.size(); i++) {
@@ -1543,92 +1905,255 @@ void Sandbox::onViewportResize(int _newWidth, int _newHeight) {
     if (m_postprocessing || m_histogram)
         _updateSceneBuffer(_newWidth, _newHeight);
 
-    if (m_record || screenshotFile != "")
+    if (_isRecording())
         m_record_fbo.allocate(_newWidth, _newHeight, COLOR_TEXTURE_DEPTH_BUFFER);
 
     flagChange();
 }
 
-void Sandbox::onScreenshot(std::string _file) {
+void Sandbox::onScreenshot(std::string _file, const PixelsOptions& _options) {
     if (_file != "" && isGL()) {
+        int width = getWindowWidth();
+        int height = getWindowHeight();
+        std::string format = getPixelsFormat(_file, _options);
+        bool hdr = format == "hdr" || format == "pfm";
+        size_t bytes = (size_t)width * height * 4 * (hdr ? sizeof(float) : sizeof(unsigned char));
+
         glBindFramebuffer(GL_FRAMEBUFFER, m_record_fbo.getId());
 
-        if (getExt(_file) == "hdr") {
-            float* pixels = new float[getWindowWidth() * getWindowHeight()*4];
-            glReadPixels(0, 0, getWindowWidth(), getWindowHeight(), GL_RGBA, GL_FLOAT, pixels);
-            savePixelsHDR(_file, pixels, getWindowWidth(), getWindowHeight());
+#if defined(PLATFORM_RPI)
+        auto pixels = takePixelsBuffer(bytes);
+        glReadPixels(0, 0, width, height, GL_RGBA, hdr ? GL_FLOAT : GL_UNSIGNED_BYTE, pixels.get());
+        _savePixels(_file, std::move(pixels), width, height, hdr, _options);
+#else
+        // If the next PBO on the ring is still waiting for the GPU, flush it first
+        RecordPbo* pbo = &m_record_pbos[m_record_pbos_index];
+        if (pbo->pending)
+            _updateRecordPbos(true);
+
+        if (pbo->id == 0)
+            glGenBuffers(1, &pbo->id);
+
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo->id);
+        if (pbo->width != width || pbo->height != height || pbo->hdr != hdr)
+            glBufferData(GL_PIXEL_PACK_BUFFER, bytes, NULL, GL_STREAM_READ);
+
+        // With a PBO bound glReadPixels returns right away, the copy happens on the GPU
+        glReadPixels(0, 0, width, height, GL_RGBA, hdr ? GL_FLOAT : GL_UNSIGNED_BYTE, 0);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+        #ifdef GL_SYNC_GPU_COMMANDS_COMPLETE
+        pbo->fence = (void*)glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        #endif
+        pbo->file = _file;
+        pbo->options = _options;
+        pbo->width = width;
+        pbo->height = height;
+        pbo->hdr = hdr;
+        pbo->pending = true;
+
+        m_record_pbos_index = (m_record_pbos_index + 1) % m_record_pbos.size();
+#endif
+
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+}
+
+bool Sandbox::_renderPoster(const std::string& _file, int _width, int _height, const PixelsOptions& _options) {
+    if (holoplay >= 0) {
+        std::cout << "Screenshots bigger than the window are not supported on holoplay mode" << std::endl;
+        return false;
+    }
+
+    // PNGs can only be written a few rows at a time without compression
+    PixelsOptions options = _options;
+    if (getPixelsFormat(_file, options) == "png" && options.level < 0)
+        options.level = 0;
+
+    std::unique_ptr<PixelsWriter> writer = createPixelsWriter(_file, options);
+    if (!writer) {
+        std::cout << "Can't write " << _file << " in tiles, use png:0, qoi, tga:0, ppm or pfm" << std::endl;
+        return false;
+    }
+
+    if (!writer->open(_file, _width, _height, options))
+        return false;
+
+    // Tiles are the size of m_record_fbo (the window). Only one row of them is kept in memory
+    int tile_width = getWindowWidth();
+    int tile_height = getWindowHeight();
+    int strips = (_height + tile_height - 1) / tile_height;
+    std::vector<unsigned char> tile((size_t)tile_width * tile_height * 4);
+    std::vector<unsigned char> strip((size_t)_width * tile_height * 4);
+
+    // Every tile is the same frame of the same (big) image
+    m_poster = true;
+    m_poster_size = glm::vec2(_width, _height);
+    m_poster_time = float(getTime()) - m_time_offset;
+    Camera& camera = uniforms.getCamera();
+    camera.setViewport(_width, _height);
+
+    bool ok = true;
+    for (int i = 0; i < strips && ok; i++) {
+        // Formats that go top-down start from the top of the image, which is the end for GL
+        int y = (writer->isBottomUp() ? i : strips - 1 - i) * tile_height;
+        int height = std::min(tile_height, _height - y);
+
+        for (int x = 0; x < _width; x += tile_width) {
+            int width = std::min(tile_width, _width - x);
+
+            m_poster_offset = glm::vec2(x, y);
+            camera.setSubview(glm::vec4(float(x) / _width, float(y) / _height, float(tile_width) / _width, float(tile_height) / _height));
+            render();
+
+            glBindFramebuffer(GL_FRAMEBUFFER, m_record_fbo.getId());
+            glReadPixels(0, 0, tile_width, height, GL_RGBA, GL_UNSIGNED_BYTE, &tile[0]);
+            glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+            for (int row = 0; row < height; row++)
+                std::memcpy(&strip[((size_t)row * _width + x) * 4], &tile[(size_t)row * tile_width * 4], (size_t)width * 4);
         }
-        else {
-            int width = getWindowWidth();
-            int height = getWindowHeight();
-            auto pixels = std::unique_ptr<unsigned char[]>(new unsigned char [width * height * 4]);
-            glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, pixels.get());
-
-            /** Just a small helper that captures all the relevant data to save an image **/
-            class Job {
-                std::string m_file_name;
-                int m_width;
-                int m_height;
-                std::unique_ptr<unsigned char[]> m_pixels;
-                std::atomic<int> * m_task_count;
-                std::atomic<long long> * m_max_mem_in_queue;
-
-                long mem_consumed_by_pixels() const { return m_width * m_height * 4; }
-                /** the function that is being invoked when the task is done **/
-                public:
-                void operator()() {
-                    if (m_pixels) {
-                        savePixels(m_file_name, m_pixels.get(), m_width, m_height);
-                        m_pixels = nullptr;
-                        (*m_task_count)--;
-                        (*m_max_mem_in_queue) += mem_consumed_by_pixels();
-                    }
-                }
 
+        ok = writer->addRows(&strip[0], height);
 
-                Job (const Job& ) = delete;
-                Job (Job && ) = default;
-                Job(std::string file_name, int width, int height, std::unique_ptr<unsigned char[]>&& pixels,
-                        std::atomic<int>& task_count, std::atomic<long long>& max_mem_in_queue):
-                    m_file_name(std::move(file_name)),
-                    m_width(width),
-                    m_height(height),
-                    m_pixels(std::move(pixels)),
-                    m_task_count(&task_count),
-                    m_max_mem_in_queue(&max_mem_in_queue) {
-                    if (m_pixels) {
-                        task_count++;
-                        max_mem_in_queue -= mem_consumed_by_pixels();
-                    }
-                }
-            };
+        if (verbose)
+            std::cout << "// " << _file << " " << (i + 1) * 100 / strips << "%" << std::endl;
+    }
 
-            std::shared_ptr<Job> saverPtr = std::make_shared<Job>(std::move(_file), width, height, std::move(pixels), m_task_count, m_max_mem_in_queue);
-            /** In the case that we render faster than we can safe frames, more and more frames
-			 * have to be stored temporary in the save queue. That means that more and more ram is used.
-			 * If to much is memory is used, we save the current frame directly to prevent that the system
-			 * is running out of memory. Otherwise we put the frame in to the thread queue, so that we can utilize
-			 * multilple cpu cores */
-            if (m_max_mem_in_queue <= 0) {
-                Job& saver = *saverPtr;
-                saver();
-            }
-            else {
-                auto func = [saverPtr]()
-                {
-                    Job& saver = *saverPtr;
-                    saver();
-                };
-                m_save_threads.Submit(std::move(func));
-            }
+    m_poster = false;
+    m_poster_offset = glm::vec2(0.0);
+    camera.setSubview(glm::vec4(0.0, 0.0, 1.0, 1.0));
+    camera.setViewport(getWindowWidth(), getWindowHeight());
+
+    return writer->close() && ok;
+}
+
+#if !defined(PLATFORM_RPI)
+void Sandbox::_updateRecordPbos(bool _wait) {
+    // Go through the ring from the oldest frame to the newest one, so frames are handed in order
+    for (size_t i = 0; i < m_record_pbos.size(); i++) {
+        RecordPbo& pbo = m_record_pbos[(m_record_pbos_index + i) % m_record_pbos.size()];
+        if (!pbo.pending)
+            continue;
+
+        #ifdef GL_SYNC_GPU_COMMANDS_COMPLETE
+        if (pbo.fence) {
+            GLsync fence = (GLsync)pbo.fence;
+            GLenum status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+            while (_wait && status == GL_TIMEOUT_EXPIRED)
+                status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+
+            // Stop at the first frame that is not ready yet, the ones after it are not going to be either
+            if (status == GL_TIMEOUT_EXPIRED)
+                return;
+
+            glDeleteSync(fence);
+            pbo.fence = nullptr;
+        }
+        #else
+        // Without fences frames are only collected when the ring is full or when it's flushed
+        if (!_wait)
+            return;
+        #endif
+
+        size_t bytes = (size_t)pbo.width * pbo.height * 4 * (pbo.hdr ? sizeof(float) : sizeof(unsigned char));
+        auto pixels = takePixelsBuffer(bytes);
+
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo.id);
+        void* data = glMapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY);
+        if (data) {
+            std::memcpy(pixels.get(), data, bytes);
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
         }
-    
-        if (!m_record) {
-            std::cout << "// Screenshot saved to " << _file << std::endl;
-            std::cout << "// > ";
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+        pbo.pending = false;
+        if (data)
+            _savePixels(pbo.file, std::move(pixels), pbo.width, pbo.height, pbo.hdr, pbo.options);
+        else
+            std::cout << "Can't read back pixels for " << pbo.file << std::endl;
+    }
+}
+#endif
+
+void Sandbox::_savePixels(const std::string& _file, std::unique_ptr<unsigned char[]>&& _pixels, int _width, int _height, bool _hdr, const PixelsOptions& _options) {
+
+    #ifdef SUPPORT_FOR_LIBAV
+    // Frames of a video go, in order, to the encoder thread instead of the image savers
+    if (m_record_encoder.isOpen() && _file == m_record_encoder.getPath()) {
+        m_record_encoder.addFrame(std::move(_pixels), _width, _height);
+        return;
+    }
+    #endif
+
+    if (m_record_raw.isOpen() && _file == m_record_raw.getPath()) {
+        m_record_raw.addFrame(std::move(_pixels), _width, _height);
+        return;
+    }
+
+    /** Just a small helper that captures all the relevant data to save an image **/
+    class Job {
+        std::string m_file_name;
+        int m_width;
+        int m_height;
+        bool m_hdr;
+        PixelsOptions m_options;
+        std::unique_ptr<unsigned char[]> m_pixels;
+        std::atomic<int> * m_task_count;
+        std::atomic<long long> * m_max_mem_in_queue;
+
+        long mem_consumed_by_pixels() const { return m_width * m_height * 4 * (m_hdr ? sizeof(float) : 1); }
+        /** the function that is being invoked when the task is done **/
+        public:
+        void operator()() {
+            if (m_pixels) {
+                if (m_hdr)
+                    savePixelsHDR(m_file_name, (float*)m_pixels.get(), m_width, m_height, m_options);
+                else
+                    savePixels(m_file_name, m_pixels.get(), m_width, m_height, m_options);
+                recyclePixelsBuffer(std::move(m_pixels), mem_consumed_by_pixels());
+                (*m_task_count)--;
+                (*m_max_mem_in_queue) += mem_consumed_by_pixels();
+            }
         }
 
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+        Job (const Job& ) = delete;
+        Job (Job && ) = default;
+        Job(std::string file_name, int width, int height, bool hdr, const PixelsOptions& options, std::unique_ptr<unsigned char[]>&& pixels,
+                std::atomic<int>& task_count, std::atomic<long long>& max_mem_in_queue):
+            m_file_name(std::move(file_name)),
+            m_width(width),
+            m_height(height),
+            m_hdr(hdr),
+            m_options(options),
+            m_pixels(std::move(pixels)),
+            m_task_count(&task_count),
+            m_max_mem_in_queue(&max_mem_in_queue) {
+            if (m_pixels) {
+                task_count++;
+                max_mem_in_queue -= mem_consumed_by_pixels();
+            }
+        }
+    };
+
+    std::shared_ptr<Job> saverPtr = std::make_shared<Job>(_file, _width, _height, _hdr, _options, std::move(_pixels), m_task_count, m_max_mem_in_queue);
+    /** In the case that we render faster than we can safe frames, more and more frames
+     * have to be stored temporary in the save queue. That means that more and more ram is used.
+     * If to much is memory is used, we save the current frame directly to prevent that the system
+     * is running out of memory. Otherwise we put the frame in to the thread queue, so that we can utilize
+     * multilple cpu cores */
+    if (m_max_mem_in_queue <= 0) {
+        Job& saver = *saverPtr;
+        saver();
+    }
+    else {
+        auto func = [saverPtr]()
+        {
+            Job& saver = *saverPtr;
+            saver();
+        };
+        m_save_threads.Submit(std::move(func));
     }
 }
 
@@ -2,10 +2,16 @@
 
 #include "scene/scene.h"
 #include "types/list.h"
+#include "io/videoEncoder.h"
+#include "io/rawStream.h"
+#include "io/pixels.h"
+#include "tools/profiler.h"
+#include "tools/renderGraph.h"
 
 #include "thread_pool/thread_pool.hpp"
 
 #include <atomic>
+#include <memory>
 
 enum ShaderType {
     FRAGMENT = 0,
@@ -33,8 +39,15 @@ public:
     
     bool                isReady();
 
-    void                record( float _start, float _end, float fps = 24.0 );
+    bool                record( float _start, float _end, float fps = 24.0, const std::string& _file = "", const PixelsOptions& _options = PixelsOptions() );
     int                 getRecordedPercentage();
+    // False once the last frame of a recording is saved and handed to the encoder
+    bool                isRecording() const { return m_record; }
+
+    bool                recordRaw( const std::string& _path );
+
+    // Advance u_time a fixed amount of seconds each frame instead of following the clock (0 to go back to it)
+    void                setTimeStep( float _step ) { m_time_step = _step; }
 
     void                addDefine( const std::string &_define, const std::string &_value = "");
     void                delDefine( const std::string &_define );
@@ -45,13 +58,16 @@ public:
 
     void                printDependencies( ShaderType _type ) const;
 
+    // CPU and GPU time of each pass
+    Profiler&           getProfiler() { return m_profiler; }
+
     
     // Some events
     void                onScroll( float _yoffset );
     void                onMouseDrag( float _x, float _y, int _button );
     void                onViewportResize( int _newWidth, int _newHeight );
     void                onFileChange( WatchFileList &_files, int _index );
-    void                onScreenshot( std::string _file );
+    void                onScreenshot( std::string _file, const PixelsOptions& _options = PixelsOptions() );
     void                onHistogram();
    
     // Include folders
@@ -60,8 +76,13 @@ public:
     // Uniforms
     Uniforms            uniforms;
 
-    // Screenshot file
+    // Screenshot file (and how to encode it)
     std::string         screenshotFile;
+    PixelsOptions       screenshotOptions;
+
+    // Screenshot size when it's not the one of the window, it gets rendered in tiles
+    int                 screenshotWidth;
+    int                 screenshotHeight;
 
     // States
     int                 frag_index;
@@ -78,12 +99,43 @@ private:
     void                _updateSceneBuffer(int _width, int _height);
     void                _updateConvolutionPyramids();
     void                _updateBuffers();
-    void                _renderConvolutionPyramids();
-    void                _renderBuffers();
+    void                _updateRenderGraph();
+    void                _renderPasses();
+    void                _renderBuffer(unsigned int _index);
+    void                _renderConvolutionPyramid(unsigned int _index);
+
+    // What a buffer or pyramid read the last time it was rendered, passes whose inputs didn't change are skipped
+    struct PassInputs {
+        std::vector<std::string>    names;      // active uniforms
+        std::vector<size_t>         passes;     // buffers and pyramids it reads (by their index on the render graph)
+        std::vector<unsigned int>   versions;   // how many times each of them was rendered
+        std::unordered_map<GLint, std::string> values;          // sent to its shader (see Shader::beginWatch)
+        std::unordered_map<GLint, std::string> extra_values;
+        bool                        always = false;             // reads something that can't be watched
+        GLuint                      program = 0;
+        GLuint                      extra_program = 0;
+        unsigned int                version = 0;
+    };
+    bool                _isPassDirty(PassInputs& _pass, size_t _node, Shader& _shader, Shader* _extra = nullptr);
+    unsigned int        _getPassVersion(size_t _node);
+
+    // Clock and viewport as seen by the shaders (recordings, posters and fixed time steps have their own)
+    float               _getTime() const;
+    float               _getDelta() const;
+    glm::vec2           _getResolution() const;
+
+    bool                _isRecording() const { return screenshotFile != "" || m_record || m_record_raw.isOpen(); }
+    void                _savePixels(const std::string& _file, std::unique_ptr<unsigned char[]>&& _pixels, int _width, int _height, bool _hdr, const PixelsOptions& _options);
+    bool                _renderPoster(const std::string& _file, int _width, int _height, const PixelsOptions& _options);
+#if !defined(PLATFORM_RPI)
+    void                _updateRecordPbos(bool _wait);
+#endif
 
     // Main Shader
     std::string         m_frag_source;
     std::string         m_vert_source;
+    SourceInfo          m_frag_info;
+    SourceInfo          m_vert_info;
 
     // Dependencies
     List                m_vert_dependencies;
@@ -92,6 +144,15 @@ private:
     // Buffers
     std::vector<Shader> m_buffers_shaders;
     int                 m_buffers_total;
+    std::vector<PassInputs> m_buffers_inputs;
+    std::vector<Fbo>    m_buffers_fbos;
+    std::vector<int>    m_buffers_fbos_owners;  // buffer that rendered last on each FBO
+
+    // Order of the buffers and pyramids, and which FBO each buffer renders to
+    RenderGraph         m_render_graph;
+    bool                m_render_graph_showPasses;
+    bool                m_render_graph_change;
+    unsigned long long  m_render_graph_links;
 
     // A. CANVAS
     Shader              m_canvas_shader;
@@ -105,6 +166,7 @@ private:
     std::vector<Shader> m_convolution_pyramid_subshaders;
     Shader              m_convolution_pyramid_shader;
     int                 m_convolution_pyramid_total;
+    std::vector<PassInputs> m_convolution_pyramid_inputs;
 
     // Postprocessing
     Shader              m_postprocessing_shader;
@@ -126,6 +188,36 @@ private:
     float               m_record_end;
     int                 m_record_counter;
     bool                m_record;
+    std::string         m_record_file;
+    PixelsOptions       m_record_options;
+
+#ifdef SUPPORT_FOR_LIBAV
+    VideoEncoder        m_record_encoder;
+#endif
+    RawStream           m_record_raw;
+
+    // Poster (screenshots rendered in tiles)
+    glm::vec2           m_poster_size;
+    glm::vec2           m_poster_offset;
+    float               m_poster_time;
+    bool                m_poster;
+
+#if !defined(PLATFORM_RPI)
+    // Ring of Pixel Buffer Objects used to read back the recorded frames
+    // without stalling the render loop until the GPU is done with them
+    struct RecordPbo {
+        std::string     file;
+        PixelsOptions   options;
+        GLuint          id      = 0;
+        void*           fence   = nullptr;
+        int             width   = 0;
+        int             height  = 0;
+        bool            hdr     = false;
+        bool            pending = false;
+    };
+    std::vector<RecordPbo>  m_record_pbos;
+    size_t                  m_record_pbos_index = 0;
+#endif
 
     // Histogram
     Shader              m_histogram_shader;
@@ -135,6 +227,7 @@ private:
     // Other state properties
     glm::mat3           m_view2d;
     float               m_time_offset;
+    float               m_time_step;
     float               m_lat;
     float               m_lon;
     unsigned int        m_frame;
@@ -145,6 +238,7 @@ private:
     //  Debug
     bool                m_showTextures;
     bool                m_showPasses;
+    Profiler            m_profiler;
     
     std::atomic<int>        m_task_count {0};
     std::atomic<long long>  m_max_mem_in_queue {0};
@@ -11,7 +11,7 @@
 // static const float MAX_SENSITIVITY = 204800.0f;
 
 Camera::Camera(): 
-    m_target(0.0), 
+    m_target(0.0), m_subview(0.0, 0.0, 1.0, 1.0),
     m_aspect(4.0f/3.0f), m_fov(45.), m_nearClip(0.01f), m_farClip(1000.0f), 
     m_exposure(2.60417e-05), m_ev100(14.9658), m_aperture(16), m_shutterSpeed(1.0f/125.0f), m_sensitivity(100.0f), 
     m_type(CameraType::PERSPECTIVE) {
@@ -56,6 +56,11 @@ void Camera::setDistance(float _distance) {
     lookAt(m_target);
 }
 
+void Camera::setSubview(const glm::vec4& _region) {
+    m_subview = _region;
+    updateCameraSettings();
+}
+
 void Camera::setVirtualOffset(float scale, int currentViewIndex, int totalViews) {
     // The standard model Looking Glass screen is roughly 4.75" vertically. If we
     // assume the average viewing distance for a user sitting at their desk is
@@ -172,6 +177,13 @@ void Camera::updateCameraSettings() {
         m_projectionMatrix = glm::ortho(-1.5f * float(m_aspect), 1.5f * float(m_aspect), -1.5f, 1.5f, -10.0f, 10.f);
     else
         m_projectionMatrix = glm::perspective(m_fov, m_aspect, m_nearClip, m_farClip);
+
+    // Scale and move the region to fill the clip space
+    if (m_subview != glm::vec4(0.0, 0.0, 1.0, 1.0)) {
+        glm::mat4 subview = glm::scale(glm::mat4(1.0), glm::vec3(1.0f / m_subview.z, 1.0f / m_subview.w, 1.0f));
+        subview = glm::translate(subview, glm::vec3(1.0f - 2.0f * m_subview.x - m_subview.z, 1.0f - 2.0f * m_subview.y - m_subview.w, 0.0f));
+        m_projectionMatrix = subview * m_projectionMatrix;
+    }
     
     updateProjectionViewMatrix();
 }
@@ -21,6 +21,10 @@ public:
     virtual void        setTarget(glm::vec3 _target);
     virtual void        setVirtualOffset(float _scale, int _currentViewIndex, int _totalViews);
 
+    // Restrict the projection to a region of the image (x, y, width, height normalized, from the bottom left).
+    // Used to render it in tiles, (0, 0, 1, 1) is the whole image
+    virtual void        setSubview(const glm::vec4& _region);
+
     virtual void        setExposure(float _aperture, float _shutterSpeed, float _sensitivity);
 
     virtual glm::vec3   worldToCamera(glm::vec3 _WorldXYZ) const;
@@ -39,6 +43,7 @@ public:
     const float         getShutterSpeed() const { return m_shutterSpeed; }  //! returns this camera's shutter speed in seconds
     const float         getSensitivity() const { return m_sensitivity; }    //! returns this camera's sensitivity in ISO
     const glm::vec3     getTarget() const { return m_target; }
+    const glm::vec4&    getSubview() const { return m_subview; }
     
     const CameraType&   getType() const { return m_type;};
     virtual glm::vec3   getPosition() const;
@@ -65,6 +70,7 @@ private:
     glm::mat3   m_normalMatrix;
 
     glm::vec3   m_target;
+    glm::vec4   m_subview;
 
     double      m_aspect;
     double      m_fov;
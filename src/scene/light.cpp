@@ -42,6 +42,27 @@ Light::Light(glm::vec3 _pos, glm::vec3 _dir, float _falloff): m_mvp_biased(1.0),
     falloff = _falloff;
 }
 
+Light::Light(const Light& _other): Node(_other) {
+    *this = _other;
+}
+
+Light& Light::operator=(const Light& _other) {
+    if (this == &_other)
+        return *this;
+
+    Node::operator=(_other);
+    color = _other.color;
+    direction = _other.direction;
+    intensity = _other.intensity;
+    falloff = _other.falloff;
+    m_mvp_biased = _other.m_mvp_biased;
+    m_mvp = _other.m_mvp;
+    m_type = _other.m_type;
+    std::copy(_other.m_viewport, _other.m_viewport+4, m_viewport);
+    bChange = true;
+    return *this;
+}
+
 Light::~Light() {
 }
 
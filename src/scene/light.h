@@ -13,6 +13,9 @@ public:
     Light(glm::vec3 _dir);
     Light(glm::vec3 _pos, float _falloff);
     Light(glm::vec3 _pos, glm::vec3 _dir, float _falloff = -1.0);
+    // Copies don't take the shadow map (the GL objects belong to the original), they make their own
+    Light(const Light& _other);
+    Light& operator=(const Light& _other);
     virtual ~Light();
 
     const LightType&    getType() const { return m_type; }
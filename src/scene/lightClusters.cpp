@@ -0,0 +1,145 @@
+#include "lightClusters.h"
+
+#include <cmath>
+#include <algorithm>
+
+#define CLUSTERS_X      16
+#define CLUSTERS_Y      8
+#define CLUSTERS_Z      24
+#define INDICES_WIDTH   256
+
+// The textures hold data, not images
+static void loadData(Texture& _texture, int _width, int _height, const std::vector<unsigned char>& _data) {
+    _texture.load(_width, _height, 4, 8, &_data[0]);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+LightClusters::LightClusters(): m_size(0.0f), m_depth(0.0f) {
+}
+
+LightClusters::~LightClusters() {
+    clear();
+}
+
+void LightClusters::update(const std::vector<Light>& _lights, const Camera& _camera, const glm::mat4& _model, bool _cull) {
+    int total_lights = std::min((int)_lights.size(), LIGHTS_MAX);
+    int size_x = _cull ? CLUSTERS_X : 1;
+    int size_y = _cull ? CLUSTERS_Y : 1;
+    int size_z = _cull ? CLUSTERS_Z : 1;
+
+    float near_clip = _camera.getNearClip();
+    float far_clip = _camera.getFarClip();
+    float slices_scale = size_z / log(far_clip / near_clip);
+    m_size = glm::vec4(size_x, size_y, size_z, total_lights);
+    m_depth = glm::vec3(near_clip, far_clip, slices_scale);
+
+    m_lists.resize(size_x * size_y * size_z);
+    for (size_t i = 0; i < m_lists.size(); i++)
+        m_lists[i].clear();
+
+    glm::mat4 view = _camera.getViewMatrix() * _model;
+    glm::mat4 projection = _camera.getProjectionMatrix();
+
+    // Rendering a tile of a big screenshot, the clusters still split the whole view
+    glm::vec4 region = _camera.getSubview();
+    if (region != glm::vec4(0.0, 0.0, 1.0, 1.0)) {
+        glm::mat4 subview = glm::scale(glm::mat4(1.0), glm::vec3(1.0f / region.z, 1.0f / region.w, 1.0f));
+        subview = glm::translate(subview, glm::vec3(1.0f - 2.0f * region.x - region.z, 1.0f - 2.0f * region.y - region.w, 0.0f));
+        projection = glm::inverse(subview) * projection;
+    }
+
+    for (int l = 0; l < total_lights; l++) {
+        const Light& light = _lights[l];
+
+        // Clusters the sphere of the light reaches. Without falloff (or culling) that is all of them
+        int x0 = 0, x1 = size_x - 1;
+        int y0 = 0, y1 = size_y - 1;
+        int z0 = 0, z1 = size_z - 1;
+
+        if (_cull && light.falloff > 0.0f && light.getType() != LIGHT_DIRECTIONAL) {
+            glm::vec3 center = glm::vec3(view * glm::vec4(light.getPosition(), 1.0f));
+            float radius = light.falloff;
+            float depth_min = -center.z - radius;
+            float depth_max = -center.z + radius;
+            if (depth_max < near_clip || depth_min > far_clip)
+                continue;
+
+            float from = std::max(depth_min, near_clip);
+            float to = std::min(depth_max, far_clip);
+            z0 = glm::clamp((int)floor(log(from / near_clip) * slices_scale), 0, size_z - 1);
+            z1 = glm::clamp((int)floor(log(to / near_clip) * slices_scale), 0, size_z - 1);
+
+            // Crossing the near plane its projection has no bounds
+            if (depth_min > near_clip) {
+                glm::vec2 ndc_min = glm::vec2(1e10f);
+                glm::vec2 ndc_max = glm::vec2(-1e10f);
+                for (int c = 0; c < 8; c++) {
+                    glm::vec4 corner = glm::vec4(   center.x + ((c & 1) ? radius : -radius),
+                                                    center.y + ((c & 2) ? radius : -radius),
+                                                    (c & 4) ? -from : -to, 1.0f);
+                    corner = projection * corner;
+                    glm::vec2 ndc = glm::vec2(corner) / corner.w;
+                    ndc_min = glm::min(ndc_min, ndc);
+                    ndc_max = glm::max(ndc_max, ndc);
+                }
+
+                if (ndc_max.x < -1.0f || ndc_max.y < -1.0f || ndc_min.x > 1.0f || ndc_min.y > 1.0f)
+                    continue;
+
+                x0 = glm::clamp((int)floor((ndc_min.x * 0.5f + 0.5f) * size_x), 0, size_x - 1);
+                x1 = glm::clamp((int)floor((ndc_max.x * 0.5f + 0.5f) * size_x), 0, size_x - 1);
+                y0 = glm::clamp((int)floor((ndc_min.y * 0.5f + 0.5f) * size_y), 0, size_y - 1);
+                y1 = glm::clamp((int)floor((ndc_max.y * 0.5f + 0.5f) * size_y), 0, size_y - 1);
+            }
+        }
+
+        for (int z = z0; z <= z1; z++)
+            for (int y = y0; y <= y1; y++)
+                for (int x = x0; x <= x1; x++)
+                    m_lists[(z * size_y + y) * size_x + x].push_back((unsigned char)l);
+    }
+
+    // Flatten the lists
+    std::vector<unsigned char> clusters(m_lists.size() * 4);
+    std::vector<unsigned char> indices;
+    for (size_t i = 0; i < m_lists.size(); i++) {
+        size_t offset = indices.size() / 4;
+        clusters[i * 4 + 0] = offset & 255;
+        clusters[i * 4 + 1] = (offset >> 8) & 255;
+        clusters[i * 4 + 2] = (unsigned char)m_lists[i].size();
+        clusters[i * 4 + 3] = (offset >> 16) & 255;
+        for (size_t j = 0; j < m_lists[i].size(); j++) {
+            indices.push_back(m_lists[i][j]);
+            indices.push_back(0);
+            indices.push_back(0);
+            indices.push_back(255);
+        }
+    }
+
+    // At least one row, and full ones
+    size_t rows = std::max((size_t)1, (indices.size() / 4 + INDICES_WIDTH - 1) / INDICES_WIDTH);
+    indices.resize(rows * INDICES_WIDTH * 4, 0);
+
+    // Only upload what changed (ex: when the camera moves)
+    if (clusters != m_clusters || m_clusters_tex.getTextureId() == 0) {
+        m_clusters.swap(clusters);
+        loadData(m_clusters_tex, size_x * size_y, size_z, m_clusters);
+    }
+
+    if (indices != m_indices || m_indices_tex.getTextureId() == 0) {
+        m_indices.swap(indices);
+        loadData(m_indices_tex, INDICES_WIDTH, (int)rows, m_indices);
+    }
+}
+
+void LightClusters::clear() {
+    m_clusters_tex.clear();
+    m_indices_tex.clear();
+    m_clusters.clear();
+    m_indices.clear();
+    m_lists.clear();
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <vector>
+
+#include "light.h"
+#include "camera.h"
+
+#include "../gl/texture.h"
+
+// Lights read by the shaders through arrays (u_lightsPosition, u_lightsColor, ...) can't be more than these
+#define LIGHTS_MAX 64
+
+// Splits the view frustum in a grid of clusters (froxels) and lists the lights reaching each one,
+// so shaders only go over the lights that can touch their fragment. It's made on the CPU and
+// handed to the shaders as two textures (RGBA, 8 bits):
+//  - clusters: one texel per cluster (x + y * width, slice). Offset of its list (r + g * 256 + a * 65536) and length (b)
+//  - indices: the lists, one light (its index on the arrays) per texel on the red channel, 256 texels per row
+class LightClusters {
+public:
+    LightClusters();
+    virtual ~LightClusters();
+
+    // _model takes the light positions to the space of the camera (ex: the scene origin).
+    // Without _cull there is a single cluster with all the lights (ex: orthographic cameras)
+    void            update(const std::vector<Light>& _lights, const Camera& _camera, const glm::mat4& _model, bool _cull = true);
+
+    Texture*        getClusters() { return &m_clusters_tex; }
+    Texture*        getIndices() { return &m_indices_tex; }
+
+    // Clusters on x, y and z (slices), and the number of lights
+    glm::vec4       getSize() const { return m_size; }
+    // Near, far and slices / log(far / near), to find the slice of a depth
+    glm::vec3       getDepth() const { return m_depth; }
+
+    void            clear();
+
+private:
+    std::vector< std::vector<unsigned char> > m_lists;
+    std::vector<unsigned char>  m_clusters;
+    std::vector<unsigned char>  m_indices;
+
+    Texture         m_clusters_tex;
+    Texture         m_indices_tex;
+
+    glm::vec4       m_size;
+    glm::vec3       m_depth;
+};
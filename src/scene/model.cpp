@@ -3,6 +3,9 @@
 #include "tools/text.h"
 #include "tools/geom.h"
 
+// Set on every draw of every model, by handle to skip looking it up by name
+static const UniformHandle<glm::mat4> u_modelViewProjectionMatrix("u_modelViewProjectionMatrix");
+
 Model::Model():
     m_model_vbo(nullptr), m_bbox_vbo(nullptr), 
     m_bbmin(100000.0), m_bbmax(-1000000.),
@@ -130,7 +133,7 @@ void Model::render(Uniforms& _uniforms, const glm::mat4& _viewProjectionMatrix)
         _uniforms.feedTo( m_shader);
 
         // Pass special uniforms
-        m_shader.setUniform( "u_modelViewProjectionMatrix", _viewProjectionMatrix);
+        m_shader.setUniform( u_modelViewProjectionMatrix, _viewProjectionMatrix);
         render( &m_shader );
     }
 }
@@ -23,6 +23,7 @@ public:
     bool        loadMaterial(const Material& _material);
 
     bool        loaded() const { return m_model_vbo != nullptr; }
+    Shader&     getShader() { return m_shader; }
     void        clear();
 
     void        setName(const std::string& _str);
@@ -7,6 +7,7 @@
 #endif
 
 #include <sys/stat.h>
+#include <algorithm>
 
 #include "io/fs.h"
 #include "tools/geom.h"
@@ -19,6 +20,13 @@
 #include "../io/gltf.h"
 #include "../io/stl.h"
 
+// Set for every draw of the scene, by handle to skip looking them up by name
+static const UniformHandle<glm::vec3> u_model("u_model");
+static const UniformHandle<glm::mat4> u_modelMatrix("u_modelMatrix");
+static const UniformHandle<glm::vec2> u_lightClustersIndicesResolution("u_lightClustersIndicesResolution");
+static const UniformHandle<glm::vec4> u_lightClustersSize("u_lightClustersSize");
+static const UniformHandle<glm::vec3> u_lightClustersDepth("u_lightClustersDepth");
+
 Scene::Scene(): 
     // Debug State
     showGrid(false), showAxis(false), showBBoxes(false), showCubebox(false), 
@@ -53,6 +61,7 @@ void Scene::clear() {
         delete m_lightUI_vbo;
         m_lightUI_vbo = nullptr;
     }
+    m_light_clusters.clear();
 
     if (!m_background_vbo) {
         delete m_background_vbo;
@@ -390,12 +399,33 @@ void Scene::setup(CommandList& _commands, Uniforms& _uniforms) {
     "bboxes[,on|off]                    show/hide models bounding boxes"));
     
     _uniforms.functions["u_model"] = UniformFunction("vec3", [this](Shader& _shader) {
-        _shader.setUniform("u_model", m_origin.getPosition());
+        _shader.setUniform(u_model, m_origin.getPosition());
     },
     [this]() { return toString(m_origin.getPosition(), ','); });
 
     _uniforms.functions["u_modelMatrix"] = UniformFunction("mat4", [this](Shader& _shader) {
-        _shader.setUniform("u_modelMatrix", m_origin.getTransformMatrix() );
+        _shader.setUniform(u_modelMatrix, m_origin.getTransformMatrix() );
+    });
+
+    // Lights reaching each cluster of the view (see LightClusters)
+    _uniforms.functions["u_lightClusters"] = UniformFunction("sampler2D", [this](Shader& _shader) {
+        _shader.setUniformTexture("u_lightClusters", m_light_clusters.getClusters(), _shader.textureIndex++ );
+    });
+
+    _uniforms.functions["u_lightClustersIndices"] = UniformFunction("sampler2D", [this](Shader& _shader) {
+        _shader.setUniformTexture("u_lightClustersIndices", m_light_clusters.getIndices(), _shader.textureIndex++ );
+    });
+
+    _uniforms.functions["u_lightClustersIndicesResolution"] = UniformFunction("vec2", [this](Shader& _shader) {
+        _shader.setUniform(u_lightClustersIndicesResolution, glm::vec2(m_light_clusters.getIndices()->getWidth(), m_light_clusters.getIndices()->getHeight()));
+    });
+
+    _uniforms.functions["u_lightClustersSize"] = UniformFunction("vec4", [this](Shader& _shader) {
+        _shader.setUniform(u_lightClustersSize, m_light_clusters.getSize());
+    });
+
+    _uniforms.functions["u_lightClustersDepth"] = UniformFunction("vec3", [this](Shader& _shader) {
+        _shader.setUniform(u_lightClustersDepth, m_light_clusters.getDepth());
     });
     
 }
@@ -487,21 +517,21 @@ bool Scene::loadGeometry(Uniforms& _uniforms, WatchFileList& _files, int _index,
     return true;
 }
 
-bool Scene::loadShaders(const std::string& _fragmentShader, const std::string& _vertexShader, bool _verbose) {
+bool Scene::loadShaders(const std::string& _fragmentShader, const std::string& _vertexShader, const SourceInfo& _fragmentInfo, const SourceInfo& _vertexInfo, bool _verbose) {
     bool rta = true;
     for (unsigned int i = 0; i < m_models.size(); i++)
         if ( !m_models[i]->loadShader( _fragmentShader, _vertexShader, _verbose) )
             rta = false;
 
 
-    m_background = check_for_background(_fragmentShader);
+    m_background = _fragmentInfo.haveBackground();
     if (m_background) {
         // Specific defines for this buffer
         m_background_shader.addDefine("BACKGROUND");
         m_background_shader.load(_fragmentShader, getDefaultSrc(VERT_BILLBOARD), false);
     }
 
-    bool thereIsFloorDefine = check_for_floor(_fragmentShader) || check_for_floor(_vertexShader);
+    bool thereIsFloorDefine = _fragmentInfo.haveFloor() || _vertexInfo.haveFloor();
     if (thereIsFloorDefine) {
         m_floor_shader.load(_fragmentShader, _vertexShader, false);
         if (m_floor_subd == -1)
@@ -511,6 +541,28 @@ bool Scene::loadShaders(const std::string& _fragmentShader, const std::string& _
     return rta;
 }
 
+std::vector<std::string> Scene::getActiveUniforms() {
+    std::vector<Shader*> shaders;
+    for (unsigned int i = 0; i < m_models.size(); i++)
+        shaders.push_back( &m_models[i]->getShader() );
+    if (m_background)
+        shaders.push_back( &m_background_shader );
+    shaders.push_back( &m_floor_shader );
+
+    std::vector<std::string> names;
+    for (unsigned int i = 0; i < shaders.size(); i++) {
+        // Compile pending define changes first
+        if (shaders[i]->getProgram() != 0)
+            shaders[i]->use();
+
+        std::vector<std::string> active = shaders[i]->getActiveUniforms();
+        for (unsigned int j = 0; j < active.size(); j++)
+            if (std::find(names.begin(), names.end(), active[j]) == names.end())
+                names.push_back(active[j]);
+    }
+    return names;
+}
+
 void Scene::flagChange() {
     m_origin.bChange = true;
 }
@@ -563,6 +615,11 @@ void Scene::render(Uniforms& _uniforms) {
 
     if (_uniforms.getCamera().bChange || m_origin.bChange)
         m_mvp = _uniforms.getCamera().getProjectionViewMatrix() * m_origin.getTransformMatrix(); 
+
+    // Only shaders with more than one light loop over the clusters (LIGHT_CLUSTERS). The shader finds the slices
+    // of plain perspective projections, the rest (ortho, holoplay views) get one cluster with all the lights
+    if (_uniforms.lights.size() > 1 && _uniforms.functions["u_lightClusters"].present)
+        m_light_clusters.update(_uniforms.lights, _uniforms.getCamera(), m_origin.getTransformMatrix(), _uniforms.getCamera().getType() == PERSPECTIVE);
     
     renderFloor(_uniforms, m_mvp);
 
@@ -609,19 +666,18 @@ void Scene::renderShadowMap(Uniforms& _uniforms) {
         }
     }
 
-    if ( m_dynamicShadows || changeOnLights || m_origin.bChange ) {
-        for (unsigned int i = 0; i < _uniforms.lights.size(); i++) {
-            // Temporally move the MVP matrix from the view of the light 
-            glm::mat4 mvp = _uniforms.lights[i].getMVPMatrix( m_origin.getTransformMatrix(), m_area );
-            _uniforms.lights[i].bindShadowMap();
+    // Only the first light has a shadow map on the shaders (u_lightShadowMap)
+    if ( _uniforms.lights.size() > 0 && (m_dynamicShadows || changeOnLights || m_origin.bChange) ) {
+        // Temporally move the MVP matrix from the view of the light 
+        glm::mat4 mvp = _uniforms.lights[0].getMVPMatrix( m_origin.getTransformMatrix(), m_area );
+        _uniforms.lights[0].bindShadowMap();
 
-            renderFloor(_uniforms, mvp);
+        renderFloor(_uniforms, mvp);
 
-            for (unsigned int i = 0; i < m_models.size(); i++)
-                m_models[i]->render(_uniforms, mvp);
+        for (unsigned int i = 0; i < m_models.size(); i++)
+            m_models[i]->render(_uniforms, mvp);
 
-            _uniforms.lights[i].unbindShadowMap();
-        }
+        _uniforms.lights[0].unbindShadowMap();
     }
 #endif
 }
@@ -37,7 +37,10 @@ public:
     void            clear();
 
     bool            loadGeometry(Uniforms& _uniforms, WatchFileList& _files, int _index, bool _verbose);
-    bool            loadShaders(const std::string& _fragmentShader, const std::string& _vertexShader, bool _verbose);
+    bool            loadShaders(const std::string& _fragmentShader, const std::string& _vertexShader, const SourceInfo& _fragmentInfo, const SourceInfo& _vertexInfo, bool _verbose);
+
+    // Uniforms used by the shaders of the models, the background and the floor
+    std::vector<std::string> getActiveUniforms();
 
 
     void            addDefine(const std::string& _define, const std::string& _value);
@@ -89,6 +92,7 @@ protected:
     Vbo*                m_lightUI_vbo;
     Shader              m_lightUI_shader;
     bool                m_dynamicShadows;
+    LightClusters       m_light_clusters;
 
     // Background
     Shader              m_background_shader;
@@ -136,13 +136,46 @@ void main(void) {
 )";
 
 const std::string default_scene_frag0 = R"(
+// Uniform blocks need GLSL 1.40 (or ARB_uniform_buffer_object)
+#if defined(UNIFORM_BLOCKS) && !defined(GL_ES) && __VERSION__ < 140
+#extension GL_ARB_uniform_buffer_object : enable
+#endif
+#if defined(UNIFORM_BLOCKS) && __VERSION__ < 140 && !defined(GL_ARB_uniform_buffer_object)
+#undef UNIFORM_BLOCKS
+#endif
 
 #ifdef GL_ES
 precision mediump float;
 #endif
 
+#ifdef UNIFORM_BLOCKS
+layout(std140) uniform CameraBlock {
+    mat4    u_viewMatrix;
+    mat4    u_projectionMatrix;
+    mat3    u_normalMatrix;
+    vec3    u_camera;
+    float   u_cameraDistance;
+    float   u_cameraNearClip;
+    float   u_cameraFarClip;
+    float   u_cameraEv100;
+    float   u_cameraExposure;
+    float   u_cameraAperture;
+    float   u_cameraShutterSpeed;
+    float   u_cameraSensitivity;
+};
+
+layout(std140) uniform FrameBlock {
+    vec4    u_date;
+    vec2    u_resolution;
+    vec2    u_mouse;
+    float   u_time;
+    float   u_delta;
+    int     u_frame;
+};
+#else
 uniform vec3    u_camera;
 uniform vec2    u_resolution;
+#endif
 
 varying vec4    v_position;
 
@@ -233,10 +266,20 @@ float linear2gamma(in float v) {
 #ifndef HEADER_LIGHT
 #define HEADER_LIGHT
 
+#ifdef UNIFORM_BLOCKS
+layout(std140) uniform LightsBlock {
+    vec3        u_light;
+    float       u_lightIntensity;
+    vec3        u_lightColor;
+    float       u_lightFalloff;
+    vec3        u_lightDirection;
+};
+#else
 uniform vec3        u_light;
 uniform vec3        u_lightColor;
 uniform float       u_lightFalloff;
 uniform float       u_lightIntensity;
+#endif
 
 #ifdef LIGHT_SHADOWMAP
 uniform sampler2D   u_lightShadowMap;
@@ -244,6 +287,32 @@ uniform mat4        u_lightMatrix;
 varying vec4        v_lightCoord;
 #endif
 
+// All the lights, and the ones reaching each cluster of the view
+#if defined(LIGHT_CLUSTERS) && defined(LIGHTS_MAX) && !defined(GL_ES)
+#ifdef UNIFORM_BLOCKS
+layout(std140) uniform LightArraysBlock {
+    vec4        u_lightsPosition[LIGHTS_MAX];   // falloff on w
+    vec4        u_lightsColor[LIGHTS_MAX];      // intensity on w
+    vec4        u_lightsDirection[LIGHTS_MAX];  // type on w
+    float       u_lightsTotal;
+};
+#else
+uniform vec4        u_lightsPosition[LIGHTS_MAX];
+uniform vec4        u_lightsColor[LIGHTS_MAX];
+uniform vec4        u_lightsDirection[LIGHTS_MAX];
+uniform float       u_lightsTotal;
+#endif
+
+uniform sampler2D   u_lightClusters;
+uniform sampler2D   u_lightClustersIndices;
+uniform vec2        u_lightClustersIndicesResolution;
+uniform vec4        u_lightClustersSize;
+uniform vec3        u_lightClustersDepth;
+uniform vec2        u_tileOffset;
+#else
+#undef LIGHT_CLUSTERS
+#endif
+
 #endif
 
 #ifndef FNC_TEXTURESHADOW
@@ -1136,9 +1205,16 @@ float schlick(float f0, float f90, float VoH) {
 #ifndef HEADER_IBL
 #define HEADER_IBL
 uniform samplerCube u_cubeMap;
+#ifdef UNIFORM_BLOCKS
+layout(std140) uniform IblBlock {
+    vec3            u_SH[9];
+    float           u_iblLuminance;
+};
+#else
 uniform vec3        u_SH[9];
 uniform float       u_iblLuminance;
 #endif
+#endif
 
 
 // #define TONEMAP_FNC tonemap_linear
@@ -1681,7 +1757,7 @@ float smithGGXCorrelated_Fast(float NoV, float NoL, float roughness) {
 float specularGGX(vec3 _L, vec3 _N, vec3 _V, float _NoV, float _NoL, float _roughness, float _fresnel) {
     float NoV = max(_NoV, 0.0);
     float NoL = max(_NoL, 0.0);
-    vec3 s = normalize(u_light - v_position.xyz);
+    vec3 s = _L;
 
     vec3 H = normalize(s + _V);
     float LoH = saturate(dot(s, H));
@@ -1890,19 +1966,23 @@ float falloff(float _dist, float _lightRadius) {
 #ifndef FNC_LIGHT_POINT
 #define FNC_LIGHT_POINT
 
-void lightPoint(vec3 _diffuseColor, vec3 _specularColor, vec3 _N, vec3 _V, float _NoV, float _roughness, float _f0, out vec3 _diffuse, out vec3 _specular) {
-    vec3 s = normalize(u_light - v_position.xyz);
+void lightPoint(vec3 _lightPos, vec3 _lightColor, float _lightIntensity, float _lightFalloff, vec3 _diffuseColor, vec3 _specularColor, vec3 _N, vec3 _V, float _NoV, float _roughness, float _f0, out vec3 _diffuse, out vec3 _specular) {
+    vec3 s = normalize(_lightPos - v_position.xyz);
     float NoL = dot(_N, s);
 
     float dif = diffuse(s, _N, _V, _NoV, NoL, _roughness) * ONE_OVER_PI;
     float spec = specular(s, _N, _V, _NoV, NoL, _roughness, _f0);
 
     float fall = 1.0;
-    if (u_lightFalloff > 0.0)
-        fall = falloff(length(u_light - v_position.xyz), u_lightFalloff);
+    if (_lightFalloff > 0.0)
+        fall = falloff(length(_lightPos - v_position.xyz), _lightFalloff);
     
-    _diffuse = u_lightIntensity * (_diffuseColor * u_lightColor * dif * fall);
-    _specular = u_lightIntensity * (_specularColor * u_lightColor * spec * fall);
+    _diffuse = _lightIntensity * (_diffuseColor * _lightColor * dif * fall);
+    _specular = _lightIntensity * (_specularColor * _lightColor * spec * fall);
+}
+
+void lightPoint(vec3 _diffuseColor, vec3 _specularColor, vec3 _N, vec3 _V, float _NoV, float _roughness, float _f0, out vec3 _diffuse, out vec3 _specular) {
+    lightPoint(u_light, u_lightColor, u_lightIntensity, u_lightFalloff, _diffuseColor, _specularColor, _N, _V, _NoV, _roughness, _f0, _diffuse, _specular);
 }
 
 #endif
@@ -1929,6 +2009,47 @@ void lightWithShadow(vec3 _diffuseColor, vec3 _specularColor, vec3 _N, vec3 _V,
     _specular += saturate(lightSpecular) * shadows;
 }
 
+#ifdef LIGHT_CLUSTERS
+// Lights of the cluster this fragment falls in. The first light is the one with the shadow map
+void lightClusters(vec3 _diffuseColor, vec3 _specularColor, vec3 _N, vec3 _V, float _NoV, float _roughness, float _f0, inout vec3 _diffuse, inout vec3 _specular) {
+    // Slices are exponential on the linear depth
+    float nearClip = u_lightClustersDepth.x;
+    float farClip = u_lightClustersDepth.y;
+    float depth = nearClip * farClip / (farClip - gl_FragCoord.z * (farClip - nearClip));
+    float slice = clamp(floor(log(depth / nearClip) * u_lightClustersDepth.z), 0.0, u_lightClustersSize.z - 1.0);
+    // Clusters cover the whole image, not just the tile of a big screenshot being rendered
+    vec2 tile = clamp(floor((gl_FragCoord.xy + u_tileOffset) / u_resolution * u_lightClustersSize.xy), vec2(0.0), u_lightClustersSize.xy - 1.0);
+
+    vec2 st = vec2(tile.y * u_lightClustersSize.x + tile.x, slice) + 0.5;
+    vec4 cluster = floor(texture2D(u_lightClusters, st / vec2(u_lightClustersSize.x * u_lightClustersSize.y, u_lightClustersSize.z)) * 255.0 + 0.5);
+    float offset = cluster.r + cluster.g * 256.0 + cluster.a * 65536.0;
+    float count = cluster.b;
+
+    for (int i = 0; i < LIGHTS_MAX; i++) {
+        if (float(i) >= count)
+            break;
+
+        float index = offset + float(i);
+        vec2 uv = (vec2(mod(index, u_lightClustersIndicesResolution.x), floor(index / u_lightClustersIndicesResolution.x)) + 0.5) / u_lightClustersIndicesResolution;
+        int light = int(floor(texture2D(u_lightClustersIndices, uv).r * 255.0 + 0.5));
+
+        vec3 lightDiffuse = vec3(0.0);
+        vec3 lightSpecular = vec3(0.0);
+        lightPoint( u_lightsPosition[light].xyz, u_lightsColor[light].rgb, u_lightsColor[light].a, u_lightsPosition[light].w, 
+                    _diffuseColor, _specularColor, _N, _V, _NoV, _roughness, _f0, lightDiffuse, lightSpecular);
+
+        float shadows = 1.0;
+#if defined(LIGHT_SHADOWMAP) && defined(LIGHT_SHADOWMAP_SIZE) && !defined(PLATFORM_RPI)
+        if (light == 0)
+            shadows = shadow();
+#endif
+
+        _diffuse += lightDiffuse * shadows;
+        _specular += saturate(lightSpecular) * shadows;
+    }
+}
+#endif
+
 vec4 pbr(const Material _mat) {
     // Calculate Color
 
@@ -1973,7 +2094,11 @@ vec4 pbr(const Material _mat) {
     // ------------------------
     vec3 lightDiffuse = vec3(0.0);
     vec3 lightSpecular = vec3(0.0);
+#ifdef LIGHT_CLUSTERS
+    lightClusters(diffuseColor, specularColor, N, V, NoV, roughness, f0, lightDiffuse, lightSpecular);
+#else
     lightWithShadow(diffuseColor, specularColor, N, V, NoV, roughness, f0, lightDiffuse, lightSpecular);
+#endif
     
     // Final Sum
     // ------------------------
@@ -0,0 +1,237 @@
+#include "profiler.h"
+
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+
+// How many frames the averages and maximums look back
+#define PROFILER_SAMPLES 120
+
+#ifdef PROFILER_GPU
+static bool haveTimerQueries() {
+    int major = 0, minor = 0;
+    const char* version = (const char*)glGetString(GL_VERSION);
+    if (version)
+        sscanf(version, "%d.%d", &major, &minor);
+
+    if (major > 3 || (major == 3 && minor >= 3))
+        return true;
+    return haveExtension("GL_ARB_timer_query") || haveExtension("GL_EXT_disjoint_timer_query");
+}
+#endif
+
+Profiler::Profiler(): m_samples(PROFILER_SAMPLES), m_current(-1), m_frame(0), m_wait(false) {
+#ifdef PROFILER_GPU
+    m_gpu = -1;
+#endif
+}
+
+Profiler::~Profiler() {
+    clear();
+}
+
+void Profiler::begin(const std::string& _name) {
+    if (m_current >= 0)
+        end();
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::map<std::string, size_t>::iterator it = m_index.find(_name);
+    if (it == m_index.end()) {
+        it = m_index.insert(std::make_pair(_name, m_passes.size())).first;
+        m_passes.push_back(Pass());
+        m_passes.back().name = _name;
+    }
+
+    m_current = (int)it->second;
+    Pass& pass = m_passes[m_current];
+
+#ifdef PROFILER_GPU
+    if (m_gpu < 0) {
+        m_gpu = haveTimerQueries();
+        if (!m_gpu)
+            std::cout << "// GPU timer queries are not supported, only CPU times are measured" << std::endl;
+    }
+
+    if (m_gpu) {
+        if (pass.queries[m_frame] == 0)
+            glGenQueries(1, &pass.queries[m_frame]);
+        glBeginQuery(GL_TIME_ELAPSED, pass.queries[m_frame]);
+        pass.issued[m_frame] = true;
+    }
+#endif
+
+    pass.start = std::chrono::high_resolution_clock::now();
+}
+
+void Profiler::end() {
+    if (m_current < 0)
+        return;
+
+    std::chrono::high_resolution_clock::time_point now = std::chrono::high_resolution_clock::now();
+
+#ifdef PROFILER_GPU
+    if (m_gpu > 0)
+        glEndQuery(GL_TIME_ELAPSED);
+#endif
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Pass& pass = m_passes[m_current];
+    _addSample(pass.cpu, std::chrono::duration<float, std::milli>(now - pass.start).count());
+    m_current = -1;
+}
+
+void Profiler::frame() {
+    if (m_current >= 0)
+        end();
+
+    m_frame = 1 - m_frame;
+
+#ifdef PROFILER_GPU
+    // The queries about to be reused were issued a frame ago, by now they are usually done.
+    // Unless asked to wait, the ones that are not get skipped
+    std::lock_guard<std::mutex> lock(m_mutex);
+    _collect(m_frame, m_wait);
+#endif
+}
+
+void Profiler::flush() {
+    if (m_current >= 0)
+        end();
+
+#ifdef PROFILER_GPU
+    // Waits for the queries still in flight, oldest set first
+    std::lock_guard<std::mutex> lock(m_mutex);
+    _collect(1 - m_frame, true);
+    _collect(m_frame, true);
+#endif
+}
+
+#ifdef PROFILER_GPU
+void Profiler::_collect(int _set, bool _wait) {
+    for (size_t i = 0; i < m_passes.size(); i++) {
+        Pass& pass = m_passes[i];
+        if (!pass.issued[_set])
+            continue;
+        pass.issued[_set] = false;
+
+        GLuint available = _wait;
+        if (!_wait)
+            glGetQueryObjectuiv(pass.queries[_set], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+            continue;
+
+        // 32 bits of nanoseconds wrap after ~4 seconds
+        GLuint64 nanoseconds = 0;
+        glGetQueryObjectui64v(pass.queries[_set], GL_QUERY_RESULT, &nanoseconds);
+        _addSample(pass.gpu, (float)(nanoseconds * 0.000001));
+    }
+}
+#endif
+
+std::string Profiler::report(bool _csv) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::stringstream out;
+    out << std::fixed << std::setprecision(3);
+
+    if (_csv)
+        out << "pass,cpu_ms,cpu_max_ms,gpu_ms,gpu_max_ms" << std::endl;
+    else
+        out << "// " << std::left << std::setw(16) << "pass" << std::right
+            << std::setw(10) << "cpu ms" << std::setw(10) << "max"
+            << std::setw(10) << "gpu ms" << std::setw(10) << "max" << std::endl;
+
+    for (size_t i = 0; i < m_passes.size(); i++) {
+        const Pass& pass = m_passes[i];
+        const std::deque<float>* samples[2] = { &pass.cpu, &pass.gpu };
+
+        if (_csv)
+            out << pass.name;
+        else
+            out << "// " << std::left << std::setw(16) << pass.name << std::right;
+
+        for (int j = 0; j < 2; j++) {
+            if (samples[j]->empty()) {
+                if (_csv)   out << ",,";
+                else        out << std::setw(10) << "-" << std::setw(10) << "-";
+                continue;
+            }
+
+            Stats stats = getStats(std::vector<float>(samples[j]->begin(), samples[j]->end()));
+            if (_csv)   out << "," << stats.mean << "," << stats.max;
+            else        out << std::setw(10) << stats.mean << std::setw(10) << stats.max;
+        }
+        out << std::endl;
+    }
+
+    return out.str();
+}
+
+std::vector<std::string> Profiler::getPasses() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::vector<std::string> passes;
+    for (size_t i = 0; i < m_passes.size(); i++)
+        passes.push_back(m_passes[i].name);
+    return passes;
+}
+
+Profiler::Stats Profiler::getStats(const std::string& _pass, bool _gpu) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::map<std::string, size_t>::iterator it = m_index.find(_pass);
+    if (it == m_index.end())
+        return Stats();
+
+    const std::deque<float>& samples = _gpu ? m_passes[it->second].gpu : m_passes[it->second].cpu;
+    return getStats(std::vector<float>(samples.begin(), samples.end()));
+}
+
+Profiler::Stats Profiler::getStats(std::vector<float> _samples) {
+    Stats stats;
+    stats.count = _samples.size();
+    if (stats.count == 0)
+        return stats;
+
+    // Nearest rank percentiles
+    std::sort(_samples.begin(), _samples.end());
+    float sum = 0.0f;
+    for (size_t i = 0; i < _samples.size(); i++)
+        sum += _samples[i];
+
+    stats.mean = sum / stats.count;
+    stats.p50 = _samples[(size_t)std::ceil(0.50 * stats.count) - 1];
+    stats.p95 = _samples[(size_t)std::ceil(0.95 * stats.count) - 1];
+    stats.p99 = _samples[(size_t)std::ceil(0.99 * stats.count) - 1];
+    stats.max = _samples.back();
+    return stats;
+}
+
+void Profiler::reset() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (size_t i = 0; i < m_passes.size(); i++) {
+        m_passes[i].cpu.clear();
+        m_passes[i].gpu.clear();
+    }
+}
+
+void Profiler::clear() {
+    if (m_current >= 0)
+        end();
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+#ifdef PROFILER_GPU
+    for (size_t i = 0; i < m_passes.size(); i++)
+        for (int j = 0; j < 2; j++)
+            if (m_passes[i].queries[j] != 0)
+                glDeleteQueries(1, &m_passes[i].queries[j]);
+#endif
+    m_passes.clear();
+    m_index.clear();
+}
+
+void Profiler::_addSample(std::deque<float>& _samples, float _value) {
+    _samples.push_back(_value);
+    while (_samples.size() > m_samples)
+        _samples.pop_front();
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <chrono>
+
+#include "../gl/gl.h"
+
+// GPU timer queries need GL 3.3 (or ARB_timer_query), without them only CPU time is measured.
+// Builds that have them still check the context they run on
+#if !defined(PLATFORM_RPI) && defined(GL_TIME_ELAPSED)
+#define PROFILER_GPU
+#endif
+
+// Measures how long each pass of a frame takes on the CPU and the GPU.
+// GPU times are read one frame late from a double-buffered set of timer
+// queries, so asking for them never stalls the render loop
+class Profiler {
+public:
+    Profiler();
+    virtual ~Profiler();
+
+    struct Stats {
+        float   mean    = 0.0f;
+        float   p50     = 0.0f;
+        float   p95     = 0.0f;
+        float   p99     = 0.0f;
+        float   max     = 0.0f;
+        size_t  count   = 0;
+    };
+    static Stats        getStats(std::vector<float> _samples);
+
+    // Passes can't be nested, starting one ends the previous
+    void                begin(const std::string& _name);
+    void                end();
+
+    // Closes the frame and collects the GPU times of the previous one
+    void                frame();
+
+    // Collects the GPU times still pending, waiting for them (call it after the last frame)
+    void                flush();
+
+    // How many frames are kept for each pass (120 by default)
+    void                setSamples(size_t _samples) { m_samples = _samples; }
+
+    // Wait for the GPU times instead of skipping the ones that are not ready (for benchmarks)
+    void                setWait(bool _wait) { m_wait = _wait; }
+
+    // Names of the passes, in the order they first run
+    std::vector<std::string> getPasses();
+    Stats               getStats(const std::string& _pass, bool _gpu);
+
+    // Frame times of each pass (averages and maximums of the last frames), as a table or as CSV
+    std::string         report(bool _csv = false);
+
+    // Forgets the times collected so far but keeps the passes
+    void                reset();
+    void                clear();
+
+private:
+    struct Pass {
+        std::string         name;
+        std::deque<float>   cpu;
+        std::deque<float>   gpu;
+        std::chrono::high_resolution_clock::time_point start;
+#ifdef PROFILER_GPU
+        GLuint              queries[2]  = { 0, 0 };
+        bool                issued[2]   = { false, false };
+#endif
+    };
+
+    void                _addSample(std::deque<float>& _samples, float _value);
+#ifdef PROFILER_GPU
+    void                _collect(int _set, bool _wait);
+#endif
+
+    std::vector<Pass>               m_passes;
+    std::map<std::string, size_t>   m_index;
+    std::mutex                      m_mutex;
+    size_t                          m_samples;
+    int                             m_current;
+    int                             m_frame;
+    bool                            m_wait;
+#ifdef PROFILER_GPU
+    int                             m_gpu;      // -1 until the context is asked for timer queries
+#endif
+};
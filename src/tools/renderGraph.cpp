@@ -0,0 +1,158 @@
+#include "renderGraph.h"
+
+#include <algorithm>
+#include <climits>
+
+RenderGraph::RenderGraph(): m_total_targets(0) {
+}
+
+RenderGraph::~RenderGraph() {
+}
+
+size_t RenderGraph::addPass(const std::string& _name, const std::vector<std::string>& _inputs, bool _target) {
+    Pass pass;
+    pass.name = _name;
+    pass.input_names = _inputs;
+    pass.has_target = _target;
+    m_passes.push_back(pass);
+    return m_passes.size() - 1;
+}
+
+void RenderGraph::compile(const std::vector<std::string>& _outputs) {
+    m_order.clear();
+    m_total_targets = 0;
+
+    // Resolve which passes each one reads (anything else is not our business)
+    for (size_t i = 0; i < m_passes.size(); i++) {
+        Pass& pass = m_passes[i];
+        pass.inputs.clear();
+        for (size_t j = 0; j < m_passes.size(); j++)
+            if (std::find(pass.input_names.begin(), pass.input_names.end(), m_passes[j].name) != pass.input_names.end())
+                pass.inputs.push_back(j);
+
+        pass.active = false;
+        pass.persistent = false;
+        pass.target = -1;
+        pass.position = -1;
+        pass.last_use = -1;
+        pass.index = -1;
+        pass.lowlink = -1;
+        pass.on_stack = false;
+    }
+
+    // Only the passes the outputs end up reading need to be rendered
+    std::vector<size_t> stack;
+    for (size_t i = 0; i < m_passes.size(); i++)
+        if (std::find(_outputs.begin(), _outputs.end(), m_passes[i].name) != _outputs.end()) {
+            m_passes[i].active = true;
+            stack.push_back(i);
+        }
+
+    while (!stack.empty()) {
+        size_t pass = stack.back();
+        stack.pop_back();
+        for (size_t i = 0; i < m_passes[pass].inputs.size(); i++) {
+            size_t input = m_passes[pass].inputs[i];
+            if (!m_passes[input].active) {
+                m_passes[input].active = true;
+                stack.push_back(input);
+            }
+        }
+    }
+
+    // Group feedback loops together, they come out with their inputs before them
+    std::vector< std::vector<size_t> > components;
+    int index = 0;
+    for (size_t i = 0; i < m_passes.size(); i++)
+        if (m_passes[i].active && m_passes[i].index == -1)
+            _strongConnect(i, stack, components, index);
+
+    for (size_t i = 0; i < components.size(); i++) {
+        std::sort(components[i].begin(), components[i].end());
+        for (size_t j = 0; j < components[i].size(); j++) {
+            m_passes[components[i][j]].position = (int)m_order.size();
+            m_order.push_back(components[i][j]);
+        }
+    }
+
+    // How long the result of each pass is needed. The ones read before they are
+    // rendered (feedback loops) have to survive until the next frame
+    for (size_t i = 0; i < m_order.size(); i++) {
+        const Pass& pass = m_passes[m_order[i]];
+        for (size_t j = 0; j < pass.inputs.size(); j++) {
+            Pass& input = m_passes[pass.inputs[j]];
+            if (input.position >= pass.position)
+                input.persistent = true;
+            else
+                input.last_use = std::max(input.last_use, pass.position);
+        }
+    }
+
+    for (size_t i = 0; i < m_order.size(); i++) {
+        Pass& pass = m_passes[m_order[i]];
+        if (std::find(_outputs.begin(), _outputs.end(), pass.name) != _outputs.end())
+            pass.last_use = (int)m_order.size();
+    }
+
+    // Hand the targets over once their last reader is done with them
+    std::vector<int> busy_until;
+    for (size_t i = 0; i < m_order.size(); i++) {
+        Pass& pass = m_passes[m_order[i]];
+        if (!pass.has_target)
+            continue;
+
+        int until = pass.persistent ? INT_MAX : pass.last_use;
+        if (!pass.persistent)
+            for (size_t t = 0; t < busy_until.size(); t++)
+                if (busy_until[t] < pass.position) {
+                    pass.target = (int)t;
+                    break;
+                }
+
+        if (pass.target == -1) {
+            pass.target = (int)busy_until.size();
+            busy_until.push_back(until);
+        }
+        else
+            busy_until[pass.target] = until;
+    }
+
+    m_total_targets = busy_until.size();
+}
+
+void RenderGraph::_strongConnect(size_t _pass, std::vector<size_t>& _stack, std::vector< std::vector<size_t> >& _components, int& _index) {
+    Pass& pass = m_passes[_pass];
+    pass.index = _index;
+    pass.lowlink = _index;
+    _index++;
+    _stack.push_back(_pass);
+    pass.on_stack = true;
+
+    for (size_t i = 0; i < pass.inputs.size(); i++) {
+        Pass& input = m_passes[pass.inputs[i]];
+        if (input.index == -1) {
+            _strongConnect(pass.inputs[i], _stack, _components, _index);
+            pass.lowlink = std::min(pass.lowlink, input.lowlink);
+        }
+        else if (input.on_stack)
+            pass.lowlink = std::min(pass.lowlink, input.index);
+    }
+
+    if (pass.lowlink == pass.index) {
+        std::vector<size_t> component;
+        size_t member;
+        do {
+            member = _stack.back();
+            _stack.pop_back();
+            m_passes[member].on_stack = false;
+            component.push_back(member);
+        } while (member != _pass);
+        _components.push_back(component);
+    }
+}
+
+void RenderGraph::clear() {
+    m_passes.clear();
+    m_order.clear();
+    m_total_targets = 0;
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+// Orders the offscreen passes (buffers, convolution pyramids, ...) by what they
+// read from each other, drops the ones nothing ends up reading and lets the
+// ones that are never needed at the same time share the same render target
+class RenderGraph {
+public:
+    RenderGraph();
+    virtual ~RenderGraph();
+
+    // A pass writes the texture _name (ex: "u_buffer0") reading the ones in _inputs.
+    // Passes with _target get one assigned, the rest keep their own storage
+    size_t              addPass(const std::string& _name, const std::vector<std::string>& _inputs, bool _target);
+
+    // _outputs are the textures read once all the passes are done (main shader, postprocessing, debug views...)
+    void                compile(const std::vector<std::string>& _outputs);
+
+    // Passes that reach the outputs, in the order they should be rendered.
+    // Inside a feedback loop passes keep their original order and read what the others left on the previous frame
+    const std::vector<size_t>& getOrder() const { return m_order; }
+
+    size_t              getTotalPasses() const { return m_passes.size(); }
+    const std::string&  getName(size_t _pass) const { return m_passes[_pass].name; }
+    bool                isActive(size_t _pass) const { return m_passes[_pass].active; }
+    // Passes it reads
+    const std::vector<size_t>& getInputs(size_t _pass) const { return m_passes[_pass].inputs; }
+
+    // Target of the pass (-1 for passes without one or not active)
+    int                 getTarget(size_t _pass) const { return m_passes[_pass].target; }
+    size_t              getTotalTargets() const { return m_total_targets; }
+
+    void                clear();
+
+private:
+    struct Pass {
+        std::string         name;
+        std::vector<size_t> inputs;
+        std::vector<std::string> input_names;
+        bool                has_target  = false;
+        bool                active      = false;
+        bool                persistent  = false;
+        int                 target      = -1;
+        int                 position    = -1;
+        int                 last_use    = -1;
+
+        // Tarjan's strongly connected components
+        int                 index       = -1;
+        int                 lowlink     = -1;
+        bool                on_stack    = false;
+    };
+
+    void                _strongConnect(size_t _pass, std::vector<size_t>& _stack, std::vector< std::vector<size_t> >& _components, int& _index);
+
+    std::vector<Pass>   m_passes;
+    std::vector<size_t> m_order;
+    size_t              m_total_targets;
+};
@@ -0,0 +1,127 @@
+#include "sourceInfo.h"
+
+#include <cctype>
+#include <cstdlib>
+
+static bool isIdStart(char _c) {
+    return isalpha((unsigned char)_c) || _c == '_';
+}
+
+static bool isIdChar(char _c) {
+    return isalnum((unsigned char)_c) || _c == '_';
+}
+
+// Number after _prefix (ex: 2 for BUFFER_2), -1 if _name is something else
+static int sectionNumber(const std::string& _name, const std::string& _prefix) {
+    if (_name.size() <= _prefix.size() || _name.compare(0, _prefix.size(), _prefix) != 0)
+        return -1;
+
+    for (size_t i = _prefix.size(); i < _name.size(); i++)
+        if (!isdigit((unsigned char)_name[i]))
+            return -1;
+
+    return atoi(_name.c_str() + _prefix.size());
+}
+
+SourceInfo analyzeSource(const std::string& _source) {
+    SourceInfo info;
+
+    enum Directive { NONE, IFDEF, IFNDEF, IF, OTHER };
+    Directive directive = NONE;
+    bool line_start = true;         // only white spaces so far on this line
+    bool after_hash = false;        // next identifier is the directive name
+    bool after_defined = false;     // next identifier is checked by defined()
+    bool after_not = false;         // a ! that could negate the next defined()
+    bool negated = false;           // the defined() being read is negated
+
+    const size_t size = _source.size();
+    size_t i = 0;
+    while (i < size) {
+        char c = _source[i];
+
+        if (c == '\n') {
+            directive = NONE;
+            line_start = true;
+            after_hash = after_defined = after_not = false;
+            i++;
+        }
+        else if (c == '/' && i + 1 < size && _source[i+1] == '/') {
+            while (i < size && _source[i] != '\n')
+                i++;
+        }
+        else if (c == '/' && i + 1 < size && _source[i+1] == '*') {
+            size_t end = _source.find("*/", i + 2);
+            // New lines inside don't end directives, same as the preprocessor
+            i = (end == std::string::npos)? size : end + 2;
+        }
+        else if (c == '#' && line_start) {
+            after_hash = true;
+            line_start = false;
+            i++;
+        }
+        else if (isIdStart(c)) {
+            size_t start = i;
+            while (i < size && isIdChar(_source[i]))
+                i++;
+            std::string id = _source.substr(start, i - start);
+            line_start = false;
+
+            if (after_hash) {
+                after_hash = false;
+                if (id == "ifdef")          directive = IFDEF;
+                else if (id == "ifndef")    directive = IFNDEF;
+                else if (id == "if" || id == "elif") directive = IF;
+                else                        directive = OTHER;
+                continue;
+            }
+
+            if (directive == IFDEF) {
+                info.defined.insert(id);
+                directive = OTHER;
+            }
+            else if (directive == IFNDEF) {
+                info.undefined.insert(id);
+                directive = OTHER;
+            }
+            else if (directive == IF) {
+                // Only positive tests declare a section, !defined(...) counts as #ifndef
+                if (after_defined) {
+                    if (negated)    info.undefined.insert(id);
+                    else            info.defined.insert(id);
+                }
+                after_defined = (id == "defined");
+                negated = after_defined && after_not;
+                after_not = false;
+            }
+
+            info.identifiers.insert(id);
+        }
+        else if (isdigit((unsigned char)c)) {
+            // Numbers (ex: 1e5 or 0xFF) are not identifiers
+            while (i < size && (isIdChar(_source[i]) || _source[i] == '.'))
+                i++;
+            line_start = false;
+        }
+        else {
+            if (!isspace((unsigned char)c))
+                line_start = false;
+            if (c == '!')
+                after_not = !(i + 1 < size && _source[i+1] == '=');
+            else if (c != '(' && !isspace((unsigned char)c))
+                after_not = false;
+            i++;
+        }
+    }
+
+    for (std::set<std::string>::const_iterator it = info.defined.begin(); it != info.defined.end(); it++) {
+        int n = sectionNumber(*it, "BUFFER_");
+        if (n >= 0)
+            info.buffers.insert(n);
+
+        n = sectionNumber(*it, "CONVOLUTION_PYRAMID_");
+        if (n >= 0)
+            info.convolution_pyramids.insert(n);
+    }
+
+    return info;
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <set>
+#include <string>
+#include <unordered_set>
+
+// What glslViewer needs to know about a shader source (passes, sections and uniforms it uses),
+// found in a single pass over it. Comments are skipped
+struct SourceInfo {
+    // Names checked with #ifdef, #if defined(...) or #elif defined(...)
+    std::set<std::string>           defined;
+    // Names checked with #ifndef, #if !defined(...) or #elif !defined(...)
+    std::set<std::string>           undefined;
+    // Every identifier on the code (uniforms, functions, defines...)
+    std::unordered_set<std::string> identifiers;
+
+    // BUFFER_<N> and CONVOLUTION_PYRAMID_<N> sections, by number
+    std::set<int>                   buffers;
+    std::set<int>                   convolution_pyramids;
+
+    // True if there is a #ifdef, #ifndef or #if defined(...) section for _define
+    bool    haveSection(const std::string& _define) const { return defined.count(_define) || undefined.count(_define); }
+    bool    haveIdentifier(const std::string& _name) const { return identifiers.count(_name) != 0; }
+
+    bool    havePostprocessing() const { return haveSection("POSTPROCESSING"); }
+    bool    haveBackground() const { return haveSection("BACKGROUND"); }
+    bool    haveFloor() const { return haveSection("FLOOR"); }
+    bool    haveConvolutionPyramidAlgorithm() const { return haveSection("CONVOLUTION_PYRAMID_ALGORITHM"); }
+};
+
+SourceInfo analyzeSource(const std::string& _source);
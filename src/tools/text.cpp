@@ -1,7 +1,7 @@
 #include "tools/text.h"
 
 #include <algorithm>
-#include <regex>
+#include <cstring>
 
 std::string toLower(const std::string& _string) {
     std::string std = _string;
@@ -191,6 +191,19 @@ std::vector<std::string> split(const std::string& _string, char _sep, bool _tole
     return tokens;
 }
 
+unsigned long long hashBytes(const void* _data, size_t _size, unsigned long long _seed) {
+    const unsigned char* bytes = (const unsigned char*)_data;
+    for (size_t i = 0; i < _size; i++) {
+        _seed ^= bytes[i];
+        _seed *= 1099511628211ULL;
+    }
+    return _seed;
+}
+
+unsigned long long hashString(const std::string& _string, unsigned long long _seed) {
+    return hashBytes(_string.data(), _string.size(), _seed);
+}
+
 bool beginsWith(const std::string& _stringA, const std::string& _stringB) {
     for (uint32_t i = 0; i < _stringB.size(); i++) {
         if (_stringB[i] != _stringA[i]) {
@@ -252,158 +265,6 @@ std::string get_version(const std::string& _src, size_t& _versionNumber) {
     return srcVersion;
 }
 
-// Count how many BUFFERS are in the shader
-int count_buffers(const std::string& _source) {
-    // Split Source code in lines
-    std::vector<std::string> lines = split(_source, '\n');
-
-    // Group results in a vector to check for duplicates
-    std::vector<std::string> results;
-
-    // Regext to search for #ifdef BUFFER_[NUMBER], #if defined( BUFFER_[NUMBER] ) and #elif defined( BUFFER_[NUMBER] ) occurences
-    std::regex re(R"((?:^\s*#if|^\s*#elif)(?:\s+)(defined\s*\(\s*BUFFER_)(\d+)(?:\s*\))|(?:^\s*#ifdef\s+BUFFER_)(\d+))");
-    std::smatch match;
-
-    // For each line search for
-    for (unsigned int l = 0; l < lines.size(); l++) {
-
-        // if there are matches
-        if (std::regex_search(lines[l], match, re)) {
-            // Depending the case can be in the 2nd or 3rd group
-            std::string number = std::ssub_match(match[2]).str();
-            if (number.size() == 0) {
-                number = std::ssub_match(match[3]).str();
-            }
-
-            // Check if it's already defined
-            bool already = false;
-            for (unsigned int i = 0; i < results.size(); i++) {
-                if (results[i] == number) {
-                    already = true;
-                    break;
-                }
-            }
-
-            // If it's not add it
-            if (!already) {
-                results.push_back(number);
-            }
-        }
-    }
-
-    // return the number of results
-    return results.size();
-}
-
-// Count how many BUFFERS are in the shader
-bool check_for_background(const std::string& _source) {
-    // Split Source code in lines
-    std::vector<std::string> lines = split(_source, '\n');
-
-    std::regex re(R"((?:^\s*#if|^\s*#elif)(?:\s+)(defined\s*\(\s*BACKGROUND)(?:\s*\))|(?:^\s*#ifdef\s+BACKGROUND)|(?:^\s*#ifndef\s+BACKGROUND))");
-    std::smatch match;
-
-    for (unsigned int l = 0; l < lines.size(); l++) {
-        if (std::regex_search(lines[l], match, re)) {
-            return true;
-        }
-    }
-
-    return false;
-}
-
-// Count how many BUFFERS are in the shader
-bool check_for_floor(const std::string& _source) {
-    // Split Source code in lines
-    std::vector<std::string> lines = split(_source, '\n');
-
-    std::regex re(R"((?:^\s*#if|^\s*#elif)(?:\s+)(defined\s*\(\s*FLOOR)(?:\s*\))|(?:^\s*#ifdef\s+FLOOR)|(?:^\s*#ifndef\s+FLOOR))");
-    std::smatch match;
-
-    for (unsigned int l = 0; l < lines.size(); l++) {
-        if (std::regex_search(lines[l], match, re)) {
-            return true;
-        }
-    }
-
-    return false;
-}
-
-bool check_for_postprocessing(const std::string& _source) {
-    // Split Source code in lines
-    std::vector<std::string> lines = split(_source, '\n');
-
-    std::regex re(R"((?:^\s*#if|^\s*#elif)(?:\s+)(defined\s*\(\s*POSTPROCESSING)(?:\s*\))|(?:^\s*#ifdef\s+POSTPROCESSING)|(?:^\s*#ifndef\s+POSTPROCESSING))");
-    std::smatch match;
-
-    for (unsigned int l = 0; l < lines.size(); l++) {
-        if (std::regex_search(lines[l], match, re)) {
-            return true;
-        }
-    }
-
-    return false;
-}
-
-// Count how many CONVOLUTION_PYRAMID_ are in the shader
-int count_convolution_pyramid(const std::string& _source) {
-    // Split Source code in lines
-    std::vector<std::string> lines = split(_source, '\n');
-
-    // Group results in a vector to check for duplicates
-    std::vector<std::string> results;
-
-    // Regext to search for #ifdef BUFFER_[NUMBER], #if defined( BUFFER_[NUMBER] ) and #elif defined( BUFFER_[NUMBER] ) occurences
-    std::regex re(R"((?:^\s*#if|^\s*#elif)(?:\s+)(defined\s*\(\s*CONVOLUTION_PYRAMID_)(\d+)(?:\s*\))|(?:^\s*#ifdef\s+CONVOLUTION_PYRAMID_)(\d+))");
-    std::smatch match;
-
-    // For each line search for
-    for (unsigned int l = 0; l < lines.size(); l++) {
-
-        // if there are matches
-        if (std::regex_search(lines[l], match, re)) {
-            // Depending the case can be in the 2nd or 3rd group
-            std::string number = std::ssub_match(match[2]).str();
-            if (number.size() == 0) {
-                number = std::ssub_match(match[3]).str();
-            }
-
-            // Check if it's already defined
-            bool already = false;
-            for (unsigned int i = 0; i < results.size(); i++) {
-                if (results[i] == number) {
-                    already = true;
-                    break;
-                }
-            }
-
-            // If it's not add it
-            if (!already) {
-                results.push_back(number);
-            }
-        }
-    }
-
-    // return the number of results
-    return results.size();
-}
-
-bool check_for_convolution_pyramid_algorithm(const std::string& _source) {
-    // Split Source code in lines
-    std::vector<std::string> lines = split(_source, '\n');
-
-    std::regex re(R"((?:^\s*#if|^\s*#elif)(?:\s+)(defined\s*\(\s*CONVOLUTION_PYRAMID_ALGORITHM)(?:\s*\))|(?:^\s*#ifdef\s+CONVOLUTION_PYRAMID_ALGORITHM)|(?:^\s*#ifndef\s+CONVOLUTION_PYRAMID_ALGORITHM))");
-    std::smatch match;
-
-    for (unsigned int l = 0; l < lines.size(); l++) {
-        if (std::regex_search(lines[l], match, re)) {
-            return true;
-        }
-    }
-
-    return false;
-}
-
 std::string getUniformName(const std::string& _str) {
     std::vector<std::string> values = split(_str, '.');
     return "u_" + toLower( toUnderscore( purifyString( values[0] ) ) );
@@ -11,12 +11,6 @@
 
 // Search for one apearance
 bool find_id(const std::string& program, const char* id);
-bool check_for_floor(const std::string& _source);
-bool check_for_background(const std::string& _source);
-int  count_buffers(const std::string& _source);
-int  count_convolution_pyramid(const std::string& _source);
-bool check_for_convolution_pyramid_algorithm(const std::string& _source);
-bool check_for_postprocessing(const std::string& _source);
 bool check_for_pattern(const std::string& _str);
 
 std::string get_version(const std::string& program, size_t& _version);
@@ -43,6 +37,10 @@ std::vector<std::string> split(const std::string& _string, char _sep, bool _tole
 
 bool isFloat(const std::string& _string);
 
+// FNV-1a (64 bits), to name things by their content. Pass a hash as _seed to keep adding to it
+unsigned long long hashBytes(const void* _data, size_t _size, unsigned long long _seed = 14695981039346656037ULL);
+unsigned long long hashString(const std::string& _string, unsigned long long _seed = 14695981039346656037ULL);
+
 //---------------------------------------- Conversions
 bool toBool(const std::string& _string);
 char toChar(const std::string& _string);
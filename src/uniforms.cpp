@@ -2,6 +2,9 @@
 
 #include <regex>
 #include <sstream>
+#include <set>
+#include <cstring>
+#include <chrono>
 #include <sys/stat.h>
 
 #include "tools/text.h"
@@ -50,9 +53,118 @@ UniformFunction::UniformFunction(const std::string &_type, std::function<void(Sh
     print = _print;
 }
 
+// Native uniforms set on every draw, by handle to skip looking them up by name
+static const UniformHandle<float>     u_iblLuminance("u_iblLuminance");
+static const UniformHandle<glm::vec3> u_camera("u_camera");
+static const UniformHandle<float>     u_cameraDistance("u_cameraDistance");
+static const UniformHandle<float>     u_cameraNearClip("u_cameraNearClip");
+static const UniformHandle<float>     u_cameraFarClip("u_cameraFarClip");
+static const UniformHandle<float>     u_cameraEv100("u_cameraEv100");
+static const UniformHandle<float>     u_cameraExposure("u_cameraExposure");
+static const UniformHandle<float>     u_cameraAperture("u_cameraAperture");
+static const UniformHandle<float>     u_cameraShutterSpeed("u_cameraShutterSpeed");
+static const UniformHandle<float>     u_cameraSensitivity("u_cameraSensitivity");
+static const UniformHandle<glm::mat3> u_normalMatrix("u_normalMatrix");
+static const UniformHandle<glm::mat4> u_viewMatrix("u_viewMatrix");
+static const UniformHandle<glm::mat4> u_projectionMatrix("u_projectionMatrix");
+static const UniformHandle<glm::vec3> u_light("u_light");
+static const UniformHandle<glm::vec3> u_lightColor("u_lightColor");
+static const UniformHandle<glm::vec3> u_lightDirection("u_lightDirection");
+static const UniformHandle<float>     u_lightIntensity("u_lightIntensity");
+static const UniformHandle<float>     u_lightFalloff("u_lightFalloff");
+static const UniformHandle<glm::mat4> u_lightMatrix("u_lightMatrix");
+static const UniformHandle<float>     u_lightsTotal("u_lightsTotal");
+
+// std140 layouts of the rest of the blocks, they have to match the ones on the shaders (see default_scene.h)
+struct CameraBlock {
+    glm::mat4   viewMatrix;
+    glm::mat4   projectionMatrix;
+    glm::vec4   normalMatrix[3];    // mat3 columns are padded to vec4
+    glm::vec3   position;
+    float       distance;
+    float       nearClip;
+    float       farClip;
+    float       ev100;
+    float       exposure;
+    float       aperture;
+    float       shutterSpeed;
+    float       sensitivity;
+    float       padding;
+};
+
+struct LightsBlock {
+    glm::vec3   position    = glm::vec3(0.0f);
+    float       intensity   = 0.0f;
+    glm::vec3   color       = glm::vec3(0.0f);
+    float       falloff     = 0.0f;
+    glm::vec3   direction   = glm::vec3(0.0f);
+    float       padding     = 0.0f;
+};
+
+struct IblBlock {
+    glm::vec4   SH[9];              // so are the elements of arrays
+    float       luminance   = 0.0f;
+    float       padding[3]  = { 0.0f, 0.0f, 0.0f };
+};
+
+// All the lights (up to LIGHTS_MAX), the same arrays the shaders without blocks get as plain uniforms
+struct LightArraysBlock {
+    glm::vec4   position[LIGHTS_MAX];   // falloff on w
+    glm::vec4   color[LIGHTS_MAX];      // intensity on w
+    glm::vec4   direction[LIGHTS_MAX];  // LightType on w
+    float       total       = 0.0f;
+    float       padding[3]  = { 0.0f, 0.0f, 0.0f };
+};
+
+static_assert(sizeof(CameraBlock) == 224 && sizeof(LightsBlock) == 48 && sizeof(FrameBlock) == 48 && sizeof(IblBlock) == 160, "uniform blocks don't follow std140");
+static_assert(sizeof(LightArraysBlock) == 48 * LIGHTS_MAX + 16, "uniform blocks don't follow std140");
+
+// Image being decoded on a worker thread, waiting to be uploaded on the GL one
+struct TextureJob {
+    ~TextureJob() {
+        if (image.pixels)
+            freePixels(image.pixels);
+    }
+
+    Texture*                    texture = nullptr;
+    std::string                 path;
+    std::vector<unsigned char>  encoded;
+    bool                        flip = false;
+    DecodedImage                image;
+    std::future<void>           done;
+    bool                        uploaded = false;   // shared textures have a job for each uniform
+};
+
+// Bound while the image is decoding
+static const unsigned char      texture_placeholder[4] = { 0, 0, 0, 0 };
+
+static const char* blocks_names[UNIFORM_BLOCKS_TOTAL] = { "CameraBlock", "LightsBlock", "FrameBlock", "IblBlock", "LightArraysBlock" };
+static const size_t blocks_sizes[UNIFORM_BLOCKS_TOTAL] = { sizeof(CameraBlock), sizeof(LightsBlock), sizeof(FrameBlock), sizeof(IblBlock), sizeof(LightArraysBlock) };
+
+static void fillLightArrays(const std::vector<Light>& _lights, LightArraysBlock& _block) {
+    size_t total = std::min(_lights.size(), (size_t)LIGHTS_MAX);
+    for (size_t i = 0; i < LIGHTS_MAX; i++) {
+        if (i < total) {
+            const Light& light = _lights[i];
+            _block.position[i] = glm::vec4(light.getPosition(), light.falloff);
+            _block.color[i] = glm::vec4(light.color, light.intensity);
+            _block.direction[i] = glm::vec4(light.direction, float(light.getType()));
+        }
+        else {
+            _block.position[i] = glm::vec4(0.0f);
+            _block.color[i] = glm::vec4(0.0f);
+            _block.direction[i] = glm::vec4(0.0f);
+        }
+    }
+    _block.total = float(total);
+}
+
 // UNIFORMS
 
-Uniforms::Uniforms(): cubemap(nullptr), m_change(false), m_is_audio_init(false) {
+Uniforms::Uniforms(): cubemap(nullptr),
+    m_decode_threads(std::max(1, static_cast<int>(std::thread::hardware_concurrency()))),
+    m_change(false), m_is_audio_init(false), m_blocks(false), m_bindings_version(1) {
+    memset(m_bindings_sizes, 0, sizeof(m_bindings_sizes));
 
     // set the right distance to the camera
     // Set up camera
@@ -60,68 +172,68 @@ Uniforms::Uniforms(): cubemap(nullptr), m_change(false), m_is_audio_init(false)
     cameras.push_back( Camera() );
 
     functions["u_iblLuminance"] = UniformFunction("float", [this](Shader& _shader) {
-        _shader.setUniform("u_iblLuminance", 30000.0f * getCamera().getExposure());
+        _shader.setUniform(u_iblLuminance, 30000.0f * getCamera().getExposure());
     },
     [this]() { return toString(30000.0f * getCamera().getExposure()); });
     
     // CAMERA UNIFORMS
     //
     functions["u_camera"] = UniformFunction("vec3", [this](Shader& _shader) {
-        _shader.setUniform("u_camera", -getCamera().getPosition() );
+        _shader.setUniform(u_camera, -getCamera().getPosition() );
     },
     [this]() { return toString(-getCamera().getPosition(), ','); });
 
     functions["u_cameraDistance"] = UniformFunction("float", [this](Shader& _shader) {
-        _shader.setUniform("u_cameraDistance", getCamera().getDistance());
+        _shader.setUniform(u_cameraDistance, getCamera().getDistance());
     },
     [this]() { return toString(getCamera().getDistance()); });
 
     functions["u_cameraNearClip"] = UniformFunction("float", [this](Shader& _shader) {
-        _shader.setUniform("u_cameraNearClip", getCamera().getNearClip());
+        _shader.setUniform(u_cameraNearClip, getCamera().getNearClip());
     },
     [this]() { return toString(getCamera().getNearClip()); });
 
     functions["u_cameraFarClip"] = UniformFunction("float", [this](Shader& _shader) {
-        _shader.setUniform("u_cameraFarClip", getCamera().getFarClip());
+        _shader.setUniform(u_cameraFarClip, getCamera().getFarClip());
     },
     [this]() { return toString(getCamera().getFarClip()); });
 
     functions["u_cameraEv100"] = UniformFunction("float", [this](Shader& _shader) {
-        _shader.setUniform("u_cameraEv100", getCamera().getEv100());
+        _shader.setUniform(u_cameraEv100, getCamera().getEv100());
     },
     [this]() { return toString(getCamera().getEv100()); });
 
     functions["u_cameraExposure"] = UniformFunction("float", [this](Shader& _shader) {
-        _shader.setUniform("u_cameraExposure", getCamera().getExposure());
+        _shader.setUniform(u_cameraExposure, getCamera().getExposure());
     },
     [this]() { return toString(getCamera().getExposure()); });
 
     functions["u_cameraAperture"] = UniformFunction("float", [this](Shader& _shader) {
-        _shader.setUniform("u_cameraAperture", getCamera().getAperture());
+        _shader.setUniform(u_cameraAperture, getCamera().getAperture());
     },
     [this]() { return toString(getCamera().getAperture()); });
 
     functions["u_cameraShutterSpeed"] = UniformFunction("float", [this](Shader& _shader) {
-        _shader.setUniform("u_cameraShutterSpeed", getCamera().getShutterSpeed());
+        _shader.setUniform(u_cameraShutterSpeed, getCamera().getShutterSpeed());
     },
     [this]() { return toString(getCamera().getShutterSpeed()); });
 
     functions["u_cameraSensitivity"] = UniformFunction("float", [this](Shader& _shader) {
-        _shader.setUniform("u_cameraSensitivity", getCamera().getSensitivity());
+        _shader.setUniform(u_cameraSensitivity, getCamera().getSensitivity());
     },
     [this]() { return toString(getCamera().getSensitivity()); });
     
     functions["u_normalMatrix"] = UniformFunction("mat3", [this](Shader& _shader) {
-        _shader.setUniform("u_normalMatrix", getCamera().getNormalMatrix());
+        _shader.setUniform(u_normalMatrix, getCamera().getNormalMatrix());
     });
 
     // CAMERA MATRIX UNIFORMS
     functions["u_viewMatrix"] = UniformFunction("mat4", [this](Shader& _shader) {
-        _shader.setUniform("u_viewMatrix", getCamera().getViewMatrix());
+        _shader.setUniform(u_viewMatrix, getCamera().getViewMatrix());
     });
 
     functions["u_projectionMatrix"] = UniformFunction("mat4", [this](Shader& _shader) {
-        _shader.setUniform("u_projectionMatrix", getCamera().getProjectionMatrix());
+        _shader.setUniform(u_projectionMatrix, getCamera().getProjectionMatrix());
     });
 
     // IBL UNIFORM
@@ -177,18 +289,48 @@ bool Uniforms::parseLine( const std::string &_line ) {
 }
 
 bool Uniforms::addTexture( const std::string& _name, Texture* _texture) {
+    m_textures_loading.erase(_name);
     if (textures.find(_name) == textures.end()) {
         textures[ _name ] = _texture;
         return true;
     }
     else {
         if (textures[ _name ])
-            delete textures[ _name ];
+            _releaseTexture(textures[ _name ]);
         textures[ _name ] = _texture;
     }
     return false;
 }
 
+bool Uniforms::_shareTexture(const std::string& _name, const std::string& _key) {
+    std::map<std::string, SharedTexture>::iterator shared = m_shared_textures.find(_key);
+    if (shared == m_shared_textures.end())
+        return false;
+
+    shared->second.users++;
+    textures[ _name ] = shared->second.texture;
+
+    // If it's still decoding this uniform waits for it too
+    for (std::map<std::string, std::shared_ptr<TextureJob> >::iterator it = m_textures_loading.begin(); it != m_textures_loading.end(); ++it)
+        if (it->second->texture == shared->second.texture) {
+            m_textures_loading[ _name ] = it->second;
+            break;
+        }
+
+    return true;
+}
+
+void Uniforms::_releaseTexture(Texture* _texture) {
+    for (std::map<std::string, SharedTexture>::iterator it = m_shared_textures.begin(); it != m_shared_textures.end(); ++it)
+        if (it->second.texture == _texture) {
+            if (--it->second.users > 0)
+                return;
+            m_shared_textures.erase(it);
+            break;
+        }
+    delete _texture;
+}
+
 bool Uniforms::addTexture(const std::string& _name, const std::string& _path, WatchFileList& _files, bool _flip, bool _verbose) {
     if (textures.find(_name) == textures.end()) {
         struct stat st;
@@ -197,15 +339,36 @@ bool Uniforms::addTexture(const std::string& _name, const std::string& _path, Wa
         if (stat(_path.c_str(), &st) != 0 )
             std::cerr << "Error watching for file " << _path << std::endl;
 
+        // Other uniforms already use that image
+        else if (_shareTexture(_name, getCanonicalPath(_path) + (_flip ? "|flip" : ""))) {
+            if (_verbose) {
+                std::cout << "// " << _path << " shared as: " << std::endl;
+                std::cout << "//    uniform sampler2D   " << _name  << ";"<< std::endl;
+                std::cout << "//    uniform vec2        " << _name  << "Resolution;"<< std::endl;
+                std::cout << "//    uniform float       " << _name  << "Ready;"<< std::endl;
+            }
+            return true;
+        }
+
         // If we can lets proceed creating a texgure
         else {
 
             Texture* tex = new Texture();
-            // load an image into the texture
-            if (tex->load(_path, _flip)) {
-
-                // the image is loaded finish add the texture to the uniform list
+            // the placeholder goes first, the image once it's decoded
+            if (tex->load(1, 1, 4, 8, texture_placeholder)) {
+
+                std::shared_ptr<TextureJob> job = std::make_shared<TextureJob>();
+                job->texture = tex;
+                job->path = _path;
+                job->flip = _flip;
+                job->done = m_decode_threads.Submit([job]() {
+                    loadImage(job->path, job->flip, &job->image);
+                });
+                m_textures_loading[ _name ] = job;
+
+                // add the texture to the uniform list
                 textures[ _name ] = tex;
+                m_shared_textures[ getCanonicalPath(_path) + (_flip ? "|flip" : "") ] = { tex, 1 };
 
                 // and the file to the watch list
                 WatchFile file;
@@ -219,6 +382,7 @@ bool Uniforms::addTexture(const std::string& _name, const std::string& _path, Wa
                     std::cout << "// " << _path << " loaded as: " << std::endl;
                     std::cout << "//    uniform sampler2D   " << _name  << ";"<< std::endl;
                     std::cout << "//    uniform vec2        " << _name  << "Resolution;"<< std::endl;
+                    std::cout << "//    uniform float       " << _name  << "Ready;"<< std::endl;
                 }
 
                 if (haveExt(_path,"jpeg")) {
@@ -258,6 +422,66 @@ bool Uniforms::addTexture(const std::string& _name, const std::string& _path, Wa
     return false;
 }
 
+bool Uniforms::addTexture(const std::string& _name, const std::vector<unsigned char>& _encoded, bool _flip, bool _verbose) {
+    if (textures.find(_name) != textures.end() || _encoded.empty())
+        return false;
+
+    // The same image can be embedded more than once
+    // Images embedded on models are named by their bytes
+    std::string key = toString(hashBytes(_encoded.data(), _encoded.size())) + ":" + toString(_encoded.size()) + (_flip ? "|flip" : "");
+    if (!_shareTexture(_name, key)) {
+        Texture* tex = new Texture();
+        if (!tex->load(1, 1, 4, 8, texture_placeholder)) {
+            delete tex;
+            return false;
+        }
+
+        std::shared_ptr<TextureJob> job = std::make_shared<TextureJob>();
+        job->texture = tex;
+        job->encoded = _encoded;
+        job->flip = _flip;
+        job->done = m_decode_threads.Submit([job]() {
+            loadImage(&job->encoded[0], (int)job->encoded.size(), job->flip, &job->image);
+        });
+        m_textures_loading[ _name ] = job;
+        textures[ _name ] = tex;
+        m_shared_textures[ key ] = { tex, 1 };
+    }
+
+    if (_verbose) {
+        std::cout << "//    uniform sampler2D   " << _name  << ";"<< std::endl;
+        std::cout << "//    uniform vec2        " << _name  << "Resolution;"<< std::endl;
+        std::cout << "//    uniform float       " << _name  << "Ready;"<< std::endl;
+    }
+
+    return true;
+}
+
+void Uniforms::updateTextures(bool _wait) {
+    std::map<std::string, std::shared_ptr<TextureJob> >::iterator it = m_textures_loading.begin();
+    while (it != m_textures_loading.end()) {
+        TextureJob* job = it->second.get();
+        if (_wait)
+            job->done.wait();
+        else if (job->done.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+            ++it;
+            continue;
+        }
+
+        TextureList::iterator tex = textures.find(it->first);
+        if (tex != textures.end() && tex->second == job->texture && !job->uploaded) {
+            if (job->image.pixels)
+                job->texture->load(job->image, job->path, job->flip);
+            else
+                std::cerr << "Error decoding image for " << it->first << std::endl;
+            job->uploaded = true;
+        }
+
+        it = m_textures_loading.erase(it);
+        m_change = true;
+    }
+}
+
 bool Uniforms::addBumpTexture(const std::string& _name, const std::string& _path, WatchFileList& _files, bool _flip, bool _verbose) {
     if (textures.find(_name) == textures.end()) {
         struct stat st;
@@ -513,10 +737,10 @@ void Uniforms::setCubeMap( const std::string& _filename, WatchFileList& _files,
     }
 }
 
-void Uniforms::checkPresenceIn( const std::string &_vert_src, const std::string &_frag_src ) {
+void Uniforms::checkPresenceIn( const SourceInfo &_vert, const SourceInfo &_frag ) {
     // Check active native uniforms
     for (UniformFunctionsList::iterator it = functions.begin(); it != functions.end(); ++it) {
-        bool present = ( find_id(_vert_src, it->first.c_str()) != 0 || find_id(_frag_src, it->first.c_str()) != 0 );
+        bool present = ( _vert.haveIdentifier(it->first) || _frag.haveIdentifier(it->first) );
         if ( it->second.present != present) {
             it->second.present = present;
             m_change = true;
@@ -524,83 +748,224 @@ void Uniforms::checkPresenceIn( const std::string &_vert_src, const std::string
     }
 }
 
-bool Uniforms::feedTo( Shader &_shader ) {
-    bool update = false;
+void Uniforms::_updateBindings( Shader &_shader ) {
+    _shader.bindings.clear();
+    _shader.bindingsVersion = m_bindings_version;
 
-    // Pass Native uniforms 
-    for (UniformFunctionsList::iterator it=functions.begin(); it!=functions.end(); ++it)
-        if (it->second.present)
-            if (it->second.assign)
-                it->second.assign(_shader);
+    // Uniform blocks are read straight from their buffers
+    if (m_blocks)
+        for (int i = 0; i < UNIFORM_BLOCKS_TOTAL; i++)
+            _shader.setUniformBlock(blocks_names[i], &m_blocks_buffers[i]);
 
+    // Only what the compiled program really uses
+    std::vector<std::string> active = _shader.getActiveUniforms();
+    std::set<std::string> used(active.begin(), active.end());
 
-    // Pass User defined uniforms
-    if (m_change) {
-        for (UniformDataList::iterator it=data.begin(); it!=data.end(); ++it) {
-            if (it->second.change) {
-                if (it->second.bInt) {
-                    if (it->second.size == 1)
-                        _shader.setUniform(it->first, int(it->second.value[0]));
-                    else if (it->second.size == 2)
-                        _shader.setUniform(it->first, int(it->second.value[0]), int(it->second.value[1]));
-                    else if (it->second.size == 3)
-                        _shader.setUniform(it->first, int(it->second.value[0]), int(it->second.value[1]), int(it->second.value[2]));
-                    else if (it->second.size == 4)
-                        _shader.setUniform(it->first, int(it->second.value[0]), int(it->second.value[1]), int(it->second.value[2]), int(it->second.value[3]));
+    // Native uniforms
+    for (UniformFunctionsList::iterator it = functions.begin(); it != functions.end(); ++it)
+        if (it->second.assign && used.count(it->first)) {
+            const UniformFunction* function = &it->second;
+            _shader.bindings.push_back( [function](Shader& _shader) { function->assign(_shader); } );
+        }
+
+    // User defined uniforms, only sent when they change
+    for (UniformDataList::iterator it = data.begin(); it != data.end(); ++it)
+        if (used.count(it->first)) {
+            const std::string* name = &it->first;
+            const UniformData* value = &it->second;
+            _shader.bindings.push_back( [this, name, value](Shader& _shader) {
+                if (!m_change || !value->change)
+                    return;
+
+                if (value->bInt) {
+                    if (value->size == 1)
+                        _shader.setUniform(*name, int(value->value[0]));
+                    else if (value->size == 2)
+                        _shader.setUniform(*name, int(value->value[0]), int(value->value[1]));
+                    else if (value->size == 3)
+                        _shader.setUniform(*name, int(value->value[0]), int(value->value[1]), int(value->value[2]));
+                    else if (value->size == 4)
+                        _shader.setUniform(*name, int(value->value[0]), int(value->value[1]), int(value->value[2]), int(value->value[3]));
                 }
                 else
-                    _shader.setUniform(it->first, it->second.value, it->second.size);
-                update = true;
-            }
+                    _shader.setUniform(*name, value->value, value->size);
+            } );
         }
-    }
 
-    // Pass Textures Uniforms
+    // Textures and their resolution
     for (TextureList::iterator it = textures.begin(); it != textures.end(); ++it) {
-        _shader.setUniformTexture(it->first, it->second, _shader.textureIndex++ );
-        _shader.setUniform(it->first+"Resolution", float(it->second->getWidth()), float(it->second->getHeight()));
+        bool texture = used.count(it->first) > 0;
+        bool resolution = used.count(it->first + "Resolution") > 0;
+        bool ready = used.count(it->first + "Ready") > 0;
+        if (!texture && !resolution && !ready)
+            continue;
+
+        const std::string* name = &it->first;
+        Texture* const* tex = &it->second;
+        UniformHandle<glm::vec2> resolution_handle(it->first + "Resolution");
+        UniformHandle<float> ready_handle(it->first + "Ready");
+        _shader.bindings.push_back( [this, name, tex, texture, resolution, ready, resolution_handle, ready_handle](Shader& _shader) {
+            if (texture)
+                _shader.setUniformTexture(*name, *tex, _shader.textureIndex++ );
+            if (resolution)
+                _shader.setUniform(resolution_handle, glm::vec2((*tex)->getWidth(), (*tex)->getHeight()));
+            if (ready)
+                _shader.setUniform(ready_handle, m_textures_loading.count(*name) ? 0.0f : 1.0f);
+        } );
     }
 
     for (StreamsList::iterator it = streams.begin(); it != streams.end(); ++it) {
-        _shader.setUniform(it->first+"CurrentFrame", float(it->second->getCurrentFrame()));
-        _shader.setUniform(it->first+"TotalFrames", float(it->second->getTotalFrames()));
+        bool current = used.count(it->first + "CurrentFrame") > 0;
+        bool total = used.count(it->first + "TotalFrames") > 0;
+        if (!current && !total)
+            continue;
+
+        TextureStream* const* stream = &it->second;
+        UniformHandle<float> current_handle(it->first + "CurrentFrame");
+        UniformHandle<float> total_handle(it->first + "TotalFrames");
+        _shader.bindings.push_back( [stream, current, total, current_handle, total_handle](Shader& _shader) {
+            if (current)
+                _shader.setUniform(current_handle, float((*stream)->getCurrentFrame()));
+            if (total)
+                _shader.setUniform(total_handle, float((*stream)->getTotalFrames()));
+        } );
     }
 
-    // Pass Buffers Texture
-    for (unsigned int i = 0; i < buffers.size(); i++)
-        _shader.setUniformTexture("u_buffer" + toString(i), &buffers[i], _shader.textureIndex++ );
+    // Buffers
+    for (unsigned int i = 0; i < buffers.size(); i++) {
+        std::string name = "u_buffer" + toString(i);
+        if (used.count(name))
+            _shader.bindings.push_back( [this, i, name](Shader& _shader) {
+                if (buffers[i])
+                    _shader.setUniformTexture(name, buffers[i], _shader.textureIndex++ );
+            } );
+    }
 
-    // Pass Convolution Piramids resultant Texture
-    for (unsigned int i = 0; i < convolution_pyramids.size(); i++)
-        _shader.setUniformTexture("u_convolutionPyramid" + toString(i), convolution_pyramids[i].getResult(), _shader.textureIndex++ );
-    
-    // Pass Light Uniforms
-    if (lights.size() == 1) {
+    // Convolution Piramids resultant Texture
+    for (unsigned int i = 0; i < convolution_pyramids.size(); i++) {
+        std::string name = "u_convolutionPyramid" + toString(i);
+        if (used.count(name))
+            _shader.bindings.push_back( [this, i, name](Shader& _shader) {
+                _shader.setUniformTexture(name, convolution_pyramids[i].getResult(), _shader.textureIndex++ );
+            } );
+    }
+
+    // Lights
+    if (used.count("u_light") || used.count("u_lightColor") || used.count("u_lightDirection") ||
+        used.count("u_lightIntensity") || used.count("u_lightFalloff") || used.count("u_lightMatrix"))
+        _shader.bindings.push_back( [this](Shader& _shader) { _feedLights(_shader); } );
+
+    if (used.count("u_lightsPosition") || used.count("u_lightsColor") || used.count("u_lightsDirection") || used.count("u_lightsTotal"))
+        _shader.bindings.push_back( [this](Shader& _shader) { _feedLightArrays(_shader); } );
+}
+
+void Uniforms::_feedLights( Shader &_shader ) {
+    // The first light, the one with the shadow map. The rest are on the arrays (see _feedLightArrays)
+    if (lights.size() > 0) {
         if (lights[0].getType() != LIGHT_DIRECTIONAL)
-            _shader.setUniform("u_light", lights[0].getPosition());
-        _shader.setUniform("u_lightColor", lights[0].color);
+            _shader.setUniform(u_light, lights[0].getPosition());
+        _shader.setUniform(u_lightColor, lights[0].color);
         if (lights[0].getType() == LIGHT_DIRECTIONAL || lights[0].getType() == LIGHT_SPOT)
-            _shader.setUniform("u_lightDirection", lights[0].direction);
-        _shader.setUniform("u_lightIntensity", lights[0].intensity);
+            _shader.setUniform(u_lightDirection, lights[0].direction);
+        _shader.setUniform(u_lightIntensity, lights[0].intensity);
         if (lights[0].falloff > 0)
-            _shader.setUniform("u_lightFalloff", lights[0].falloff);
-        _shader.setUniform("u_lightMatrix", lights[0].getBiasMVPMatrix() );
+            _shader.setUniform(u_lightFalloff, lights[0].falloff);
+        _shader.setUniform(u_lightMatrix, lights[0].getBiasMVPMatrix() );
     }
-    else {
-        for (unsigned int i = 0; i < lights.size(); i++) {
-            if (lights[i].getType() != LIGHT_DIRECTIONAL)
-                _shader.setUniform("u_light", lights[i].getPosition());
-            _shader.setUniform("u_lightColor", lights[i].color);
-            if (lights[i].getType() == LIGHT_DIRECTIONAL || lights[i].getType() == LIGHT_SPOT)
-                _shader.setUniform("u_lightDirection", lights[i].direction);
-            _shader.setUniform("u_lightIntensity", lights[i].intensity);
-            if (lights[i].falloff > 0)
-                _shader.setUniform("u_lightFalloff", lights[i].falloff);
-            _shader.setUniform("u_lightMatrix", lights[i].getBiasMVPMatrix() );
-        }
+}
+
+void Uniforms::_feedLightArrays( Shader &_shader ) {
+    LightArraysBlock arrays;
+    fillLightArrays(lights, arrays);
+    _shader.setUniform("u_lightsPosition", arrays.position, LIGHTS_MAX);
+    _shader.setUniform("u_lightsColor", arrays.color, LIGHTS_MAX);
+    _shader.setUniform("u_lightsDirection", arrays.direction, LIGHTS_MAX);
+    _shader.setUniform(u_lightsTotal, arrays.total);
+}
+
+bool Uniforms::setBlocks( bool _enable ) {
+    _enable = _enable && UniformBuffer::isSupported();
+    if (_enable == m_blocks)
+        return m_blocks;
+
+    for (int i = 0; i < UNIFORM_BLOCKS_TOTAL; i++) {
+        if (_enable)
+            _enable = m_blocks_buffers[i].allocate(i, blocks_sizes[i]);
+        else
+            m_blocks_buffers[i].clear();
     }
 
-    return update;
+    m_blocks = _enable;
+    m_bindings_version++;
+    return m_blocks;
+}
+
+void Uniforms::updateBlocks() {
+    if (!m_blocks)
+        return;
+
+    Camera& cam = getCamera();
+    CameraBlock camera;
+    camera.viewMatrix = cam.getViewMatrix();
+    camera.projectionMatrix = cam.getProjectionMatrix();
+    glm::mat3 normalMatrix = cam.getNormalMatrix();
+    for (int i = 0; i < 3; i++)
+        camera.normalMatrix[i] = glm::vec4(normalMatrix[i], 0.0f);
+    camera.position = -cam.getPosition();
+    camera.distance = cam.getDistance();
+    camera.nearClip = cam.getNearClip();
+    camera.farClip = cam.getFarClip();
+    camera.ev100 = cam.getEv100();
+    camera.exposure = cam.getExposure();
+    camera.aperture = cam.getAperture();
+    camera.shutterSpeed = cam.getShutterSpeed();
+    camera.sensitivity = cam.getSensitivity();
+    camera.padding = 0.0f;
+    m_blocks_buffers[UNIFORM_BLOCK_CAMERA].update(&camera);
+
+    // Like the plain uniforms, the block has the first light
+    LightsBlock light;
+    if (lights.size() > 0) {
+        Light& first = lights[0];
+        if (first.getType() != LIGHT_DIRECTIONAL)
+            light.position = first.getPosition();
+        light.intensity = first.intensity;
+        light.color = first.color;
+        if (first.falloff > 0)
+            light.falloff = first.falloff;
+        if (first.getType() == LIGHT_DIRECTIONAL || first.getType() == LIGHT_SPOT)
+            light.direction = first.direction;
+    }
+    m_blocks_buffers[UNIFORM_BLOCK_LIGHTS].update(&light);
+
+    LightArraysBlock arrays;
+    fillLightArrays(lights, arrays);
+    m_blocks_buffers[UNIFORM_BLOCK_LIGHT_ARRAYS].update(&arrays);
+
+    m_blocks_buffers[UNIFORM_BLOCK_FRAME].update(&frame);
+
+    IblBlock ibl;
+    for (int i = 0; i < 9; i++)
+        ibl.SH[i] = glm::vec4(cubemap ? cubemap->SH[i] : glm::vec3(0.0f), 0.0f);
+    ibl.luminance = 30000.0f * cam.getExposure();
+    m_blocks_buffers[UNIFORM_BLOCK_IBL].update(&ibl);
+}
+
+void Uniforms::feedTo( Shader &_shader ) {
+    // Anything added or removed since the bindings were made (most are caught by
+    // the ones adding them, this catches the containers filled from outside)
+    size_t sizes[UNIFORMS_BINDING_SIZES] = { functions.size(), data.size(), textures.size(), streams.size(),
+                                             buffers.size(), convolution_pyramids.size(), lights.size() };
+    if (memcmp(sizes, m_bindings_sizes, sizeof(sizes)) != 0) {
+        memcpy(m_bindings_sizes, sizes, sizeof(sizes));
+        m_bindings_version++;
+    }
+
+    if (_shader.bindingsVersion != m_bindings_version)
+        _updateBindings(_shader);
+
+    for (size_t i = 0; i < _shader.bindings.size(); i++)
+        _shader.bindings[i](_shader);
 }
 
 void Uniforms::flagChange() {
@@ -645,6 +1010,7 @@ bool Uniforms::haveChange() {
 
     return  m_change || 
             streams.size() > 0 ||
+            m_textures_loading.size() > 0 ||
             functions["u_time"].present || 
             functions["u_delta"].present ||
             functions["u_mouse"].present ||
@@ -652,6 +1018,34 @@ bool Uniforms::haveChange() {
             lightChange || getCamera().bChange;
 }
 
+// _name is the uniform of _texture, or one of its <texture>Resolution, <texture>Ready, ...
+static bool isTextureUniform( const std::string& _name, const std::string& _texture ) {
+    static const char* suffixes[] = { "", "Resolution", "Ready", "CurrentFrame", "TotalFrames" };
+    if (_name.size() < _texture.size() || _name.compare(0, _texture.size(), _texture) != 0)
+        return false;
+
+    for (size_t i = 0; i < sizeof(suffixes) / sizeof(suffixes[0]); i++)
+        if (_name.compare(_texture.size(), std::string::npos, suffixes[i]) == 0)
+            return true;
+    return false;
+}
+
+bool Uniforms::isChanging( const std::string& _name ) const {
+    UniformFunctionsList::const_iterator function = functions.find(_name);
+    if (function != functions.end())
+        return function->second.type.compare(0, 7, "sampler") == 0;
+
+    for (StreamsList::const_iterator it = streams.begin(); it != streams.end(); ++it)
+        if (isTextureUniform(_name, it->first))
+            return true;
+
+    for (std::map<std::string, std::shared_ptr<TextureJob> >::const_iterator it = m_textures_loading.begin(); it != m_textures_loading.end(); ++it)
+        if (isTextureUniform(_name, it->first))
+            return true;
+
+    return false;
+}
+
 void Uniforms::clear() {
 
     if (cubemap) {
@@ -662,11 +1056,14 @@ void Uniforms::clear() {
     // Delete Textures
     for (TextureList::iterator i = textures.begin(); i != textures.end(); ++i) {
         if (i->second) {
-            delete i->second;
+            _releaseTexture(i->second);
             i->second = nullptr;
         }
     }
     textures.clear();
+    m_textures_loading.clear();
+    m_shared_textures.clear();
+    m_bindings_version++;
 
     // Streams are textures so it should be clear by now;
     // streams.clear();
@@ -729,6 +1126,7 @@ void Uniforms::printTextures(){
     for (TextureList::iterator it = textures.begin(); it != textures.end(); ++it) {
         std::cout << "sampler2D," << it->first << ',' << it->second->getFilePath() << std::endl;
         std::cout << "vec2," << it->first << "Resolution," << toString(it->second->getWidth(), 1) << "," << toString(it->second->getHeight(), 1) << std::endl;
+        std::cout << "float," << it->first << "Ready," << (m_textures_loading.count(it->first) ? "0.0" : "1.0") << std::endl;
     }
 
     for (StreamsList::iterator it = streams.begin(); it != streams.end(); ++it) {
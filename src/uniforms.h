@@ -3,20 +3,50 @@
 #include <map>
 #include <vector>
 #include <string>
+#include <memory>
 #include <functional>
 
+#include "thread_pool/thread_pool.hpp"
+
 #include "gl/fbo.h"
 #include "gl/shader.h"
 #include "gl/texture.h"
 #include "gl/textureStream.h"
 #include "gl/textureAudio.h"
+#include "gl/uniformBuffer.h"
 
 #include "types/convolutionPyramid.h"
 
 #include "scene/light.h"
 #include "scene/camera.h"
+#include "scene/lightClusters.h"
 
 #include "io/fs.h"
+#include "tools/sourceInfo.h"
+
+// Containers watched to know when the bindings of the shaders have to be made again
+#define UNIFORMS_BINDING_SIZES 7
+
+// Fixed binding points of the uniform blocks shared by all the shaders
+enum UniformBlockBinding {
+    UNIFORM_BLOCK_CAMERA = 0,
+    UNIFORM_BLOCK_LIGHTS,
+    UNIFORM_BLOCK_FRAME,
+    UNIFORM_BLOCK_IBL,
+    UNIFORM_BLOCK_LIGHT_ARRAYS,
+    UNIFORM_BLOCKS_TOTAL
+};
+
+// Time, viewport and mouse of the current frame, laid out as the FrameBlock uniform block (std140)
+struct FrameBlock {
+    glm::vec4   date        = glm::vec4(0.0f);
+    glm::vec2   resolution  = glm::vec2(0.0f);
+    glm::vec2   mouse       = glm::vec2(0.0f);
+    float       time        = 0.0f;
+    float       delta       = 0.0f;
+    int         frame       = 0;
+    float       padding     = 0.0f;
+};
 
 struct UniformData {
     std::string getType();
@@ -45,6 +75,8 @@ typedef std::map<std::string, UniformFunction> UniformFunctionsList;
 typedef std::map<std::string, Texture*> TextureList;
 typedef std::map<std::string, TextureStream*> StreamsList;
 
+struct TextureJob;
+
 class Uniforms {
 public:
     Uniforms();
@@ -54,7 +86,14 @@ public:
     bool                    parseLine( const std::string &_line );
 
     bool                    addTexture( const std::string& _name, Texture* _texture );
+
+    // Images are decoded on a pool of threads. Until they are uploaded (by updateTextures()) the
+    // texture is a 1x1 placeholder and u_<name>Ready is 0. _encoded are the bytes of a png, jpg, ...
     bool                    addTexture( const std::string& _name, const std::string& _path, WatchFileList& _files, bool _flip = true, bool _verbose = true );
+    bool                    addTexture( const std::string& _name, const std::vector<unsigned char>& _encoded, bool _flip = false, bool _verbose = true );
+    void                    updateTextures( bool _wait = false );
+    bool                    haveTexturesLoading() const { return !m_textures_loading.empty(); }
+
     bool                    addBumpTexture( const std::string& _name, const std::string& _path, WatchFileList& _files, bool _flip = true, bool _verbose = true );
     bool                    addStreamingTexture( const std::string& _name, const std::string& _url, bool _flip = true, bool _device = false, bool _verbose = true );
     bool                    addAudioTexture( const std::string& _name, const std::string& device_id, bool _flip = false, bool _verbose = true );
@@ -69,14 +108,23 @@ public:
     void                    setCubeMap( const std::string& _filename, WatchFileList& _files, bool _verbose = true);
 
     // Check presence of uniforms on shaders
-    void                    checkPresenceIn( const std::string &_vert_src, const std::string &_frag_src );
+    void                    checkPresenceIn( const SourceInfo &_vert, const SourceInfo &_frag );
 
 
-    // Feed uniforms to a specific shader
-    bool                    feedTo( Shader &_shader );
+    // Feed uniforms to a specific shader. The first time (and after it relinks or
+    // uniforms are added or removed) it makes the list of the ones the shader uses
+    void                    feedTo( Shader &_shader );
 
     Camera&                 getCamera() { return cameras[0]; }
 
+    // Camera, lights, time and IBL can also go on uniform blocks (CameraBlock, LightsBlock, FrameBlock,
+    // IblBlock and LightArraysBlock) read by all the shaders that declare them. Returns if they are in use (they need GL 3.1)
+    bool                    setBlocks( bool _enable );
+    bool                    haveBlocks() const { return m_blocks; }
+
+    // Uploads the blocks that changed. Once per frame, and again if the camera moves in between
+    void                    updateBlocks();
+
     // Debug
     void                    print(bool _all);
     void                    printBuffers();
@@ -88,6 +136,10 @@ public:
     void                    unflagChange();
     bool                    haveChange();
 
+    // If what _name shows can change while the values sent to the shaders stay the same: textures made by
+    // functions (u_scene, shadow maps...), streams and images still decoding (also their <name>Resolution, <name>Ready, ...)
+    bool                    isChanging( const std::string& _name ) const;
+
     void                    clear();
 
     // Manually defined uniforms (through console IN)
@@ -101,16 +153,43 @@ public:
     StreamsList             streams;
 
     TextureCube*            cubemap;
-    std::vector<Fbo>        buffers;
+    std::vector<Fbo*>       buffers;            // owned by the render graph, null for the ones nothing reads
     std::vector<ConvolutionPyramid> convolution_pyramids;
 
     // 3d Scene Uniforms 
     std::vector<Camera>     cameras;
     std::vector<Light>      lights;
 
+    // Filled by the owner of the clock before updateBlocks()
+    FrameBlock              frame;
+
 protected:
+    void                    _updateBindings( Shader &_shader );
+    void                    _feedLights( Shader &_shader );
+    void                    _feedLightArrays( Shader &_shader );
+
+    UniformBuffer           m_blocks_buffers[UNIFORM_BLOCKS_TOTAL];
+
+    // Textures made from the same image (by canonical path, or by the bytes of the ones embedded
+    // on models) are shared by all the uniforms using it, and deleted with the last one of them
+    struct SharedTexture {
+        Texture*            texture;
+        size_t              users;
+    };
+    bool                    _shareTexture( const std::string& _name, const std::string& _key );
+    void                    _releaseTexture( Texture* _texture );
+    std::map<std::string, SharedTexture> m_shared_textures;
+
+    thread_pool::ThreadPool m_decode_threads;
+    std::map<std::string, std::shared_ptr<TextureJob> > m_textures_loading;
+
     bool                    m_change;
     bool                    m_is_audio_init;
+    bool                    m_blocks;
+
+    // Bumped every time the bindings made for the shaders can be out of date
+    size_t                  m_bindings_version;
+    size_t                  m_bindings_sizes[UNIFORMS_BINDING_SIZES];
 };
 
 
@@ -601,15 +601,16 @@ void debounceSetWindowTitle(std::string title){
 }
 #endif
 
-void updateGL() {
+void updateGL(bool _rest) {
     // Update time
     // --------------------------------------------------------------------
 
     #if defined(DRIVER_GLFW)
         double now = glfwGetTime();
 
+        // Rest to keep the max FPS, unless asked to go as fast as possible
         float diff = now - fTime;
-        if (diff < fRestSec) {
+        if (_rest && diff < fRestSec) {
             pal_sleep(int((fRestSec - diff) * 1000000));
             now = glfwGetTime();
         }
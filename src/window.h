@@ -15,7 +15,7 @@ enum WindowStyle {
 //----------------------------------------------
 void initGL(glm::ivec4 &_viewport, WindowStyle _prop = REGULAR);
 bool isGL();
-void updateGL();
+void updateGL(bool _rest = true);
 void renderGL();
 void closeGL();
 